@@ -22,6 +22,16 @@
 #include <stdlib.h> 		// malloc
 #include <string.h> 		// memset
 #include <math.h> 			// sin, cos
+#include <time.h> 			// clock_gettime
+#include <pthread.h> 		// pthread_create, pthread_mutex_lock, pthread_cond_wait
+#include <unistd.h> 		// sysconf, close
+#include <sys/stat.h> 		// stat, fstat
+#ifdef _WIN32
+#	include <windows.h> 		// QueryPerformanceCounter
+#else
+#	include <fcntl.h> 		// open
+#	include <sys/mman.h> 	// mmap, munmap
+#endif
 
 #if defined(__cplusplus) && (__cplusplus >= 201103L)
 #	define PVK_CONSTEXPR constexpr
@@ -68,6 +78,28 @@ PVK_LINKAGE void __PVK_DELETE(char** ptr)
 }
 #endif
 
+/* Timing */
+/* returns a monotonically increasing time in nano seconds (unaffected by wall clock adjustments), only meaningful as a difference */
+PVK_LINKAGE uint64_t pvkGetTimeNs();
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE uint64_t pvkGetTimeNs()
+{
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	/* split to avoid overflowing 64 bits for large counter values */
+	uint64_t seconds = (uint64_t)counter.QuadPart / (uint64_t)frequency.QuadPart;
+	uint64_t remainder = (uint64_t)counter.QuadPart % (uint64_t)frequency.QuadPart;
+	return seconds * 1000000000ull + remainder * 1000000000ull / (uint64_t)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+#endif
+
 /* Mathematics */
 
 PVK_STATIC PVK_CONSTEXPR double PVK_PI = 3.1415926;
@@ -457,6 +489,12 @@ PVK_STATIC PVK_INLINE void pvkWindowPollEvents(PvkWindow* window)
 	glfwPollEvents();
 }
 
+/* blocks until there is an event, e.g. while the window is minimized and there is nothing to render */
+PVK_STATIC PVK_INLINE void pvkWindowWaitEvents(PvkWindow* window)
+{
+	glfwWaitEvents();
+}
+
 PVK_LINKAGE void pvkWindowDestroy(PvkWindow* window);
 #ifdef PVK_IMPLEMENTATION
 PVK_LINKAGE void pvkWindowDestroy(PvkWindow* window)
@@ -684,6 +722,68 @@ PVK_LINKAGE bool __pvkIsDeviceFeaturesSupported(VkPhysicalDevice device, VkPhysi
 }
 #endif
 
+PVK_LINKAGE bool pvkIsDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkIsDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName)
+{
+	uint32_t extensionCount;
+	PVK_CHECK(vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, NULL));
+	VkExtensionProperties* extensions = PVK_NEWV(VkExtensionProperties, extensionCount);
+	PVK_CHECK(vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, extensions));
+	bool isSupported = false;
+	for(uint32_t i = 0; i < extensionCount; i++)
+		if(strcmp(extensions[i].extensionName, extensionName) == 0)
+		{
+			isSupported = true;
+			break;
+		}
+	PVK_DELETE(extensions);
+	return isSupported;
+}
+#endif
+
+/* the instances are created with apiVersion 1.0, so vkGetPhysicalDeviceFeatures2 is only available through 
+ * VK_KHR_get_physical_device_properties2, returns false if the instance hasn't been created with it
+ * isExtensionEnabled: true if the instance has been created with VK_KHR_get_physical_device_properties2, 
+ * 					   a loader may return the entry points of an extension which hasn't been enabled, so they aren't used to decide it */
+PVK_LINKAGE bool __pvkGetPhysicalDeviceFeatures2(VkInstance instance, bool isExtensionEnabled, VkPhysicalDevice device, VkPhysicalDeviceFeatures2* features2);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool __pvkGetPhysicalDeviceFeatures2(VkInstance instance, bool isExtensionEnabled, VkPhysicalDevice device, VkPhysicalDeviceFeatures2* features2)
+{
+	if(!isExtensionEnabled)
+		return false;
+	PFN_vkGetPhysicalDeviceFeatures2 getPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+	if(getPhysicalDeviceFeatures2 == NULL)
+		PVK_FETAL_ERROR("VK_KHR_get_physical_device_properties2 is enabled but its functions can't be loaded");
+	getPhysicalDeviceFeatures2(device, features2);
+	return true;
+}
+#endif
+
+/* returns true if the device supports VK_KHR_timeline_semaphore and its timelineSemaphore feature,
+ * isExtensionEnabled: true if the instance has been created with VK_KHR_get_physical_device_properties2, 
+ * 					   the feature can't be queried without it and false is returned */
+PVK_LINKAGE bool pvkIsTimelineSemaphoreSupported(VkInstance instance, bool isExtensionEnabled, VkPhysicalDevice device);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkIsTimelineSemaphoreSupported(VkInstance instance, bool isExtensionEnabled, VkPhysicalDevice device)
+{
+	if(!pvkIsDeviceExtensionSupported(device, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+		return false;
+
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = { };
+	timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	VkPhysicalDeviceFeatures2 features2 = { };
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &timelineSemaphoreFeatures;
+	if(!__pvkGetPhysicalDeviceFeatures2(instance, isExtensionEnabled, device, &features2))
+	{
+		PVK_WARNING("VK_KHR_get_physical_device_properties2 isn't enabled on the instance, timeline semaphores can't be used");
+		return false;
+	}
+	return timelineSemaphoreFeatures.timelineSemaphore == VK_TRUE;
+}
+#endif
+
 PVK_LINKAGE bool __pvkIsPhysicalDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface, PvkPhysicalDeviceRequirements* requirements);
 #ifdef PVK_IMPLEMENTATION
 PVK_LINKAGE bool __pvkIsPhysicalDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface, PvkPhysicalDeviceRequirements* requirements)
@@ -807,6 +907,44 @@ PVK_LINKAGE uint32_t pvkFindQueueFamilyIndex(VkPhysicalDevice device, VkQueueFla
 }
 #endif
 
+/* returns the queue family best suited for asynchronous uploads: a transfer only family (dedicated DMA engine) if the device
+ * has one, otherwise a family without graphics support, otherwise the first graphics family (no ownership transfers are needed then) */
+PVK_LINKAGE uint32_t pvkFindTransferQueueFamilyIndex(VkPhysicalDevice device);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE uint32_t pvkFindTransferQueueFamilyIndex(VkPhysicalDevice device)
+{
+	uint32_t count;
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &count, NULL);
+	VkQueueFamilyProperties* properties = PVK_NEWV(VkQueueFamilyProperties, count);
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &count, properties);
+
+	uint32_t index = UINT32_MAX;
+	uint32_t nonGraphicsIndex = UINT32_MAX;
+	for(int i = 0; i < count; i++)
+	{
+		/* graphics and compute queues implicitly support transfer operations */
+		VkQueueFlags flags = properties[i].queueFlags;
+		if((flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0)
+		{
+			if(flags & VK_QUEUE_TRANSFER_BIT)
+			{
+				index = i;
+				break;
+			}
+		}
+		else if(((flags & VK_QUEUE_GRAPHICS_BIT) == 0) && (nonGraphicsIndex == UINT32_MAX))
+			nonGraphicsIndex = i;
+	}
+	PVK_DELETE(properties);
+
+	if(index == UINT32_MAX)
+		index = nonGraphicsIndex;
+	if(index == UINT32_MAX)
+		index = pvkFindQueueFamilyIndex(device, VK_QUEUE_GRAPHICS_BIT);
+	return index;
+}
+#endif
+
 PVK_LINKAGE uint32_t pvkFindQueueFamilyIndexWithPresentSupport(VkPhysicalDevice device, VkSurfaceKHR surface);
 #ifdef PVK_IMPLEMENTATION
 PVK_LINKAGE uint32_t pvkFindQueueFamilyIndexWithPresentSupport(VkPhysicalDevice device, VkSurfaceKHR surface)
@@ -855,13 +993,30 @@ PVK_LINKAGE void __pvkUnionUInt32(uint32_t count, const uint32_t* values, uint32
 }
 #endif
 
-PVK_LINKAGE VkDevice pvkCreateLogicalDeviceWithExtensions(VkInstance instance, VkPhysicalDevice physicalDevice, 
-													uint32_t queueFamilyCount, uint32_t* queueFamilyIndices, bool samplerYcbcrConversion,
-													uint32_t extensionCount, ...);
+/* the features which pvkCreateLogicalDevice* enable on physicalDevice (the optional ones only if it supports them),
+ * e.g. for pvkCreateDrawList */
+PVK_LINKAGE VkPhysicalDeviceFeatures pvkGetLogicalDeviceFeatures(VkPhysicalDevice physicalDevice);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE VkDevice pvkCreateLogicalDeviceWithExtensions(VkInstance instance, VkPhysicalDevice physicalDevice, 
-													uint32_t queueFamilyCount, uint32_t* queueFamilyIndices, bool samplerYcbcrConversion,
-													uint32_t extensionCount, ...)
+PVK_LINKAGE VkPhysicalDeviceFeatures pvkGetLogicalDeviceFeatures(VkPhysicalDevice physicalDevice)
+{
+	// TODO: make features configurable
+	/* the indirect draws of PvkDrawList are issued with fewer calls if these are available */
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+	VkPhysicalDeviceFeatures features = { };
+	features.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	features.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	return features;
+}
+#endif
+
+PVK_LINKAGE VkDevice __pvkCreateLogicalDevice(VkInstance instance, VkPhysicalDevice physicalDevice, 
+													uint32_t queueFamilyCount, uint32_t* queueFamilyIndices, bool samplerYcbcrConversion, bool timelineSemaphore,
+													uint32_t extensionCount, const char** extensions);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkDevice __pvkCreateLogicalDevice(VkInstance instance, VkPhysicalDevice physicalDevice, 
+													uint32_t queueFamilyCount, uint32_t* queueFamilyIndices, bool samplerYcbcrConversion, bool timelineSemaphore,
+													uint32_t extensionCount, const char** extensions)
 {
 	// union operation
 	uint32_t uniqueQueueFamilyCount;
@@ -882,14 +1037,6 @@ PVK_LINKAGE VkDevice pvkCreateLogicalDeviceWithExtensions(VkInstance instance, V
 		};
 	}
 
-	// create extensions array from the variable arguments list
-	const char* extensions[extensionCount];
-	va_list args;
-	va_start(args, extensionCount);
-	for(int i = 0; i < extensionCount; i++)
-		extensions[i] = va_arg(args, const char*);
-	va_end(args);
-
 	// check for device extension support
 	uint32_t supportedExtensionCount;
 	PVK_CHECK(vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &supportedExtensionCount, NULL));
@@ -912,11 +1059,21 @@ PVK_LINKAGE VkDevice pvkCreateLogicalDeviceWithExtensions(VkInstance instance, V
 	}
 	PVK_DELETE(supportedExtensions);
 
-	// TODO: make features configurable
-	VkPhysicalDeviceFeatures features = { };
+	VkPhysicalDeviceFeatures features = pvkGetLogicalDeviceFeatures(physicalDevice);
 	VkPhysicalDeviceSamplerYcbcrConversionFeatures samplerYcbcrConversionFeatures = { };
 	samplerYcbcrConversionFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SAMPLER_YCBCR_CONVERSION_FEATURES;
 	samplerYcbcrConversionFeatures.samplerYcbcrConversion = VK_TRUE;
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = { };
+	timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+	if(timelineSemaphore)
+	{
+		/* VK_KHR_timeline_semaphore depends on VK_KHR_get_physical_device_properties2 on a 1.0 instance, 
+		 * requesting timeline semaphores requires the instance to have been created with it */
+		if(!pvkIsTimelineSemaphoreSupported(instance, true, physicalDevice))
+			PVK_FETAL_ERROR("Timeline semaphores aren't supported, check pvkIsTimelineSemaphoreSupported before requesting them");
+		samplerYcbcrConversionFeatures.pNext = &timelineSemaphoreFeatures;
+	}
 
 	VkDeviceCreateInfo dcInfo = { };
 	{
@@ -935,6 +1092,48 @@ PVK_LINKAGE VkDevice pvkCreateLogicalDeviceWithExtensions(VkInstance instance, V
 }
 #endif
 
+PVK_LINKAGE VkDevice pvkCreateLogicalDeviceWithExtensions(VkInstance instance, VkPhysicalDevice physicalDevice, 
+													uint32_t queueFamilyCount, uint32_t* queueFamilyIndices, bool samplerYcbcrConversion,
+													uint32_t extensionCount, ...);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkDevice pvkCreateLogicalDeviceWithExtensions(VkInstance instance, VkPhysicalDevice physicalDevice, 
+													uint32_t queueFamilyCount, uint32_t* queueFamilyIndices, bool samplerYcbcrConversion,
+													uint32_t extensionCount, ...)
+{
+	// create extensions array from the variable arguments list
+	const char* extensions[extensionCount];
+	va_list args;
+	va_start(args, extensionCount);
+	for(int i = 0; i < extensionCount; i++)
+		extensions[i] = va_arg(args, const char*);
+	va_end(args);
+	return __pvkCreateLogicalDevice(instance, physicalDevice, queueFamilyCount, queueFamilyIndices, samplerYcbcrConversion, false, extensionCount, extensions);
+}
+#endif
+
+/* timelineSemaphore: enables VK_KHR_timeline_semaphore (and its feature), see pvkIsTimelineSemaphoreSupported,
+ * 					  the instance must have been created with VK_KHR_get_physical_device_properties2 */
+PVK_LINKAGE VkDevice pvkCreateLogicalDeviceWithExtensions2(VkInstance instance, VkPhysicalDevice physicalDevice, 
+													uint32_t queueFamilyCount, uint32_t* queueFamilyIndices, bool samplerYcbcrConversion, bool timelineSemaphore,
+													uint32_t extensionCount, ...);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkDevice pvkCreateLogicalDeviceWithExtensions2(VkInstance instance, VkPhysicalDevice physicalDevice, 
+													uint32_t queueFamilyCount, uint32_t* queueFamilyIndices, bool samplerYcbcrConversion, bool timelineSemaphore,
+													uint32_t extensionCount, ...)
+{
+	// create extensions array from the variable arguments list
+	const char* extensions[extensionCount + 1];
+	va_list args;
+	va_start(args, extensionCount);
+	for(int i = 0; i < extensionCount; i++)
+		extensions[i] = va_arg(args, const char*);
+	va_end(args);
+	if(timelineSemaphore)
+		extensions[extensionCount++] = VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME;
+	return __pvkCreateLogicalDevice(instance, physicalDevice, queueFamilyCount, queueFamilyIndices, samplerYcbcrConversion, timelineSemaphore, extensionCount, extensions);
+}
+#endif
+
 #ifdef PVK_USE_WIN32_SURFACE
 PVK_LINKAGE VkSurfaceKHR pvkCreateSurface(VkInstance vkInstance, HINSTANCE instance, HWND handle);
 #ifdef PVK_IMPLEMENTATION
@@ -1045,6 +1244,21 @@ PVK_LINKAGE VkSemaphore pvkCreateSemaphore(VkDevice device)
 }
 #endif
 
+PVK_STATIC PVK_INLINE VkSemaphore* __pvkCreateSemaphores(VkDevice device, uint32_t count)
+{
+	VkSemaphore* semaphores = PVK_NEWV(VkSemaphore, count);
+	for(uint32_t i = 0; i < count; i++)
+		semaphores[i] = pvkCreateSemaphore(device);
+	return semaphores;
+}
+
+PVK_STATIC PVK_INLINE void __pvkDestroySemaphores(VkDevice device, uint32_t count, VkSemaphore* semaphores)
+{
+	for(uint32_t i = 0; i < count; i++)
+		vkDestroySemaphore(device, semaphores[i], NULL);
+	PVK_DELETE(semaphores);
+}
+
 PVK_LINKAGE VkFence pvkCreateFence(VkDevice device, VkFenceCreateFlags flags);
 #ifdef PVK_IMPLEMENTATION
 PVK_LINKAGE VkFence pvkCreateFence(VkDevice device, VkFenceCreateFlags flags)
@@ -1122,10 +1336,22 @@ PVK_LINKAGE void pvkResetFences(VkDevice device, uint32_t fenceCount, VkFence* f
 }
 #endif
 
+/* default timeout of the blocking waits on a PvkFencePool, long enough to never expire unless the GPU has hung */
+#define PVK_FENCE_POOL_WAIT_TIMEOUT 1000000000ULL /* nano seconds */
+
 typedef struct PvkFencePool
 {
 	VkFence* fences;
 	uint32_t reserveCount;
+	/* index of the first fence checked by the next pvkFencePoolWaitAny, the fences are handed out in round robin order */
+	uint32_t nextIndex;
+	/* stats of pvkFencePoolWaitAny */
+	uint64_t waitCount;
+	/* number of waits which had to block because none of the fences was signaled */
+	uint64_t blockCount;
+	uint64_t timeoutCount;
+	uint64_t blockedTimeNs;
+	uint64_t maxBlockedTimeNs;
 } PvkFencePool;
 
 PVK_LINKAGE PvkFencePool* pvkCreateFencePool(VkDevice device, uint32_t reserveCount);
@@ -1135,6 +1361,12 @@ PVK_LINKAGE PvkFencePool* pvkCreateFencePool(VkDevice device, uint32_t reserveCo
 	PvkFencePool* pool = (PvkFencePool*)PVK_MALLOC(sizeof(PvkFencePool));
 	pool->fences = (VkFence*)PVK_MALLOC(sizeof(VkFence) * reserveCount);
 	pool->reserveCount = reserveCount;
+	pool->nextIndex = 0;
+	pool->waitCount = 0;
+	pool->blockCount = 0;
+	pool->timeoutCount = 0;
+	pool->blockedTimeNs = 0;
+	pool->maxBlockedTimeNs = 0;
 	for(uint32_t i = 0; i < reserveCount; i++)
 		pool->fences[i] = pvkCreateFence(device, VK_FENCE_CREATE_SIGNALED_BIT);
 	return pool;
@@ -1174,6 +1406,76 @@ PVK_LINKAGE bool pvkFencePoolAcquire(VkDevice device, PvkFencePool* pool, VkFenc
 }
 #endif
 
+/* blocks (for at most timeout nano seconds) until any fence of the pool is signaled, the fences are checked in round robin order
+ * starting after the one returned last time. Unlike pvkFencePoolAcquire the fence isn't reset, the caller resets it right before
+ * submitting the work which signals it again. Returns false if the timeout expired. */
+PVK_LINKAGE bool pvkFencePoolWaitAny(VkDevice device, PvkFencePool* pool, uint64_t timeout, uint32_t* outIndex);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkFencePoolWaitAny(VkDevice device, PvkFencePool* pool, uint64_t timeout, uint32_t* outIndex)
+{
+	pool->waitCount++;
+	for(uint32_t pass = 0; pass < 2; pass++)
+	{
+		for(uint32_t i = 0; i < pool->reserveCount; i++)
+		{
+			uint32_t index = (pool->nextIndex + i) % pool->reserveCount;
+			VkResult result = vkGetFenceStatus(device, pool->fences[index]);
+			if(result == VK_SUCCESS)
+			{
+				pool->nextIndex = (index + 1) % pool->reserveCount;
+				*outIndex = index;
+				return true;
+			}
+			else if(result != VK_NOT_READY) PVK_CHECK(result);
+		}
+		if(pass == 1)
+			break;
+
+		/* none is signaled, sleep in the driver until one of them is instead of spinning */
+		pool->blockCount++;
+		uint64_t start = pvkGetTimeNs();
+		VkResult result = vkWaitForFences(device, pool->reserveCount, pool->fences, VK_FALSE, timeout);
+		uint64_t blockedTime = pvkGetTimeNs() - start;
+		pool->blockedTimeNs += blockedTime;
+		if(blockedTime > pool->maxBlockedTimeNs)
+			pool->maxBlockedTimeNs = blockedTime;
+		if(result == VK_TIMEOUT)
+		{
+			pool->timeoutCount++;
+			return false;
+		}
+		PVK_CHECK(result);
+	}
+	return false;
+}
+#endif
+
+/* blocking version of pvkFencePoolAcquire, the acquired fence is reset */
+PVK_LINKAGE bool pvkFencePoolAcquireWait(VkDevice device, PvkFencePool* pool, uint64_t timeout, VkFence* outFence);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkFencePoolAcquireWait(VkDevice device, PvkFencePool* pool, uint64_t timeout, VkFence* outFence)
+{
+	uint32_t index;
+	if(!pvkFencePoolWaitAny(device, pool, timeout, &index))
+		return false;
+	PVK_CHECK(vkResetFences(device, 1, &pool->fences[index]));
+	*outFence = pool->fences[index];
+	return true;
+}
+#endif
+
+PVK_LINKAGE void pvkFencePoolLogStats(PvkFencePool* pool);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkFencePoolLogStats(PvkFencePool* pool)
+{
+	PVK_INFO("Fence pool: waits = %llu, blocked = %llu (timed out = %llu), blocked time = %.3f ms (avg = %.3f ms, max = %.3f ms)",
+				(unsigned long long)pool->waitCount, (unsigned long long)pool->blockCount, (unsigned long long)pool->timeoutCount,
+				pool->blockedTimeNs / 1000000.0,
+				(pool->blockCount > 0) ? (pool->blockedTimeNs / 1000000.0 / pool->blockCount) : 0.0,
+				pool->maxBlockedTimeNs / 1000000.0);
+}
+#endif
+
 PVK_LINKAGE void pvkSubmit(VkCommandBuffer commandBuffer, VkQueue queue, VkSemaphore wait, VkSemaphore signal, VkFence signalFence);
 #ifdef PVK_IMPLEMENTATION
 PVK_LINKAGE void pvkSubmit(VkCommandBuffer commandBuffer, VkQueue queue, VkSemaphore wait, VkSemaphore signal, VkFence signalFence)
@@ -1265,6 +1567,12 @@ PVK_LINKAGE void pvkBeginRenderPass(VkCommandBuffer commandBuffer, VkRenderPass
 		beginInfo.pClearValues = clearValues;
 	};
 	vkCmdBeginRenderPass(commandBuffer, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	/* for the pipelines created with PVK_DYNAMIC_EXTENT, the pipelines with static viewport and scissor override it when bound */
+	VkViewport viewport = { 0, 0, (float)width, (float)height, 0, 1.0f };
+	VkRect2D scissor = { { 0, 0 }, { width, height } };
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 }
 #endif
 
@@ -1360,72 +1668,497 @@ PVK_LINKAGE void __pvkCheckForMemoryTypesSupport(VkPhysicalDevice device, uint32
 }
 #endif
 
-/* Vulkan Image & ImageView */
-PVK_LINKAGE VkImage __pvkCreateImage(VkDevice device, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, VkImageCreateFlags flags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices);
+/* Vulkan Device Memory Sub-allocation
+ * Buffers and images created through a PvkMemoryAllocator share large VkDeviceMemory blocks instead of
+ * owning one allocation each, which keeps the number of vkAllocateMemory calls far below maxMemoryAllocationCount.
+ * Each block keeps a list of free ranges sorted by offset (first fit, neighbouring ranges are coalesced on free).
+ * Linear (buffer) and optimal (image) resources never share a block, so bufferImageGranularity doesn't need to be honored.
+ * NOTE: The allocator isn't thread safe. */
+#define PVK_DEFAULT_MEMORY_BLOCK_SIZE (64 * 1024 * 1024) /* 64 MB */
+
+typedef struct PvkMemoryFreeRange
+{
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	struct PvkMemoryFreeRange* next;
+} PvkMemoryFreeRange;
+
+typedef struct PvkMemoryAllocator PvkMemoryAllocator;
+
+typedef struct PvkMemoryBlock
+{
+	PvkMemoryAllocator* allocator;
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	uint32_t memoryTypeIndex;
+	bool isLinear;
+	/* true if the block has been allocated for a single resource which is larger than the block size */
+	bool isDedicated;
+	/* persistently mapped pointer to the start of the block, NULL if the memory type isn't HOST_VISIBLE */
+	void* mappedData;
+	/* 0 if the memory type is HOST_COHERENT, otherwise VkPhysicalDeviceLimits::nonCoherentAtomSize */
+	VkDeviceSize nonCoherentAtomSize;
+	uint32_t allocationCount;
+	/* sorted by offset */
+	PvkMemoryFreeRange* freeRanges;
+	struct PvkMemoryBlock* next;
+} PvkMemoryBlock;
+
+typedef struct PvkMemoryAllocation
+{
+	/* NULL if the memory isn't sub-allocated (owned exclusively by the resource) */
+	PvkMemoryBlock* block;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+} PvkMemoryAllocation;
+
+struct PvkMemoryAllocator
+{
+	VkPhysicalDevice physicalDevice;
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkDeviceSize nonCoherentAtomSize;
+	VkDeviceSize blockSize;
+	/* blocks[memoryTypeIndex][0] for linear resources, blocks[memoryTypeIndex][1] for optimal resources */
+	PvkMemoryBlock* blocks[VK_MAX_MEMORY_TYPES][2];
+	uint32_t blockCount;
+	uint32_t dedicatedBlockCount;
+	uint32_t allocationCount;
+	VkDeviceSize allocatedBytes;
+	VkDeviceSize usedBytes;
+};
+
+typedef struct PvkMemoryAllocatorStats
+{
+	uint32_t allocationCount;
+	uint32_t blockCount;
+	uint32_t dedicatedBlockCount;
+	uint32_t freeRangeCount;
+	/* total size of all the VkDeviceMemory blocks */
+	VkDeviceSize allocatedBytes;
+	/* total size of all the live sub-allocations */
+	VkDeviceSize usedBytes;
+	VkDeviceSize largestFreeRange;
+	/* 0 if all the free space is contiguous, approaches 1 as the free space gets scattered into small ranges */
+	float fragmentation;
+} PvkMemoryAllocatorStats;
+
+PVK_STATIC PVK_INLINE VkDeviceSize __pvkAlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (alignment > 1) ? (((value + alignment - 1) / alignment) * alignment) : value;
+}
+
+PVK_LINKAGE uint32_t __pvkFindMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties* properties, uint32_t memoryTypeBits, VkMemoryPropertyFlags propertyFlags);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE VkImage __pvkCreateImage(VkDevice device, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, VkImageCreateFlags flags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices)
+PVK_LINKAGE uint32_t __pvkFindMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties* properties, uint32_t memoryTypeBits, VkMemoryPropertyFlags propertyFlags)
 {
-	// union operation
-	uint32_t uniqueQueueFamilyCount;
-	uint32_t uniqueQueueFamilyIndices[queueFamilyIndexCount];
-	__pvkUnionUInt32(queueFamilyIndexCount, queueFamilyIndices, &uniqueQueueFamilyCount, uniqueQueueFamilyIndices);
-	
-	VkImageCreateInfo cInfo = { };
+	for(uint32_t i = 0; i < properties->memoryTypeCount; i++)
 	{
-		cInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		cInfo.flags = flags;
-		cInfo.imageType = VK_IMAGE_TYPE_2D;
-		cInfo.format = format;
-		cInfo.extent = (VkExtent3D) { };
-		{ cInfo.extent.width = width; cInfo.extent.height = height; cInfo.extent.depth = 1; };
-		cInfo.mipLevels = 1;
-		cInfo.arrayLayers = 1;
-		cInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		cInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		cInfo.usage = usageFlags;
-		cInfo.sharingMode = (uniqueQueueFamilyCount > 1) ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
-		cInfo.queueFamilyIndexCount = uniqueQueueFamilyCount;
-		cInfo.pQueueFamilyIndices = uniqueQueueFamilyIndices;
-	};
-	VkImage image;
-	PVK_CHECK(vkCreateImage(device, &cInfo, NULL, &image));
-	return image;
+		if(!(memoryTypeBits & (1u << i)))
+			continue;
+		if((properties->memoryTypes[i].propertyFlags & propertyFlags) == propertyFlags)
+			return i;
+	}
+	PVK_WARNING("Unable to find memory type with requested memory property flags and memory type bits");
+	return UINT32_MAX;
 }
 #endif
 
-typedef struct PvkImage
+/* first fit in a list of free ranges sorted by offset, also used by PvkGeometryPool (with ranges in vertices and indices) */
+PVK_LINKAGE bool __pvkFreeRangesAllocate(PvkMemoryFreeRange** freeRanges, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* outOffset);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool __pvkFreeRangesAllocate(PvkMemoryFreeRange** freeRanges, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* outOffset)
 {
-	VkImage handle;
-	VkDeviceMemory memory;
-} PvkImage;
+	PvkMemoryFreeRange* prev = NULL;
+	PvkMemoryFreeRange* range = *freeRanges;
+	while(range != NULL)
+	{
+		VkDeviceSize offset = __pvkAlignUp(range->offset, alignment);
+		VkDeviceSize end = range->offset + range->size;
+		if((offset + size) <= end)
+		{
+			VkDeviceSize padding = offset - range->offset;
+			VkDeviceSize tail = end - (offset + size);
+			if((padding == 0) && (tail == 0))
+			{
+				/* exact fit, unlink the range */
+				if(prev == NULL)
+					*freeRanges = range->next;
+				else
+					prev->next = range->next;
+				PVK_DELETE(range);
+			}
+			else if(padding == 0)
+			{
+				range->offset = offset + size;
+				range->size = tail;
+			}
+			else
+			{
+				/* keep the padding in front as a free range, and split off the tail if any */
+				range->size = padding;
+				if(tail > 0)
+				{
+					PvkMemoryFreeRange* tailRange = PVK_NEW(PvkMemoryFreeRange);
+					tailRange->offset = offset + size;
+					tailRange->size = tail;
+					tailRange->next = range->next;
+					range->next = tailRange;
+				}
+			}
+			*outOffset = offset;
+			return true;
+		}
+		prev = range;
+		range = range->next;
+	}
+	return false;
+}
+#endif
 
-PVK_LINKAGE PvkImage pvkCreateImage(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices);
+/* returns [offset, offset + size) to the list, coalescing it with its neighbours */
+PVK_LINKAGE void __pvkFreeRangesFree(PvkMemoryFreeRange** freeRanges, VkDeviceSize offset, VkDeviceSize size);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE PvkImage pvkCreateImage(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices)
+PVK_LINKAGE void __pvkFreeRangesFree(PvkMemoryFreeRange** freeRanges, VkDeviceSize offset, VkDeviceSize size)
 {
-	VkImage image = __pvkCreateImage(device, format, width, height, usageFlags, 0, queueFamilyIndexCount, queueFamilyIndices);
-	VkMemoryRequirements imageMemoryRequirements;
-	vkGetImageMemoryRequirements(device, image, &imageMemoryRequirements);
-	__pvkCheckForMemoryTypesSupport(physicalDevice, imageMemoryRequirements.memoryTypeBits);
-	VkDeviceMemory memory = pvkAllocateMemory(device, imageMemoryRequirements.size, __pvkGetMemoryTypeIndexFromMemoryProperty(physicalDevice, mflags));
-	PVK_CHECK(vkBindImageMemory(device, image, memory, 0));
-	return (PvkImage) { image, memory };
+	PvkMemoryFreeRange* prev = NULL;
+	PvkMemoryFreeRange* next = *freeRanges;
+	while((next != NULL) && (next->offset < offset))
+	{
+		prev = next;
+		next = next->next;
+	}
+
+	bool mergesPrev = (prev != NULL) && ((prev->offset + prev->size) == offset);
+	bool mergesNext = (next != NULL) && ((offset + size) == next->offset);
+	if(mergesPrev && mergesNext)
+	{
+		prev->size += size + next->size;
+		prev->next = next->next;
+		PVK_DELETE(next);
+	}
+	else if(mergesPrev)
+		prev->size += size;
+	else if(mergesNext)
+	{
+		next->offset = offset;
+		next->size += size;
+	}
+	else
+	{
+		PvkMemoryFreeRange* range = PVK_NEW(PvkMemoryFreeRange);
+		range->offset = offset;
+		range->size = size;
+		range->next = next;
+		if(prev == NULL)
+			*freeRanges = range;
+		else
+			prev->next = range;
+	}
 }
 #endif
 
-PVK_LINKAGE PvkImage pvkCreateImage2(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices);
+PVK_LINKAGE void __pvkDestroyFreeRanges(PvkMemoryFreeRange* freeRanges);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE PvkImage pvkCreateImage2(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices)
+PVK_LINKAGE void __pvkDestroyFreeRanges(PvkMemoryFreeRange* freeRanges)
 {
-	VkImage image = __pvkCreateImage(device, format, width, height, usageFlags, VK_IMAGE_CREATE_DISJOINT_BIT, queueFamilyIndexCount, queueFamilyIndices);
-	
-	VkImagePlaneMemoryRequirementsInfo imagePlaneRequirementInfo = { };
-	imagePlaneRequirementInfo.sType = VK_STRUCTURE_TYPE_IMAGE_PLANE_MEMORY_REQUIREMENTS_INFO;
-	imagePlaneRequirementInfo.planeAspect = (VkImageAspectFlagBits)(VK_IMAGE_ASPECT_PLANE_0_BIT)
-	;
-	VkImageMemoryRequirementsInfo2 info = { };
-	info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
-	info.pNext = &imagePlaneRequirementInfo;
+	while(freeRanges != NULL)
+	{
+		PvkMemoryFreeRange* next = freeRanges->next;
+		PVK_DELETE(freeRanges);
+		freeRanges = next;
+	}
+}
+#endif
+
+PVK_LINKAGE PvkMemoryAllocator* pvkCreateMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkMemoryAllocator* pvkCreateMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize)
+{
+	PvkMemoryAllocator* allocator = PVK_NEW(PvkMemoryAllocator);
+	allocator->physicalDevice = physicalDevice;
+	allocator->device = device;
+	allocator->blockSize = (blockSize == 0) ? PVK_DEFAULT_MEMORY_BLOCK_SIZE : blockSize;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &allocator->memoryProperties);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	allocator->nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+	return allocator;
+}
+#endif
+
+PVK_LINKAGE void __pvkMemoryBlockDestroy(PvkMemoryBlock* block);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void __pvkMemoryBlockDestroy(PvkMemoryBlock* block)
+{
+	PvkMemoryAllocator* allocator = block->allocator;
+	if(block->mappedData != NULL)
+		vkUnmapMemory(allocator->device, block->memory);
+	vkFreeMemory(allocator->device, block->memory, NULL);
+	__pvkDestroyFreeRanges(block->freeRanges);
+	allocator->blockCount--;
+	if(block->isDedicated)
+		allocator->dedicatedBlockCount--;
+	allocator->allocatedBytes -= block->size;
+	PVK_DELETE(block);
+}
+#endif
+
+PVK_LINKAGE void pvkDestroyMemoryAllocator(PvkMemoryAllocator* allocator);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyMemoryAllocator(PvkMemoryAllocator* allocator)
+{
+	if(allocator->allocationCount > 0)
+		PVK_WARNING("Memory allocator is being destroyed while %u allocations are still alive", allocator->allocationCount);
+	for(uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+	{
+		for(uint32_t j = 0; j < 2; j++)
+		{
+			PvkMemoryBlock* block = allocator->blocks[i][j];
+			while(block != NULL)
+			{
+				PvkMemoryBlock* next = block->next;
+				__pvkMemoryBlockDestroy(block);
+				block = next;
+			}
+		}
+	}
+	PVK_DELETE(allocator);
+}
+#endif
+
+PVK_LINKAGE PvkMemoryBlock* __pvkMemoryBlockCreate(PvkMemoryAllocator* allocator, uint32_t memoryTypeIndex, VkDeviceSize size, bool isLinear, bool isDedicated);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkMemoryBlock* __pvkMemoryBlockCreate(PvkMemoryAllocator* allocator, uint32_t memoryTypeIndex, VkDeviceSize size, bool isLinear, bool isDedicated)
+{
+	VkMemoryPropertyFlags propertyFlags = allocator->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+	PvkMemoryBlock* block = PVK_NEW(PvkMemoryBlock);
+	if((propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+	{
+		/* flushed ranges are rounded to nonCoherentAtomSize, and they must not go past the end of the memory */
+		block->nonCoherentAtomSize = allocator->nonCoherentAtomSize;
+		size = __pvkAlignUp(size, block->nonCoherentAtomSize);
+	}
+	block->allocator = allocator;
+	block->memory = pvkAllocateMemory(allocator->device, size, memoryTypeIndex);
+	block->size = size;
+	block->memoryTypeIndex = memoryTypeIndex;
+	block->isLinear = isLinear;
+	block->isDedicated = isDedicated;
+	/* host visible blocks are mapped once for their whole lifetime */
+	if(propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		PVK_CHECK(vkMapMemory(allocator->device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mappedData));
+	block->freeRanges = PVK_NEW(PvkMemoryFreeRange);
+	block->freeRanges->offset = 0;
+	block->freeRanges->size = size;
+
+	/* push at the front of the list, newest blocks are the most likely to have free space */
+	block->next = allocator->blocks[memoryTypeIndex][isLinear ? 0 : 1];
+	allocator->blocks[memoryTypeIndex][isLinear ? 0 : 1] = block;
+	allocator->blockCount++;
+	if(isDedicated)
+		allocator->dedicatedBlockCount++;
+	allocator->allocatedBytes += size;
+	return block;
+}
+#endif
+
+PVK_LINKAGE bool __pvkMemoryBlockAllocate(PvkMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* outOffset);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool __pvkMemoryBlockAllocate(PvkMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* outOffset)
+{
+	if(!__pvkFreeRangesAllocate(&block->freeRanges, size, alignment, outOffset))
+		return false;
+	block->allocationCount++;
+	return true;
+}
+#endif
+
+PVK_LINKAGE void __pvkMemoryBlockFree(PvkMemoryBlock* block, VkDeviceSize offset, VkDeviceSize size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void __pvkMemoryBlockFree(PvkMemoryBlock* block, VkDeviceSize offset, VkDeviceSize size)
+{
+	__pvkFreeRangesFree(&block->freeRanges, offset, size);
+	block->allocationCount--;
+}
+#endif
+
+PVK_LINKAGE PvkMemoryAllocation pvkMemoryAllocatorAllocate(PvkMemoryAllocator* allocator, VkMemoryRequirements* requirements, VkMemoryPropertyFlags mflags, bool isLinear);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkMemoryAllocation pvkMemoryAllocatorAllocate(PvkMemoryAllocator* allocator, VkMemoryRequirements* requirements, VkMemoryPropertyFlags mflags, bool isLinear)
+{
+	uint32_t memoryTypeIndex = __pvkFindMemoryTypeIndex(&allocator->memoryProperties, requirements->memoryTypeBits, mflags);
+	PVK_ASSERT(memoryTypeIndex != UINT32_MAX);
+
+	PvkMemoryBlock* block = NULL;
+	VkDeviceSize offset = 0;
+	if(requirements->size > (allocator->blockSize / 2))
+	{
+		/* large resources get their own block, they would waste most of a shared block anyway */
+		block = __pvkMemoryBlockCreate(allocator, memoryTypeIndex, requirements->size, isLinear, true);
+		bool result = __pvkMemoryBlockAllocate(block, requirements->size, requirements->alignment, &offset);
+		PVK_ASSERT(result);
+	}
+	else
+	{
+		block = allocator->blocks[memoryTypeIndex][isLinear ? 0 : 1];
+		while(block != NULL)
+		{
+			if(!block->isDedicated && __pvkMemoryBlockAllocate(block, requirements->size, requirements->alignment, &offset))
+				break;
+			block = block->next;
+		}
+		if(block == NULL)
+		{
+			block = __pvkMemoryBlockCreate(allocator, memoryTypeIndex, allocator->blockSize, isLinear, false);
+			bool result = __pvkMemoryBlockAllocate(block, requirements->size, requirements->alignment, &offset);
+			PVK_ASSERT(result);
+		}
+	}
+
+	allocator->allocationCount++;
+	allocator->usedBytes += requirements->size;
+	return (PvkMemoryAllocation) { block, offset, requirements->size };
+}
+#endif
+
+PVK_LINKAGE void pvkMemoryAllocatorFree(PvkMemoryAllocator* allocator, PvkMemoryAllocation allocation);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkMemoryAllocatorFree(PvkMemoryAllocator* allocator, PvkMemoryAllocation allocation)
+{
+	PvkMemoryBlock* block = allocation.block;
+	PVK_ASSERT(block != NULL);
+	__pvkMemoryBlockFree(block, allocation.offset, allocation.size);
+	allocator->allocationCount--;
+	allocator->usedBytes -= allocation.size;
+
+	if(block->allocationCount > 0)
+		return;
+
+	/* release empty blocks, but keep the last shared block of a memory type around to avoid re-allocating it over and over */
+	PvkMemoryBlock** list = &allocator->blocks[block->memoryTypeIndex][block->isLinear ? 0 : 1];
+	if(!block->isDedicated)
+	{
+		uint32_t sharedBlockCount = 0;
+		for(PvkMemoryBlock* it = *list; it != NULL; it = it->next)
+			if(!it->isDedicated) sharedBlockCount++;
+		if(sharedBlockCount <= 1)
+			return;
+	}
+	while(*list != block)
+		list = &(*list)->next;
+	*list = block->next;
+	__pvkMemoryBlockDestroy(block);
+}
+#endif
+
+PVK_LINKAGE PvkMemoryAllocatorStats pvkMemoryAllocatorGetStats(PvkMemoryAllocator* allocator);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkMemoryAllocatorStats pvkMemoryAllocatorGetStats(PvkMemoryAllocator* allocator)
+{
+	PvkMemoryAllocatorStats stats = { };
+	stats.allocationCount = allocator->allocationCount;
+	stats.blockCount = allocator->blockCount;
+	stats.dedicatedBlockCount = allocator->dedicatedBlockCount;
+	stats.allocatedBytes = allocator->allocatedBytes;
+	stats.usedBytes = allocator->usedBytes;
+
+	VkDeviceSize totalFree = 0;
+	for(uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+		for(uint32_t j = 0; j < 2; j++)
+			for(PvkMemoryBlock* block = allocator->blocks[i][j]; block != NULL; block = block->next)
+				for(PvkMemoryFreeRange* range = block->freeRanges; range != NULL; range = range->next)
+				{
+					stats.freeRangeCount++;
+					totalFree += range->size;
+					if(range->size > stats.largestFreeRange)
+						stats.largestFreeRange = range->size;
+				}
+	stats.fragmentation = (totalFree > 0) ? (1.0f - (float)stats.largestFreeRange / (float)totalFree) : 0.0f;
+	return stats;
+}
+#endif
+
+PVK_LINKAGE void pvkMemoryAllocatorLogStats(PvkMemoryAllocator* allocator);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkMemoryAllocatorLogStats(PvkMemoryAllocator* allocator)
+{
+	PvkMemoryAllocatorStats stats = pvkMemoryAllocatorGetStats(allocator);
+	PVK_INFO("Memory allocator: allocations = %u, blocks = %u (dedicated = %u), used = %llu / %llu bytes, free ranges = %u, fragmentation = %.3f",
+				stats.allocationCount, stats.blockCount, stats.dedicatedBlockCount,
+				(unsigned long long)stats.usedBytes, (unsigned long long)stats.allocatedBytes,
+				stats.freeRangeCount, stats.fragmentation);
+}
+#endif
+
+/* Vulkan Image & ImageView */
+PVK_LINKAGE VkImage __pvkCreateImage(VkDevice device, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, VkImageCreateFlags flags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkImage __pvkCreateImage(VkDevice device, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, VkImageCreateFlags flags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices)
+{
+	// union operation
+	uint32_t uniqueQueueFamilyCount;
+	uint32_t uniqueQueueFamilyIndices[queueFamilyIndexCount];
+	__pvkUnionUInt32(queueFamilyIndexCount, queueFamilyIndices, &uniqueQueueFamilyCount, uniqueQueueFamilyIndices);
+	
+	VkImageCreateInfo cInfo = { };
+	{
+		cInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		cInfo.flags = flags;
+		cInfo.imageType = VK_IMAGE_TYPE_2D;
+		cInfo.format = format;
+		cInfo.extent = (VkExtent3D) { };
+		{ cInfo.extent.width = width; cInfo.extent.height = height; cInfo.extent.depth = 1; };
+		cInfo.mipLevels = 1;
+		cInfo.arrayLayers = 1;
+		cInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		cInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		cInfo.usage = usageFlags;
+		cInfo.sharingMode = (uniqueQueueFamilyCount > 1) ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+		cInfo.queueFamilyIndexCount = uniqueQueueFamilyCount;
+		cInfo.pQueueFamilyIndices = uniqueQueueFamilyIndices;
+	};
+	VkImage image;
+	PVK_CHECK(vkCreateImage(device, &cInfo, NULL, &image));
+	return image;
+}
+#endif
+
+typedef struct PvkImage
+{
+	VkImage handle;
+	VkDeviceMemory memory;
+	/* allocation.block is NULL if the image owns the memory */
+	PvkMemoryAllocation allocation;
+} PvkImage;
+
+PVK_LINKAGE PvkImage pvkCreateImage(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkImage pvkCreateImage(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices)
+{
+	VkImage image = __pvkCreateImage(device, format, width, height, usageFlags, 0, queueFamilyIndexCount, queueFamilyIndices);
+	VkMemoryRequirements imageMemoryRequirements;
+	vkGetImageMemoryRequirements(device, image, &imageMemoryRequirements);
+	__pvkCheckForMemoryTypesSupport(physicalDevice, imageMemoryRequirements.memoryTypeBits);
+	VkDeviceMemory memory = pvkAllocateMemory(device, imageMemoryRequirements.size, __pvkGetMemoryTypeIndexFromMemoryProperty(physicalDevice, mflags));
+	PVK_CHECK(vkBindImageMemory(device, image, memory, 0));
+	return (PvkImage) { image, memory, { } };
+}
+#endif
+
+PVK_LINKAGE PvkImage pvkCreateImage2(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkImage pvkCreateImage2(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices)
+{
+	VkImage image = __pvkCreateImage(device, format, width, height, usageFlags, VK_IMAGE_CREATE_DISJOINT_BIT, queueFamilyIndexCount, queueFamilyIndices);
+	
+	VkImagePlaneMemoryRequirementsInfo imagePlaneRequirementInfo = { };
+	imagePlaneRequirementInfo.sType = VK_STRUCTURE_TYPE_IMAGE_PLANE_MEMORY_REQUIREMENTS_INFO;
+	imagePlaneRequirementInfo.planeAspect = (VkImageAspectFlagBits)(VK_IMAGE_ASPECT_PLANE_0_BIT)
+	;
+	VkImageMemoryRequirementsInfo2 info = { };
+	info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	info.pNext = &imagePlaneRequirementInfo;
 	info.image = image;
 	VkMemoryRequirements2 imageMemoryRequirements = { };
 	imageMemoryRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
@@ -1465,7 +2198,22 @@ PVK_LINKAGE PvkImage pvkCreateImage2(VkPhysicalDevice physicalDevice, VkDevice d
 	bindInfos[1].memory = memory;
 	bindInfos[1].memoryOffset = plane1Offset;
 	PVK_CHECK(vkBindImageMemory2(device, 2, bindInfos));
-	return (PvkImage) { image, memory };
+	return (PvkImage) { image, memory, { } };
+}
+#endif
+
+PVK_LINKAGE PvkImage pvkCreateImageWithAllocator(PvkMemoryAllocator* allocator, VkMemoryPropertyFlags mflags, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkImage pvkCreateImageWithAllocator(PvkMemoryAllocator* allocator, VkMemoryPropertyFlags mflags, VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usageFlags, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices)
+{
+	VkDevice device = allocator->device;
+	VkImage image = __pvkCreateImage(device, format, width, height, usageFlags, 0, queueFamilyIndexCount, queueFamilyIndices);
+	VkMemoryRequirements imageMemoryRequirements;
+	vkGetImageMemoryRequirements(device, image, &imageMemoryRequirements);
+	/* __pvkCreateImage always creates images with VK_IMAGE_TILING_OPTIMAL */
+	PvkMemoryAllocation allocation = pvkMemoryAllocatorAllocate(allocator, &imageMemoryRequirements, mflags, false);
+	PVK_CHECK(vkBindImageMemory(device, image, allocation.block->memory, allocation.offset));
+	return (PvkImage) { image, allocation.block->memory, allocation };
 }
 #endif
 
@@ -1473,8 +2221,11 @@ PVK_LINKAGE void pvkDestroyImage(VkDevice device, PvkImage image);
 #ifdef PVK_IMPLEMENTATION
 PVK_LINKAGE void pvkDestroyImage(VkDevice device, PvkImage image)
 {
-	vkFreeMemory(device, image.memory, NULL);
 	vkDestroyImage(device, image.handle, NULL);
+	if(image.allocation.block != NULL)
+		pvkMemoryAllocatorFree(image.allocation.block->allocator, image.allocation);
+	else
+		vkFreeMemory(device, image.memory, NULL);
 }
 #endif
 
@@ -1573,6 +2324,135 @@ PVK_LINKAGE void pvkDestroySwapchainImageViews(VkDevice device, VkSwapchainKHR s
 }
 #endif
 
+/* Swapchain
+ * Keeps the creation parameters so that it can recreate itself on resize, the old swapchain is handed over as oldSwapchain
+ * and the surface is kept as it is (the surface is owned by the caller). */
+#define PVK_SWAPCHAIN_MAX_QUEUE_FAMILIES 4
+
+typedef struct PvkSwapchain
+{
+	VkPhysicalDevice physicalDevice;
+	VkDevice device;
+	VkSurfaceKHR surface;
+	VkSwapchainKHR handle;
+	uint32_t minImageCount;
+	VkFormat format;
+	VkColorSpaceKHR colorSpace;
+	VkPresentModeKHR presentMode;
+	uint32_t queueFamilyCount;
+	uint32_t queueFamilyIndices[PVK_SWAPCHAIN_MAX_QUEUE_FAMILIES];
+	uint32_t width;
+	uint32_t height;
+	uint32_t imageCount;
+	VkImageView* imageViews;
+	/* renderFinishSemaphores[i] is signaled by the frame rendering to image i and waited on by its present,
+	 * a semaphore per frame slot could still be waited on by the previous present of another image */
+	VkSemaphore* renderFinishSemaphores;
+	uint32_t recreateCount;
+} PvkSwapchain;
+
+/* the extent the swapchain images must have: the current extent of the surface if it dictates one, otherwise width x height
+ * clamped to the extents the surface supports, it is 0 x 0 while the window is minimized (no swapchain can be created then) */
+PVK_LINKAGE VkExtent2D pvkGetSwapchainExtent(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t width, uint32_t height);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkExtent2D pvkGetSwapchainExtent(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t width, uint32_t height)
+{
+	VkSurfaceCapabilitiesKHR capabilities;
+	PVK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities));
+	if(capabilities.currentExtent.width != UINT32_MAX)
+		return capabilities.currentExtent;
+	VkExtent2D minExtent = capabilities.minImageExtent;
+	VkExtent2D maxExtent = capabilities.maxImageExtent;
+	VkExtent2D extent;
+	extent.width = (width < minExtent.width) ? minExtent.width : ((width > maxExtent.width) ? maxExtent.width : width);
+	extent.height = (height < minExtent.height) ? minExtent.height : ((height > maxExtent.height) ? maxExtent.height : height);
+	return extent;
+}
+#endif
+
+/* width and height are clamped to what the surface supports (see pvkGetSwapchainExtent), the surface mustn't be minimized */
+PVK_LINKAGE PvkSwapchain* pvkCreateSwapchain2(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t minImageCount,
+											uint32_t width, uint32_t height, 
+											VkFormat format, VkColorSpaceKHR colorSpace, VkPresentModeKHR presentMode,
+											uint32_t queueFamilyCount, uint32_t* queueFamilyIndices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkSwapchain* pvkCreateSwapchain2(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t minImageCount,
+											uint32_t width, uint32_t height, 
+											VkFormat format, VkColorSpaceKHR colorSpace, VkPresentModeKHR presentMode,
+											uint32_t queueFamilyCount, uint32_t* queueFamilyIndices)
+{
+	PVK_ASSERT(queueFamilyCount <= PVK_SWAPCHAIN_MAX_QUEUE_FAMILIES);
+	VkExtent2D extent = pvkGetSwapchainExtent(physicalDevice, surface, width, height);
+	if((extent.width == 0) || (extent.height == 0))
+		PVK_FETAL_ERROR("Swapchain can't be created with a 0 x 0 extent, the surface is minimized");
+	PvkSwapchain* swapchain = PVK_NEW(PvkSwapchain);
+	swapchain->physicalDevice = physicalDevice;
+	swapchain->device = device;
+	swapchain->surface = surface;
+	swapchain->minImageCount = minImageCount;
+	swapchain->format = format;
+	swapchain->colorSpace = colorSpace;
+	swapchain->presentMode = presentMode;
+	swapchain->queueFamilyCount = queueFamilyCount;
+	memcpy(swapchain->queueFamilyIndices, queueFamilyIndices, sizeof(uint32_t) * queueFamilyCount);
+	swapchain->width = extent.width;
+	swapchain->height = extent.height;
+	swapchain->handle = pvkCreateSwapchain(device, surface, minImageCount, extent.width, extent.height, format, colorSpace, presentMode,
+											queueFamilyCount, swapchain->queueFamilyIndices, VK_NULL_HANDLE);
+	swapchain->imageViews = pvkCreateSwapchainImageViews(device, swapchain->handle, format, &swapchain->imageCount);
+	swapchain->renderFinishSemaphores = __pvkCreateSemaphores(device, swapchain->imageCount);
+	return swapchain;
+}
+#endif
+
+/* recreates the swapchain and its image views with the new extent (clamped, see pvkGetSwapchainExtent),
+ * the GPU must be done rendering to the old swapchain images (i.e. wait on the frames in flight) but the device needn't be idle,
+ * presentQueue: queue the old swapchain images have been presented on, waited on before the old swapchain is destroyed,
+ * returns false and keeps the old swapchain if the surface is minimized (0 x 0), it has to be recreated once it isn't */
+PVK_LINKAGE bool pvkSwapchainRecreate(PvkSwapchain* swapchain, VkQueue presentQueue, uint32_t width, uint32_t height);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkSwapchainRecreate(PvkSwapchain* swapchain, VkQueue presentQueue, uint32_t width, uint32_t height)
+{
+	VkExtent2D extent = pvkGetSwapchainExtent(swapchain->physicalDevice, swapchain->surface, width, height);
+	if((extent.width == 0) || (extent.height == 0))
+		return false;
+	VkSwapchainKHR oldSwapchain = swapchain->handle;
+	swapchain->handle = pvkCreateSwapchain(swapchain->device, swapchain->surface, swapchain->minImageCount, extent.width, extent.height, 
+											swapchain->format, swapchain->colorSpace, swapchain->presentMode,
+											swapchain->queueFamilyCount, swapchain->queueFamilyIndices, oldSwapchain);
+	/* the old swapchain is retired now, but the presents queued on it may still be pending (waiting on its render finish semaphores),
+	 * the frame fences don't cover them, so the present queue has to drain before the swapchain and the semaphores are destroyed */
+	PVK_CHECK(vkQueueWaitIdle(presentQueue));
+	for(uint32_t i = 0; i < swapchain->imageCount; i++)
+		vkDestroyImageView(swapchain->device, swapchain->imageViews[i], NULL);
+	PVK_DELETE(swapchain->imageViews);
+	__pvkDestroySemaphores(swapchain->device, swapchain->imageCount, swapchain->renderFinishSemaphores);
+	vkDestroySwapchainKHR(swapchain->device, oldSwapchain, NULL);
+
+	swapchain->width = extent.width;
+	swapchain->height = extent.height;
+	swapchain->imageViews = pvkCreateSwapchainImageViews(swapchain->device, swapchain->handle, swapchain->format, &swapchain->imageCount);
+	/* the image count of the new swapchain may differ */
+	swapchain->renderFinishSemaphores = __pvkCreateSemaphores(swapchain->device, swapchain->imageCount);
+	swapchain->recreateCount++;
+	return true;
+}
+#endif
+
+/* doesn't destroy the surface */
+PVK_LINKAGE void pvkDestroySwapchain(PvkSwapchain* swapchain);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroySwapchain(PvkSwapchain* swapchain)
+{
+	for(uint32_t i = 0; i < swapchain->imageCount; i++)
+		vkDestroyImageView(swapchain->device, swapchain->imageViews[i], NULL);
+	PVK_DELETE(swapchain->imageViews);
+	__pvkDestroySemaphores(swapchain->device, swapchain->imageCount, swapchain->renderFinishSemaphores);
+	vkDestroySwapchainKHR(swapchain->device, swapchain->handle, NULL);
+	PVK_DELETE(swapchain);
+}
+#endif
+
 /* Vulkan Frambuffer */
 PVK_LINKAGE VkFramebuffer* pvkCreateFramebuffers(VkDevice device, VkRenderPass renderPass, uint32_t width, uint32_t height, uint32_t fbCount, uint32_t attachmentCount, VkImageView* imageViews);
 #ifdef PVK_IMPLEMENTATION
@@ -1607,6 +2487,110 @@ PVK_LINKAGE void pvkDestroyFramebuffers(VkDevice device, uint32_t fbCount, VkFra
 }
 #endif
 
+/* Mapped files
+ * Read only view of a whole file, memory mapped where supported so that the data is never copied, 
+ * read into the heap otherwise. */
+typedef struct PvkMappedFile
+{
+	const void* data;
+	size_t size;
+	/* false if the data has been read into the heap */
+	bool isMapped;
+} PvkMappedFile;
+
+/* returns false if the file can't be opened or read, or if it is empty (outFile->data is then NULL) */
+PVK_LINKAGE bool pvkMapFile(const char* filePath, PvkMappedFile* outFile);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkMapFile(const char* filePath, PvkMappedFile* outFile)
+{
+	*outFile = (PvkMappedFile) { };
+#ifdef _WIN32
+	FILE* file = fopen(filePath, "rb");
+	if(file == NULL)
+		return false;
+	long length = -1;
+	if(fseek(file, 0, SEEK_END) == 0)
+		length = ftell(file);
+	if(length <= 0)
+	{
+		fclose(file);
+		return false;
+	}
+	rewind(file);
+	char* data = PVK_NEWV(char, length);
+	size_t readLength = fread(data, 1, (size_t)length, file);
+	fclose(file);
+	if(readLength != (size_t)length)
+	{
+		PVK_WARNING("Unable to read the file at path \"%s\"", filePath);
+		PVK_DELETE(data);
+		return false;
+	}
+	outFile->data = data;
+	outFile->size = (size_t)length;
+	return true;
+#else
+	int fd = open(filePath, O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat fileStat;
+	if(fstat(fd, &fileStat) != 0)
+	{
+		close(fd);
+		PVK_WARNING("Unable to stat the file at path \"%s\"", filePath);
+		return false;
+	}
+	/* mmap can't map 0 bytes */
+	if(fileStat.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	void* data = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	/* the mapping stays valid after closing the descriptor */
+	close(fd);
+	if(data == MAP_FAILED)
+	{
+		PVK_WARNING("Unable to map the file at path \"%s\"", filePath);
+		return false;
+	}
+	outFile->data = data;
+	outFile->size = (size_t)fileStat.st_size;
+	outFile->isMapped = true;
+	return true;
+#endif
+}
+#endif
+
+PVK_LINKAGE void pvkUnmapFile(PvkMappedFile* file);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkUnmapFile(PvkMappedFile* file)
+{
+#ifndef _WIN32
+	if(file->isMapped)
+		munmap((void*)file->data, file->size);
+	else
+#endif
+	if(file->data != NULL)
+		PVK_FREE((void*)file->data);
+	*file = (PvkMappedFile) { };
+}
+#endif
+
+/* FNV-1a */
+PVK_STATIC PVK_INLINE uint64_t __pvkHashBytes(uint64_t hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for(size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+#define PVK_HASH_SEED 0xcbf29ce484222325ULL
+#define __PVK_HASH_FIELD(hash, field) hash = __pvkHashBytes(hash, &(field), sizeof(field))
+
 /* Shaders & Graphics Pipeline */
 PVK_LINKAGE const char* __pvkLoadBinaryFile(const char* filePath, size_t* out_length);
 #ifdef PVK_IMPLEMENTATION
@@ -1631,22 +2615,47 @@ PVK_LINKAGE const char* __pvkLoadBinaryFile(const char* filePath, size_t* out_le
 }
 #endif
 
-PVK_LINKAGE VkShaderModule pvkCreateShaderModule(VkDevice device, const char* filePath);
+/* moves tempFilePath over filePath in one step, so that filePath is either the old or the new file even if the process dies meanwhile */
+PVK_LINKAGE bool __pvkReplaceFile(const char* tempFilePath, const char* filePath);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE VkShaderModule pvkCreateShaderModule(VkDevice device, const char* filePath)
+PVK_LINKAGE bool __pvkReplaceFile(const char* tempFilePath, const char* filePath)
+{
+#ifdef _WIN32
+	/* rename doesn't replace an existing file on windows */
+	return MoveFileExA(tempFilePath, filePath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(tempFilePath, filePath) == 0;
+#endif
+}
+#endif
+
+PVK_LINKAGE VkShaderModule pvkCreateShaderModuleFromCode(VkDevice device, const void* code, size_t size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkShaderModule pvkCreateShaderModuleFromCode(VkDevice device, const void* code, size_t size)
 {
-	size_t length;
-	const char* bytes = __pvkLoadBinaryFile(filePath, &length);
-	PVK_ASSERT((length % 4) == 0);
+	PVK_ASSERT((size % 4) == 0);
 	VkShaderModuleCreateInfo cInfo = { };
 	{
 		cInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		cInfo.codeSize = (uint32_t)length;
-		cInfo.pCode = (uint32_t*)bytes;
+		cInfo.codeSize = size;
+		cInfo.pCode = (const uint32_t*)code;
 	};
 	VkShaderModule shaderModule;
 	PVK_CHECK(vkCreateShaderModule(device, &cInfo, NULL, &shaderModule));
-	PVK_DELETE(bytes);
+	return shaderModule;
+}
+#endif
+
+/* the SPIR-V is memory mapped and passed to vkCreateShaderModule as it is */
+PVK_LINKAGE VkShaderModule pvkCreateShaderModule(VkDevice device, const char* filePath);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkShaderModule pvkCreateShaderModule(VkDevice device, const char* filePath)
+{
+	PvkMappedFile file;
+	if(!pvkMapFile(filePath, &file))
+		PVK_FETAL_ERROR("Unable to open the file at path \"%s\" or it is empty", filePath);
+	VkShaderModule shaderModule = pvkCreateShaderModuleFromCode(device, file.data, file.size);
+	pvkUnmapFile(&file);
 	return shaderModule;
 }
 #endif
@@ -1674,354 +2683,3766 @@ PVK_LINKAGE VkShaderStageFlagBits __pkvShaderTypeToVulkanShaderStage(PvkShaderTy
 }
 #endif
 
-PVK_LINKAGE VkPipelineShaderStageCreateInfo* __pvkCreatePipelineShaderStageCreateInfos(uint32_t count, const PvkShader* const shaders);
-#ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE VkPipelineShaderStageCreateInfo* __pvkCreatePipelineShaderStageCreateInfos(uint32_t count, const PvkShader* const shaders)
+/* SPIR-V reflection
+ * Extracts the descriptor bindings, the push constant range and the vertex inputs of a SPIR-V module,
+ * enough to create the descriptor set layouts and the pipeline layout of the shaders without writing them by hand. */
+#define PVK_REFLECTION_MAX_BINDINGS 32
+#define PVK_REFLECTION_MAX_VERTEX_INPUTS 16
+
+typedef struct PvkReflectedBinding
 {
-	VkPipelineShaderStageCreateInfo* infos = PVK_NEWV(VkPipelineShaderStageCreateInfo, count);
-	for(int i = 0; i < count; i++)
-	{
-		infos[i] = (VkPipelineShaderStageCreateInfo) { };
-		{
-			infos[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-			infos[i].module = shaders[i].handle;
-			infos[i].pName = "main";
-			infos[i].stage = __pkvShaderTypeToVulkanShaderStage(shaders[i].type);	
+	uint32_t set;
+	uint32_t binding;
+	VkDescriptorType type;
+	/* number of elements of a descriptor array, 1 otherwise */
+	uint32_t count;
+} PvkReflectedBinding;
+
+typedef struct PvkReflectedVertexInput
+{
+	uint32_t location;
+	VkFormat format;
+} PvkReflectedVertexInput;
+
+typedef struct PvkShaderReflection
+{
+	VkShaderStageFlagBits stage;
+	uint32_t bindingCount;
+	PvkReflectedBinding bindings[PVK_REFLECTION_MAX_BINDINGS];
+	/* pushConstantSize is 0 if the shader has no push constant block */
+	uint32_t pushConstantOffset;
+	uint32_t pushConstantSize;
+	/* only for vertex shaders, sorted by location */
+	uint32_t vertexInputCount;
+	PvkReflectedVertexInput vertexInputs[PVK_REFLECTION_MAX_VERTEX_INPUTS];
+} PvkShaderReflection;
+
+/* opcodes, decorations and storage classes of the SPIR-V specification used by the reflection */
+#define __PVK_SPIRV_MAGIC 0x07230203
+#define __PVK_SPIRV_OP_ENTRY_POINT 15
+#define __PVK_SPIRV_OP_TYPE_BOOL 20
+#define __PVK_SPIRV_OP_TYPE_INT 21
+#define __PVK_SPIRV_OP_TYPE_FLOAT 22
+#define __PVK_SPIRV_OP_TYPE_VECTOR 23
+#define __PVK_SPIRV_OP_TYPE_MATRIX 24
+#define __PVK_SPIRV_OP_TYPE_IMAGE 25
+#define __PVK_SPIRV_OP_TYPE_SAMPLER 26
+#define __PVK_SPIRV_OP_TYPE_SAMPLED_IMAGE 27
+#define __PVK_SPIRV_OP_TYPE_ARRAY 28
+#define __PVK_SPIRV_OP_TYPE_RUNTIME_ARRAY 29
+#define __PVK_SPIRV_OP_TYPE_STRUCT 30
+#define __PVK_SPIRV_OP_TYPE_POINTER 32
+#define __PVK_SPIRV_OP_CONSTANT 43
+#define __PVK_SPIRV_OP_VARIABLE 59
+#define __PVK_SPIRV_OP_DECORATE 71
+#define __PVK_SPIRV_OP_MEMBER_DECORATE 72
+#define __PVK_SPIRV_DECORATION_BLOCK 2
+#define __PVK_SPIRV_DECORATION_BUFFER_BLOCK 3
+#define __PVK_SPIRV_DECORATION_ARRAY_STRIDE 6
+#define __PVK_SPIRV_DECORATION_MATRIX_STRIDE 7
+#define __PVK_SPIRV_DECORATION_BUILT_IN 11
+#define __PVK_SPIRV_DECORATION_LOCATION 30
+#define __PVK_SPIRV_DECORATION_BINDING 33
+#define __PVK_SPIRV_DECORATION_DESCRIPTOR_SET 34
+#define __PVK_SPIRV_DECORATION_OFFSET 35
+#define __PVK_SPIRV_STORAGE_CLASS_UNIFORM_CONSTANT 0
+#define __PVK_SPIRV_STORAGE_CLASS_INPUT 1
+#define __PVK_SPIRV_STORAGE_CLASS_UNIFORM 2
+#define __PVK_SPIRV_STORAGE_CLASS_PUSH_CONSTANT 9
+#define __PVK_SPIRV_STORAGE_CLASS_STORAGE_BUFFER 12
+#define __PVK_SPIRV_DIM_BUFFER 5
+#define __PVK_SPIRV_DIM_SUBPASS_DATA 6
+
+typedef struct __PvkSpirvId
+{
+	/* the instruction defining the id (types, constants and variables only) */
+	const uint32_t* instruction;
+	uint32_t set;
+	uint32_t binding;
+	uint32_t location;
+	uint32_t arrayStride;
+	bool hasSet;
+	bool hasBinding;
+	bool hasLocation;
+	bool isBuiltIn;
+	bool isBlock;
+	bool isBufferBlock;
+} __PvkSpirvId;
+
+typedef struct __PvkSpirvReflector
+{
+	const uint32_t* code;
+	uint32_t wordCount;
+	__PvkSpirvId* ids;
+	uint32_t idBound;
+	/* range of the annotation instructions, the member decorations are looked up in it */
+	uint32_t annotationBegin;
+	uint32_t annotationEnd;
+} __PvkSpirvReflector;
+
+/* minimum word count of the type instructions, including the opcode word, for all the operands the reflection reads */
+PVK_STATIC PVK_INLINE uint32_t __pvkSpirvGetTypeWordCount(uint32_t opcode)
+{
+	switch(opcode)
+	{
+		/* result, width */
+		case __PVK_SPIRV_OP_TYPE_FLOAT: return 3;
+		/* result, width, signedness */
+		case __PVK_SPIRV_OP_TYPE_INT: return 4;
+		/* result, component/column type, count */
+		case __PVK_SPIRV_OP_TYPE_VECTOR:
+		case __PVK_SPIRV_OP_TYPE_MATRIX: return 4;
+		/* result, sampled type, dim, depth, arrayed, ms, sampled, format */
+		case __PVK_SPIRV_OP_TYPE_IMAGE: return 9;
+		/* result, image type */
+		case __PVK_SPIRV_OP_TYPE_SAMPLED_IMAGE: return 3;
+		/* result, element type, length */
+		case __PVK_SPIRV_OP_TYPE_ARRAY: return 4;
+		/* result, element type */
+		case __PVK_SPIRV_OP_TYPE_RUNTIME_ARRAY: return 3;
+		/* result, storage class, type */
+		case __PVK_SPIRV_OP_TYPE_POINTER: return 4;
+		default: return 2;
+	}
+}
+
+/* the instructions are only registered with all the operands the reflection reads, so they can be indexed without checking their length */
+PVK_STATIC PVK_INLINE const uint32_t* __pvkSpirvGetInstruction(__PvkSpirvReflector* reflector, uint32_t id)
+{
+	return (id < reflector->idBound) ? reflector->ids[id].instruction : NULL;
+}
+
+PVK_STATIC PVK_INLINE uint32_t __pvkSpirvGetMemberDecoration(__PvkSpirvReflector* reflector, uint32_t structId, uint32_t member, uint32_t decoration, uint32_t defaultValue)
+{
+	for(uint32_t i = reflector->annotationBegin; i < reflector->annotationEnd; i += reflector->code[i] >> 16)
+	{
+		const uint32_t* instruction = &reflector->code[i];
+		if(((instruction[0] & 0xffff) == __PVK_SPIRV_OP_MEMBER_DECORATE) && ((instruction[0] >> 16) > 4)
+			&& (instruction[1] == structId) && (instruction[2] == member) && (instruction[3] == decoration))
+			return instruction[4];
+	}
+	return defaultValue;
+}
+
+/* size in bytes of a type in a block, matrixStride is the MatrixStride decoration of the member (0 if none) */
+PVK_LINKAGE uint32_t __pvkSpirvGetTypeSize(__PvkSpirvReflector* reflector, uint32_t typeId, uint32_t matrixStride);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE uint32_t __pvkSpirvGetTypeSize(__PvkSpirvReflector* reflector, uint32_t typeId, uint32_t matrixStride)
+{
+	const uint32_t* type = __pvkSpirvGetInstruction(reflector, typeId);
+	if(type == NULL)
+		return 0;
+	switch(type[0] & 0xffff)
+	{
+		case __PVK_SPIRV_OP_TYPE_BOOL:
+			return 4;
+		case __PVK_SPIRV_OP_TYPE_INT:
+		case __PVK_SPIRV_OP_TYPE_FLOAT:
+			return type[2] / 8;
+		case __PVK_SPIRV_OP_TYPE_VECTOR:
+			return __pvkSpirvGetTypeSize(reflector, type[2], 0) * type[3];
+		case __PVK_SPIRV_OP_TYPE_MATRIX:
+			return ((matrixStride != 0) ? matrixStride : __pvkSpirvGetTypeSize(reflector, type[2], 0)) * type[3];
+		case __PVK_SPIRV_OP_TYPE_ARRAY:
+		{
+			const uint32_t* length = __pvkSpirvGetInstruction(reflector, type[3]);
+			if((length == NULL) || ((length[0] & 0xffff) != __PVK_SPIRV_OP_CONSTANT))
+				return 0;
+			uint32_t stride = reflector->ids[typeId].arrayStride;
+			return length[3] * ((stride != 0) ? stride : __pvkSpirvGetTypeSize(reflector, type[2], matrixStride));
+		}
+		case __PVK_SPIRV_OP_TYPE_STRUCT:
+		{
+			uint32_t size = 0;
+			uint32_t memberCount = (type[0] >> 16) - 2;
+			for(uint32_t i = 0; i < memberCount; i++)
+			{
+				uint32_t offset = __pvkSpirvGetMemberDecoration(reflector, typeId, i, __PVK_SPIRV_DECORATION_OFFSET, 0);
+				uint32_t stride = __pvkSpirvGetMemberDecoration(reflector, typeId, i, __PVK_SPIRV_DECORATION_MATRIX_STRIDE, 0);
+				uint32_t end = offset + __pvkSpirvGetTypeSize(reflector, type[2 + i], stride);
+				if(end > size)
+					size = end;
+			}
+			return size;
+		}
+		default:
+			return 0;
+	}
+}
+#endif
+
+PVK_STATIC PVK_INLINE VkShaderStageFlagBits __pvkSpirvExecutionModelToShaderStage(uint32_t executionModel)
+{
+	switch(executionModel)
+	{
+		case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+		case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+		default: return (VkShaderStageFlagBits)0;
+	}
+}
+
+/* the descriptor type of a variable in the UniformConstant, Uniform or StorageBuffer storage class, 
+ * returns false if the type isn't supported */
+PVK_LINKAGE bool __pvkSpirvGetDescriptorType(__PvkSpirvReflector* reflector, uint32_t storageClass, uint32_t typeId, VkDescriptorType* outType);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool __pvkSpirvGetDescriptorType(__PvkSpirvReflector* reflector, uint32_t storageClass, uint32_t typeId, VkDescriptorType* outType)
+{
+	const uint32_t* type = __pvkSpirvGetInstruction(reflector, typeId);
+	if(type == NULL)
+		return false;
+	if(storageClass == __PVK_SPIRV_STORAGE_CLASS_STORAGE_BUFFER)
+	{
+		*outType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		return true;
+	}
+	if(storageClass == __PVK_SPIRV_STORAGE_CLASS_UNIFORM)
+	{
+		*outType = reflector->ids[typeId].isBufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		return true;
+	}
+	switch(type[0] & 0xffff)
+	{
+		case __PVK_SPIRV_OP_TYPE_SAMPLER:
+			*outType = VK_DESCRIPTOR_TYPE_SAMPLER;
+			return true;
+		case __PVK_SPIRV_OP_TYPE_SAMPLED_IMAGE:
+			*outType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			return true;
+		case __PVK_SPIRV_OP_TYPE_IMAGE:
+		{
+			/* result, sampled type, dim, depth, arrayed, ms, sampled */
+			uint32_t dim = type[3];
+			bool isStorage = type[7] == 2;
+			if(dim == __PVK_SPIRV_DIM_SUBPASS_DATA)
+				*outType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			else if(dim == __PVK_SPIRV_DIM_BUFFER)
+				*outType = isStorage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			else
+				*outType = isStorage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+			return true;
+		}
+		default:
+			return false;
+	}
+}
+#endif
+
+PVK_STATIC PVK_INLINE VkFormat __pvkSpirvGetVertexInputFormat(__PvkSpirvReflector* reflector, uint32_t typeId)
+{
+	const uint32_t* type = __pvkSpirvGetInstruction(reflector, typeId);
+	if(type == NULL)
+		return VK_FORMAT_UNDEFINED;
+	uint32_t componentCount = 1;
+	if((type[0] & 0xffff) == __PVK_SPIRV_OP_TYPE_VECTOR)
+	{
+		componentCount = type[3];
+		type = __pvkSpirvGetInstruction(reflector, type[2]);
+		if(type == NULL)
+			return VK_FORMAT_UNDEFINED;
+	}
+	if((componentCount < 1) || (componentCount > 4) || (type[2] != 32))
+		return VK_FORMAT_UNDEFINED;
+	const VkFormat floatFormats[4] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+	const VkFormat sintFormats[4] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+	const VkFormat uintFormats[4] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+	switch(type[0] & 0xffff)
+	{
+		case __PVK_SPIRV_OP_TYPE_FLOAT: return floatFormats[componentCount - 1];
+		/* result, width, signedness */
+		case __PVK_SPIRV_OP_TYPE_INT: return (type[3] != 0) ? sintFormats[componentCount - 1] : uintFormats[componentCount - 1];
+		default: return VK_FORMAT_UNDEFINED;
+	}
+}
+
+/* returns false if the code isn't valid SPIR-V */
+PVK_LINKAGE bool pvkReflectShader(const void* code, size_t size, PvkShaderReflection* outReflection);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkReflectShader(const void* code, size_t size, PvkShaderReflection* outReflection)
+{
+	memset(outReflection, 0, sizeof(PvkShaderReflection));
+	const uint32_t* words = (const uint32_t*)code;
+	uint32_t wordCount = (uint32_t)(size / 4);
+	if((wordCount < 5) || (words[0] != __PVK_SPIRV_MAGIC))
+	{
+		PVK_WARNING("Not a SPIR-V module (or in a foreign endianness)");
+		return false;
+	}
+
+	__PvkSpirvReflector reflector = { };
+	{
+		reflector.code = words;
+		reflector.wordCount = wordCount;
+		reflector.idBound = words[3];
+		reflector.ids = PVK_NEWV(__PvkSpirvId, reflector.idBound);
+		reflector.annotationBegin = wordCount;
+	};
+
+	/* first pass: the entry point, the decorations, the types, the constants and the variables */
+	bool isValid = true;
+	for(uint32_t i = 5; i < wordCount; )
+	{
+		const uint32_t* instruction = &words[i];
+		uint32_t opcode = instruction[0] & 0xffff;
+		uint32_t length = instruction[0] >> 16;
+		if((length == 0) || ((i + length) > wordCount))
+		{
+			isValid = false;
+			break;
+		}
+		uint32_t resultId = UINT32_MAX;
+		switch(opcode)
+		{
+			case __PVK_SPIRV_OP_ENTRY_POINT:
+				if((outReflection->stage == 0) && (length > 1))
+					outReflection->stage = __pvkSpirvExecutionModelToShaderStage(instruction[1]);
+				break;
+			case __PVK_SPIRV_OP_DECORATE:
+			case __PVK_SPIRV_OP_MEMBER_DECORATE:
+			{
+				if(i < reflector.annotationBegin)
+					reflector.annotationBegin = i;
+				reflector.annotationEnd = i + length;
+				if((length < 3) || (instruction[1] >= reflector.idBound))
+					break;
+				__PvkSpirvId* target = &reflector.ids[instruction[1]];
+				if(opcode == __PVK_SPIRV_OP_MEMBER_DECORATE)
+				{
+					/* i.e. gl_PerVertex */
+					if((length > 3) && (instruction[3] == __PVK_SPIRV_DECORATION_BUILT_IN))
+						target->isBuiltIn = true;
+					break;
+				}
+				uint32_t value = (length > 3) ? instruction[3] : 0;
+				switch(instruction[2])
+				{
+					case __PVK_SPIRV_DECORATION_DESCRIPTOR_SET: target->set = value; target->hasSet = true; break;
+					case __PVK_SPIRV_DECORATION_BINDING: target->binding = value; target->hasBinding = true; break;
+					case __PVK_SPIRV_DECORATION_LOCATION: target->location = value; target->hasLocation = true; break;
+					case __PVK_SPIRV_DECORATION_ARRAY_STRIDE: target->arrayStride = value; break;
+					case __PVK_SPIRV_DECORATION_BUILT_IN: target->isBuiltIn = true; break;
+					case __PVK_SPIRV_DECORATION_BLOCK: target->isBlock = true; break;
+					case __PVK_SPIRV_DECORATION_BUFFER_BLOCK: target->isBufferBlock = true; break;
+				}
+				break;
+			}
+			case __PVK_SPIRV_OP_CONSTANT:
+			case __PVK_SPIRV_OP_VARIABLE:
+				/* result type, result id */
+				resultId = (length > 3) ? instruction[2] : UINT32_MAX;
+				break;
+			default:
+				/* OpType* have the result id first */
+				if((opcode < __PVK_SPIRV_OP_TYPE_BOOL) || (opcode > __PVK_SPIRV_OP_TYPE_POINTER))
+					break;
+				if(length < __pvkSpirvGetTypeWordCount(opcode))
+				{
+					isValid = false;
+					break;
+				}
+				resultId = instruction[1];
+				break;
+		}
+		if(!isValid)
+			break;
+		if(resultId < reflector.idBound)
+			reflector.ids[resultId].instruction = instruction;
+		i += length;
+	}
+	if(!isValid)
+		PVK_WARNING("SPIR-V module is truncated or malformed");
+
+	/* second pass: the interface of the variables */
+	for(uint32_t id = 0; isValid && (id < reflector.idBound); id++)
+	{
+		const uint32_t* variable = reflector.ids[id].instruction;
+		if((variable == NULL) || ((variable[0] & 0xffff) != __PVK_SPIRV_OP_VARIABLE))
+			continue;
+		uint32_t storageClass = variable[3];
+		const uint32_t* pointer = __pvkSpirvGetInstruction(&reflector, variable[1]);
+		if((pointer == NULL) || ((pointer[0] & 0xffff) != __PVK_SPIRV_OP_TYPE_POINTER))
+			continue;
+		uint32_t typeId = pointer[3];
+		const __PvkSpirvId* info = &reflector.ids[id];
+		switch(storageClass)
+		{
+			case __PVK_SPIRV_STORAGE_CLASS_UNIFORM_CONSTANT:
+			case __PVK_SPIRV_STORAGE_CLASS_UNIFORM:
+			case __PVK_SPIRV_STORAGE_CLASS_STORAGE_BUFFER:
+			{
+				if(!info->hasSet || !info->hasBinding)
+					break;
+				uint32_t count = 1;
+				const uint32_t* type = __pvkSpirvGetInstruction(&reflector, typeId);
+				if((type != NULL) && ((type[0] & 0xffff) == __PVK_SPIRV_OP_TYPE_ARRAY))
+				{
+					const uint32_t* length = __pvkSpirvGetInstruction(&reflector, type[3]);
+					count = ((length != NULL) && ((length[0] & 0xffff) == __PVK_SPIRV_OP_CONSTANT)) ? length[3] : 1;
+					typeId = type[2];
+				}
+				else if((type != NULL) && ((type[0] & 0xffff) == __PVK_SPIRV_OP_TYPE_RUNTIME_ARRAY))
+				{
+					PVK_WARNING("Runtime descriptor array at set = %u, binding = %u is reflected as a single descriptor", info->set, info->binding);
+					typeId = type[2];
+				}
+				VkDescriptorType descriptorType;
+				if(!__pvkSpirvGetDescriptorType(&reflector, storageClass, typeId, &descriptorType))
+				{
+					PVK_WARNING("Unsupported descriptor type at set = %u, binding = %u", info->set, info->binding);
+					break;
+				}
+				if(outReflection->bindingCount == PVK_REFLECTION_MAX_BINDINGS)
+				{
+					PVK_WARNING("Shader has more than %u bindings, the rest are ignored", PVK_REFLECTION_MAX_BINDINGS);
+					break;
+				}
+				outReflection->bindings[outReflection->bindingCount++] = (PvkReflectedBinding) { info->set, info->binding, descriptorType, count };
+				break;
+			}
+			case __PVK_SPIRV_STORAGE_CLASS_PUSH_CONSTANT:
+			{
+				const uint32_t* type = __pvkSpirvGetInstruction(&reflector, typeId);
+				if((type == NULL) || ((type[0] & 0xffff) != __PVK_SPIRV_OP_TYPE_STRUCT))
+					break;
+				uint32_t offset = UINT32_MAX;
+				uint32_t memberCount = (type[0] >> 16) - 2;
+				for(uint32_t i = 0; i < memberCount; i++)
+				{
+					uint32_t memberOffset = __pvkSpirvGetMemberDecoration(&reflector, typeId, i, __PVK_SPIRV_DECORATION_OFFSET, 0);
+					if(memberOffset < offset)
+						offset = memberOffset;
+				}
+				if(offset == UINT32_MAX)
+					break;
+				/* the ranges must be multiple of 4 */
+				offset &= ~3u;
+				outReflection->pushConstantOffset = offset;
+				outReflection->pushConstantSize = ((__pvkSpirvGetTypeSize(&reflector, typeId, 0) + 3) & ~3u) - offset;
+				break;
+			}
+			case __PVK_SPIRV_STORAGE_CLASS_INPUT:
+			{
+				if((outReflection->stage != VK_SHADER_STAGE_VERTEX_BIT) || info->isBuiltIn || !info->hasLocation)
+					break;
+				if((typeId < reflector.idBound) && reflector.ids[typeId].isBuiltIn)
+					break;
+				/* a matrix input takes one location per column (e.g. the model matrix of PvkInstance) */
+				uint32_t locationCount = 1;
+				const uint32_t* type = __pvkSpirvGetInstruction(&reflector, typeId);
+				if((type != NULL) && ((type[0] & 0xffff) == __PVK_SPIRV_OP_TYPE_MATRIX))
+				{
+					/* result, column type, column count */
+					locationCount = type[3];
+					typeId = type[2];
+				}
+				VkFormat format = __pvkSpirvGetVertexInputFormat(&reflector, typeId);
+				if(format == VK_FORMAT_UNDEFINED)
+				{
+					PVK_WARNING("Unsupported vertex input type at location = %u", info->location);
+					break;
+				}
+				for(uint32_t i = 0; (i < locationCount) && (outReflection->vertexInputCount < PVK_REFLECTION_MAX_VERTEX_INPUTS); i++)
+				{
+					/* insertion sorted by location */
+					uint32_t location = info->location + i;
+					uint32_t j = outReflection->vertexInputCount++;
+					for(; (j > 0) && (outReflection->vertexInputs[j - 1].location > location); j--)
+						outReflection->vertexInputs[j] = outReflection->vertexInputs[j - 1];
+					outReflection->vertexInputs[j] = (PvkReflectedVertexInput) { location, format };
+				}
+				break;
+			}
+		}
+	}
+	PVK_DELETE(reflector.ids);
+	return isValid;
+}
+#endif
+
+/* Shader module cache
+ * Creates each shader module only once, keyed by its file path and by the contents of its SPIR-V (looked up by hash),
+ * so that different paths with the same contents share the module as well. The SPIR-V is memory mapped and passed
+ * to vkCreateShaderModule without copying, either from its own .spv file or from a mounted shader archive. */
+
+/* Shader archive: a header, the entry table and the SPIR-V of each entry (4 bytes aligned) in a single file,
+ * so that loading all the shaders takes one file open */
+#define PVK_SHADER_ARCHIVE_MAGIC 0x4b415350 /* "PSAK" */
+#define PVK_SHADER_ARCHIVE_VERSION 2
+#define PVK_SHADER_ARCHIVE_MAX_PATH_LENGTH 64
+
+typedef struct PvkShaderArchiveHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+} PvkShaderArchiveHeader;
+
+typedef struct PvkShaderArchiveEntry
+{
+	/* path of the .spv file the entry has been packed from, null terminated */
+	char filePath[PVK_SHADER_ARCHIVE_MAX_PATH_LENGTH];
+	uint64_t hash;
+	/* modification time of the .spv file when it has been packed, the entry is stale if the file has changed since */
+	int64_t modifiedTime;
+	/* from the beginning of the archive */
+	uint32_t offset;
+	uint32_t size;
+} PvkShaderArchiveEntry;
+
+/* returns false if the file doesn't exist */
+PVK_STATIC PVK_INLINE bool __pvkGetFileStat(const char* filePath, uint64_t* outSize, int64_t* outModifiedTime)
+{
+	struct stat fileStat;
+	if(stat(filePath, &fileStat) != 0)
+		return false;
+	*outSize = (uint64_t)fileStat.st_size;
+	*outModifiedTime = (int64_t)fileStat.st_mtime;
+	return true;
+}
+
+/* packs the files into an archive at archivePath, the file is written to archivePath.tmp first and then renamed */
+PVK_LINKAGE bool pvkWriteShaderArchive(const char* archivePath, uint32_t count, const char* const* filePaths);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkWriteShaderArchive(const char* archivePath, uint32_t count, const char* const* filePaths)
+{
+	PvkShaderArchiveHeader header = { PVK_SHADER_ARCHIVE_MAGIC, PVK_SHADER_ARCHIVE_VERSION, count, 0 };
+	PvkShaderArchiveEntry* entries = PVK_NEWV(PvkShaderArchiveEntry, count);
+	PvkMappedFile* files = PVK_NEWV(PvkMappedFile, count);
+	bool isWritten = true;
+	uint32_t offset = sizeof(PvkShaderArchiveHeader) + sizeof(PvkShaderArchiveEntry) * count;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		if(strlen(filePaths[i]) >= PVK_SHADER_ARCHIVE_MAX_PATH_LENGTH)
+		{
+			PVK_WARNING("Shader path \"%s\" is too long to be archived", filePaths[i]);
+			isWritten = false;
+			continue;
+		}
+		uint64_t fileSize;
+		if(!__pvkGetFileStat(filePaths[i], &fileSize, &entries[i].modifiedTime) || !pvkMapFile(filePaths[i], &files[i]))
+		{
+			PVK_WARNING("Unable to open the file at path \"%s\"", filePaths[i]);
+			isWritten = false;
+			continue;
+		}
+		strcpy(entries[i].filePath, filePaths[i]);
+		entries[i].hash = __pvkHashBytes(PVK_HASH_SEED, files[i].data, files[i].size);
+		entries[i].offset = offset;
+		entries[i].size = (uint32_t)files[i].size;
+		offset += (entries[i].size + 3) & ~3u;
+	}
+
+	char tempFilePath[strlen(archivePath) + 5];
+	sprintf(tempFilePath, "%s.tmp", archivePath);
+	FILE* file = isWritten ? fopen(tempFilePath, "wb") : NULL;
+	if(file != NULL)
+	{
+		const uint8_t padding[3] = { };
+		isWritten = (fwrite(&header, sizeof(header), 1, file) == 1) && (fwrite(entries, sizeof(PvkShaderArchiveEntry), count, file) == count);
+		for(uint32_t i = 0; (i < count) && isWritten; i++)
+		{
+			size_t paddingSize = ((entries[i].size + 3) & ~3u) - entries[i].size;
+			isWritten = (fwrite(files[i].data, 1, files[i].size, file) == files[i].size) && (fwrite(padding, 1, paddingSize, file) == paddingSize);
+		}
+		isWritten = (fclose(file) == 0) && isWritten;
+	}
+	else
+		isWritten = false;
+	for(uint32_t i = 0; i < count; i++)
+		pvkUnmapFile(&files[i]);
+	PVK_DELETE(files);
+	PVK_DELETE(entries);
+	if(!isWritten || !__pvkReplaceFile(tempFilePath, archivePath))
+	{
+		PVK_WARNING("Unable to write the shader archive to the file at path \"%s\"", archivePath);
+		remove(tempFilePath);
+		return false;
+	}
+	return true;
+}
+#endif
+
+typedef struct PvkShaderCacheEntry
+{
+	char* filePath;
+	uint64_t hash;
+	uint32_t size;
+	/* the SPIR-V in the mounted archive, NULL if it has been loaded from its own file (mapped again when it has to be compared), 
+	 * the contents are compared byte for byte before the module is shared since equal hashes don't mean equal contents */
+	const void* archiveCode;
+	VkShaderModule module;
+	PvkShaderReflection* reflection;
+	/* shares the module (and the reflection) of an earlier entry with the same contents */
+	bool isAlias;
+} PvkShaderCacheEntry;
+
+typedef struct PvkShaderCache
+{
+	VkDevice device;
+	PvkMappedFile archive;
+	const PvkShaderArchiveEntry* archiveEntries;
+	uint32_t archiveEntryCount;
+	PvkShaderCacheEntry* entries;
+	uint32_t entryCount;
+	uint32_t entryCapacity;
+	/* stats */
+	uint32_t hitCount;
+	uint32_t fileOpenCount;
+	uint32_t moduleCount;
+	/* archive entries ignored because their .spv file has changed, the archive should be packed again */
+	uint32_t staleArchiveEntryCount;
+} PvkShaderCache;
+
+PVK_LINKAGE PvkShaderCache* pvkCreateShaderCache(VkDevice device);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkShaderCache* pvkCreateShaderCache(VkDevice device)
+{
+	PvkShaderCache* cache = PVK_NEW(PvkShaderCache);
+	cache->device = device;
+	return cache;
+}
+#endif
+
+/* destroys all the shader modules of the cache */
+PVK_LINKAGE void pvkDestroyShaderCache(PvkShaderCache* cache);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyShaderCache(PvkShaderCache* cache)
+{
+	for(uint32_t i = 0; i < cache->entryCount; i++)
+	{
+		if(!cache->entries[i].isAlias)
+		{
+			vkDestroyShaderModule(cache->device, cache->entries[i].module, NULL);
+			PVK_DELETE(cache->entries[i].reflection);
+		}
+		PVK_DELETE(cache->entries[i].filePath);
+	}
+	if(cache->entries != NULL)
+		PVK_FREE(cache->entries);
+	pvkUnmapFile(&cache->archive);
+	PVK_DELETE(cache);
+}
+#endif
+
+/* maps the archive for the lifetime of the cache, the shaders found in it aren't loaded from their own files anymore.
+ * returns false if the archive doesn't exist or isn't valid, the shaders are then loaded from their own files. */
+PVK_LINKAGE bool pvkShaderCacheMountArchive(PvkShaderCache* cache, const char* archivePath);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkShaderCacheMountArchive(PvkShaderCache* cache, const char* archivePath)
+{
+	PVK_ASSERT(cache->archive.data == NULL);
+	PvkMappedFile archive;
+	if(!pvkMapFile(archivePath, &archive))
+		return false;
+	cache->fileOpenCount++;
+	const PvkShaderArchiveHeader* header = (const PvkShaderArchiveHeader*)archive.data;
+	bool isValid = (archive.size >= sizeof(PvkShaderArchiveHeader))
+					&& (header->magic == PVK_SHADER_ARCHIVE_MAGIC)
+					&& (header->version == PVK_SHADER_ARCHIVE_VERSION)
+					&& (archive.size >= (sizeof(PvkShaderArchiveHeader) + sizeof(PvkShaderArchiveEntry) * (uint64_t)header->entryCount));
+	const PvkShaderArchiveEntry* entries = (const PvkShaderArchiveEntry*)(header + 1);
+	for(uint32_t i = 0; isValid && (i < header->entryCount); i++)
+		isValid = ((entries[i].offset % 4) == 0) && (((uint64_t)entries[i].offset + entries[i].size) <= archive.size)
+					&& (memchr(entries[i].filePath, 0, PVK_SHADER_ARCHIVE_MAX_PATH_LENGTH) != NULL);
+	if(!isValid)
+	{
+		PVK_WARNING("Shader archive at path \"%s\" is not valid, ignoring it", archivePath);
+		pvkUnmapFile(&archive);
+		return false;
+	}
+	cache->archive = archive;
+	cache->archiveEntries = entries;
+	cache->archiveEntryCount = header->entryCount;
+	return true;
+}
+#endif
+
+PVK_STATIC PVK_INLINE PvkShaderCacheEntry* __pvkShaderCacheAddEntry(PvkShaderCache* cache, const char* filePath, uint64_t hash, uint32_t size, const void* archiveCode, VkShaderModule module, PvkShaderReflection* reflection, bool isAlias)
+{
+	if(cache->entryCount == cache->entryCapacity)
+	{
+		cache->entryCapacity = (cache->entryCapacity == 0) ? 16 : (cache->entryCapacity * 2);
+		cache->entries = (PvkShaderCacheEntry*)realloc(cache->entries, sizeof(PvkShaderCacheEntry) * cache->entryCapacity);
+		PVK_ASSERT(cache->entries != NULL);
+	}
+	PvkShaderCacheEntry* entry = &cache->entries[cache->entryCount++];
+	entry->filePath = PVK_NEWV(char, strlen(filePath) + 1);
+	strcpy(entry->filePath, filePath);
+	entry->hash = hash;
+	entry->size = size;
+	entry->archiveCode = archiveCode;
+	entry->module = module;
+	entry->reflection = reflection;
+	entry->isAlias = isAlias;
+	return entry;
+}
+
+/* returns true if the SPIR-V of entry is code, only called on a hash match so its file is rarely mapped again */
+PVK_LINKAGE bool __pvkShaderCacheEntryEquals(PvkShaderCache* cache, const PvkShaderCacheEntry* entry, uint64_t hash, const void* code, uint32_t size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool __pvkShaderCacheEntryEquals(PvkShaderCache* cache, const PvkShaderCacheEntry* entry, uint64_t hash, const void* code, uint32_t size)
+{
+	if((entry->hash != hash) || (entry->size != size))
+		return false;
+	if(entry->archiveCode != NULL)
+		return memcmp(entry->archiveCode, code, size) == 0;
+	/* the file may have changed since the entry has been loaded, the module isn't shared then */
+	PvkMappedFile file;
+	if(!pvkMapFile(entry->filePath, &file))
+		return false;
+	cache->fileOpenCount++;
+	bool isEqual = (file.size == size) && (memcmp(file.data, code, size) == 0);
+	pvkUnmapFile(&file);
+	return isEqual;
+}
+#endif
+
+PVK_LINKAGE PvkShaderCacheEntry* __pvkShaderCacheGetEntry(PvkShaderCache* cache, const char* filePath);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkShaderCacheEntry* __pvkShaderCacheGetEntry(PvkShaderCache* cache, const char* filePath)
+{
+	for(uint32_t i = 0; i < cache->entryCount; i++)
+	{
+		if(strcmp(cache->entries[i].filePath, filePath) == 0)
+		{
+			cache->hitCount++;
+			return &cache->entries[i];
+		}
+	}
+
+	/* the archive is searched first, its hashes are precomputed */
+	const void* code = NULL;
+	const void* archiveCode = NULL;
+	uint32_t size = 0;
+	uint64_t hash = 0;
+	PvkMappedFile file = { };
+	for(uint32_t i = 0; i < cache->archiveEntryCount; i++)
+	{
+		const PvkShaderArchiveEntry* entry = &cache->archiveEntries[i];
+		if(strcmp(entry->filePath, filePath) == 0)
+		{
+			/* a stat is much cheaper than opening the file, the archive is trusted if the .spv file isn't shipped along */
+			uint64_t fileSize;
+			int64_t modifiedTime;
+			if(__pvkGetFileStat(filePath, &fileSize, &modifiedTime) && ((fileSize != entry->size) || (modifiedTime != entry->modifiedTime)))
+			{
+				PVK_WARNING("Shader \"%s\" has changed since it has been archived, loading it from its own file", filePath);
+				cache->staleArchiveEntryCount++;
+				break;
+			}
+			code = (const uint8_t*)cache->archive.data + entry->offset;
+			archiveCode = code;
+			size = entry->size;
+			hash = entry->hash;
+			break;
+		}
+	}
+	if(code == NULL)
+	{
+		if(!pvkMapFile(filePath, &file))
+			PVK_FETAL_ERROR("Unable to open the file at path \"%s\" or it is empty", filePath);
+		cache->fileOpenCount++;
+		code = file.data;
+		size = (uint32_t)file.size;
+		hash = __pvkHashBytes(PVK_HASH_SEED, code, size);
+	}
+
+	VkShaderModule module = VK_NULL_HANDLE;
+	PvkShaderReflection* reflection = NULL;
+	for(uint32_t i = 0; i < cache->entryCount; i++)
+	{
+		if(__pvkShaderCacheEntryEquals(cache, &cache->entries[i], hash, code, size))
+		{
+			module = cache->entries[i].module;
+			reflection = cache->entries[i].reflection;
+			break;
+		}
+	}
+	bool isAlias = module != VK_NULL_HANDLE;
+	if(!isAlias)
+	{
+		module = pvkCreateShaderModuleFromCode(cache->device, code, size);
+		reflection = PVK_NEW(PvkShaderReflection);
+		if(!pvkReflectShader(code, size, reflection))
+			PVK_WARNING("Unable to reflect the shader at path \"%s\"", filePath);
+		cache->moduleCount++;
+	}
+	else
+		cache->hitCount++;
+	pvkUnmapFile(&file);
+	return __pvkShaderCacheAddEntry(cache, filePath, hash, size, archiveCode, module, reflection, isAlias);
+}
+#endif
+
+/* returns the shader module for the .spv file at filePath, the module is owned by the cache */
+PVK_LINKAGE VkShaderModule pvkShaderCacheGet(PvkShaderCache* cache, const char* filePath);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkShaderModule pvkShaderCacheGet(PvkShaderCache* cache, const char* filePath)
+{
+	return __pvkShaderCacheGetEntry(cache, filePath)->module;
+}
+#endif
+
+/* returns the reflection of the .spv file at filePath (loading it if it isn't yet), owned by the cache */
+PVK_LINKAGE const PvkShaderReflection* pvkShaderCacheGetReflection(PvkShaderCache* cache, const char* filePath);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE const PvkShaderReflection* pvkShaderCacheGetReflection(PvkShaderCache* cache, const char* filePath)
+{
+	return __pvkShaderCacheGetEntry(cache, filePath)->reflection;
+}
+#endif
+
+typedef struct PvkVertex
+{
+	// attribute at location = 0 : position of the vertex
+	PvkVec3 position;
+
+	// attribute at location = 1 : normal of the vertex
+	PvkVec3 normal;
+
+	// attribute at location = 2 : texture coordinates of the vertex
+	PvkVec2 texcoord;
+
+	// attribute at location = 3 : color of the vertex
+	PvkVec4 color;
+
+} PvkVertex;
+
+#define PVK_VERTEX_SIZE sizeof(PvkVertex)
+#define PVK_VERTEX_ATTRIBUTE_COUNT 4
+#define PVK_VERTEX_POSITION_OFFSET offsetof(PvkVertex, position)
+#define PVK_VERTEX_NORMAL_OFFSET offsetof(PvkVertex, normal)
+#define PVK_VERTEX_TEXCOORD_OFFSET offsetof(PvkVertex, texcoord)
+#define PVK_VERTEX_COLOR_OFFSET offsetof(PvkVertex, color)
+
+/* quantized PvkVertex, half of its size, the shaders read it through the same locations */
+typedef struct PvkCompactVertex
+{
+	// attribute at location = 0 : position of the vertex
+	PvkVec3 position;
+
+	// attribute at location = 1 : octahedral encoded normal of the vertex (VK_FORMAT_R16G16_SNORM, vec2), see pvkOctEncode
+	int16_t normal[2];
+
+	// attribute at location = 2 : texture coordinates of the vertex (VK_FORMAT_R16G16_SFLOAT, vec2)
+	uint16_t texcoord[2];
+
+	// attribute at location = 3 : color of the vertex (VK_FORMAT_R8G8B8A8_UNORM, vec4)
+	uint8_t color[4];
+
+} PvkCompactVertex;
+
+#define PVK_COMPACT_VERTEX_SIZE sizeof(PvkCompactVertex)
+#define PVK_COMPACT_VERTEX_POSITION_OFFSET offsetof(PvkCompactVertex, position)
+#define PVK_COMPACT_VERTEX_NORMAL_OFFSET offsetof(PvkCompactVertex, normal)
+#define PVK_COMPACT_VERTEX_TEXCOORD_OFFSET offsetof(PvkCompactVertex, texcoord)
+#define PVK_COMPACT_VERTEX_COLOR_OFFSET offsetof(PvkCompactVertex, color)
+
+/* layout of the vertex buffers of a geometry, 0 for interleaved PvkVertex */
+typedef enum PvkVertexFormatFlagBits
+{
+	/* interleaved PvkCompactVertex instead of PvkVertex */
+	PVK_VERTEX_FORMAT_COMPACT_BIT = 1 << 0,
+	/* an additional stream of the positions alone for the depth only passes, see pvkBindGeometryPositions */
+	PVK_VERTEX_FORMAT_POSITION_STREAM_BIT = 1 << 1
+} PvkVertexFormatFlagBits;
+typedef uint32_t PvkVertexFormatFlags;
+
+#define PVK_POSITION_VERTEX_SIZE sizeof(PvkVec3)
+
+PVK_STATIC PVK_INLINE uint32_t pvkGetVertexSize(PvkVertexFormatFlags format)
+{
+	return (format & PVK_VERTEX_FORMAT_COMPACT_BIT) ? PVK_COMPACT_VERTEX_SIZE : PVK_VERTEX_SIZE;
+}
+
+/* IEEE 754 half precision, rounded to the nearest (even), too large values become infinities */
+PVK_LINKAGE uint16_t pvkFloatToHalf(float value);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE uint16_t pvkFloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	int32_t exponent = (int32_t)((bits >> 23) & 0xFF);
+	/* infinities and NaNs */
+	if(exponent == 0xFF)
+		return (uint16_t)(sign | 0x7C00 | ((mantissa != 0) ? 0x200 : 0));
+	exponent = exponent - 127 + 15;
+	if(exponent >= 31)
+		return (uint16_t)(sign | 0x7C00);
+	uint32_t shift = 13;
+	if(exponent <= 0)
+	{
+		/* subnormal half, the implicit leading bit becomes explicit */
+		if(exponent < -10)
+			return (uint16_t)sign;
+		mantissa |= 0x800000;
+		shift = (uint32_t)(14 - exponent);
+		exponent = 0;
+	}
+	uint32_t half = ((uint32_t)exponent << 10) + (mantissa >> shift);
+	uint32_t remainder = mantissa & ((1u << shift) - 1);
+	uint32_t halfway = 1u << (shift - 1);
+	/* a carry out of the mantissa correctly bumps the exponent (up to infinity) */
+	if((remainder > halfway) || ((remainder == halfway) && (half & 1)))
+		half++;
+	return (uint16_t)(sign | half);
+}
+#endif
+
+/* octahedral encoding of a unit vector into two snorm16 components, it is decoded in the vertex shader with:
+ *   vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+ *   if(n.z < 0) n.xy = (1.0 - abs(n.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));
+ *   n = normalize(n); */
+PVK_LINKAGE void pvkOctEncode(PvkVec3 normal, int16_t outEncoded[2]);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkOctEncode(PvkVec3 normal, int16_t outEncoded[2])
+{
+	float length = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	float x = (length > 0) ? (normal.x / length) : 0;
+	float y = (length > 0) ? (normal.y / length) : 0;
+	if(normal.z < 0)
+	{
+		/* fold the lower hemisphere over the diagonals */
+		float foldedX = (1.0f - fabsf(y)) * ((x >= 0) ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * ((y >= 0) ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	outEncoded[0] = (int16_t)roundf(fminf(fmaxf(x, -1.0f), 1.0f) * 32767.0f);
+	outEncoded[1] = (int16_t)roundf(fminf(fmaxf(y, -1.0f), 1.0f) * 32767.0f);
+}
+#endif
+
+PVK_LINKAGE void pvkEncodeCompactVertices(uint32_t count, const PvkVertex* vertices, PvkCompactVertex* outVertices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkEncodeCompactVertices(uint32_t count, const PvkVertex* vertices, PvkCompactVertex* outVertices)
+{
+	for(uint32_t i = 0; i < count; i++)
+	{
+		const PvkVertex* vertex = &vertices[i];
+		PvkCompactVertex* compactVertex = &outVertices[i];
+		compactVertex->position = vertex->position;
+		pvkOctEncode(vertex->normal, compactVertex->normal);
+		compactVertex->texcoord[0] = pvkFloatToHalf(vertex->texcoord.x);
+		compactVertex->texcoord[1] = pvkFloatToHalf(vertex->texcoord.y);
+		for(uint32_t j = 0; j < 4; j++)
+			compactVertex->color[j] = (uint8_t)roundf(fminf(fmaxf(vertex->color.v[j], 0), 1.0f) * 255.0f);
+	}
+}
+#endif
+
+/* per instance data of instanced draws (see pvkDrawGeometryInstanced), read from the second vertex binding */
+typedef struct PvkInstance
+{
+	// attributes at location = 4, 5, 6, 7 : model matrix of the instance (mat4), transposed like the uniform data
+	PvkMat4 modelMatrix;
+
+	// attribute at location = 8 : color of the instance, multiplied with the vertex color
+	PvkVec4 color;
+
+} PvkInstance;
+
+#define PVK_INSTANCE_BINDING 1
+#define PVK_INSTANCE_SIZE sizeof(PvkInstance)
+#define PVK_INSTANCE_FIRST_LOCATION PVK_VERTEX_ATTRIBUTE_COUNT
+#define PVK_INSTANCE_ATTRIBUTE_COUNT 5
+#define PVK_INSTANCE_MODEL_MATRIX_OFFSET offsetof(PvkInstance, modelMatrix)
+#define PVK_INSTANCE_COLOR_OFFSET offsetof(PvkInstance, color)
+
+PVK_STATIC PVK_INLINE PVK_CONSTEXPR VkVertexInputAttributeDescription __pvkGetVertexInputAttributeDescription(uint32_t binding, uint32_t location, VkFormat format, uint32_t offset)
+{
+	VkVertexInputAttributeDescription dsc = { };
+	{
+		dsc.location = location;
+		dsc.binding = binding;
+		dsc.format = format;
+		dsc.offset = offset;
+	};
+	return dsc;
+}
+
+/* Pipeline Cache
+ * Persisted to a file so that the pipelines compiled on the previous launches are not compiled again,
+ * the file is discarded if it was written by a different GPU or driver. */
+typedef struct PvkPipelineCache
+{
+	VkDevice device;
+	VkPipelineCache handle;
+	char* filePath;
+	/* true if the cache has been initialized with the data of the file */
+	bool isWarm;
+} PvkPipelineCache;
+
+/* checks the data against the VkPipelineCacheHeaderVersionOne the driver would write for this physical device */
+PVK_LINKAGE bool __pvkIsPipelineCacheDataCompatible(VkPhysicalDevice physicalDevice, const char* data, size_t size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool __pvkIsPipelineCacheDataCompatible(VkPhysicalDevice physicalDevice, const char* data, size_t size)
+{
+	if(size < (4 * sizeof(uint32_t) + VK_UUID_SIZE))
+		return false;
+	/* the data needn't be aligned */
+	uint32_t header[4];			// headerSize, headerVersion, vendorID, deviceID
+	memcpy(header, data, sizeof(header));
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	return (header[0] >= (sizeof(header) + VK_UUID_SIZE)) && (header[0] <= size)
+			&& (header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+			&& (header[2] == properties.vendorID)
+			&& (header[3] == properties.deviceID)
+			&& (memcmp(data + sizeof(header), properties.pipelineCacheUUID, VK_UUID_SIZE) == 0);
+}
+#endif
+
+/* filePath may not exist yet, it is written by pvkPipelineCacheSave and pvkDestroyPipelineCache */
+PVK_LINKAGE PvkPipelineCache* pvkCreatePipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, const char* filePath);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkPipelineCache* pvkCreatePipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, const char* filePath)
+{
+	PvkPipelineCache* cache = PVK_NEW(PvkPipelineCache);
+	cache->device = device;
+	cache->filePath = PVK_NEWV(char, strlen(filePath) + 1);
+	strcpy(cache->filePath, filePath);
+
+	size_t size = 0;
+	char* data = NULL;
+	FILE* file = fopen(filePath, "rb");
+	if(file != NULL)
+	{
+		/* the cache is optional, so a file which can't be read is treated as a missing one */
+		long length = (fseek(file, 0, SEEK_END) == 0) ? ftell(file) : -1;
+		if((length > 0) && (fseek(file, 0, SEEK_SET) == 0))
+		{
+			data = PVK_NEWV(char, length);
+			size = fread(data, 1, length, file);
+		}
+		fclose(file);
+		if((length < 0) || (size != (size_t)length))
+		{
+			PVK_WARNING("Unable to read the pipeline cache at path \"%s\", starting with an empty cache", filePath);
+			size = 0;
+		}
+		else if(!__pvkIsPipelineCacheDataCompatible(physicalDevice, data, size))
+		{
+			PVK_WARNING("Pipeline cache at path \"%s\" is invalid or was written by another device/driver, discarding it", filePath);
+			size = 0;
+		}
+	}
+
+	VkPipelineCacheCreateInfo cInfo = { };
+	{
+		cInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cInfo.initialDataSize = size;
+		cInfo.pInitialData = (size > 0) ? data : NULL;
+	};
+	PVK_CHECK(vkCreatePipelineCache(device, &cInfo, NULL, &cache->handle));
+	cache->isWarm = size > 0;
+	if(data != NULL)
+		PVK_DELETE(data);
+	return cache;
+}
+#endif
+
+/* writes the cache into a temporary file and then renames it over filePath, so that a crash while writing can't leave a truncated cache behind */
+PVK_LINKAGE bool pvkPipelineCacheSave(PvkPipelineCache* cache);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkPipelineCacheSave(PvkPipelineCache* cache)
+{
+	size_t size;
+	PVK_CHECK(vkGetPipelineCacheData(cache->device, cache->handle, &size, NULL));
+	char* data = PVK_NEWV(char, size);
+	PVK_CHECK(vkGetPipelineCacheData(cache->device, cache->handle, &size, data));
+
+	char tempFilePath[strlen(cache->filePath) + 5];
+	sprintf(tempFilePath, "%s.tmp", cache->filePath);
+	FILE* file = fopen(tempFilePath, "wb");
+	if(file == NULL)
+	{
+		PVK_WARNING("Unable to open the file at path \"%s\" for writing", tempFilePath);
+		PVK_DELETE(data);
+		return false;
+	}
+	bool isWritten = fwrite(data, 1, size, file) == size;
+	isWritten = (fclose(file) == 0) && isWritten;
+	PVK_DELETE(data);
+	if(!isWritten || !__pvkReplaceFile(tempFilePath, cache->filePath))
+	{
+		PVK_WARNING("Unable to write the pipeline cache to the file at path \"%s\"", cache->filePath);
+		remove(tempFilePath);
+		return false;
+	}
+	return true;
+}
+#endif
+
+/* saves the cache before destroying it */
+PVK_LINKAGE void pvkDestroyPipelineCache(PvkPipelineCache* cache);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyPipelineCache(PvkPipelineCache* cache)
+{
+	pvkPipelineCacheSave(cache);
+	vkDestroyPipelineCache(cache->device, cache->handle, NULL);
+	PVK_DELETE(cache->filePath);
+	PVK_DELETE(cache);
+}
+#endif
+
+/* pass it as the width and height of the pipeline create functions to make the viewport and scissor dynamic state,
+ * they are then set by pvkBeginRenderPass and the pipeline doesn't depend on the framebuffer size */
+#define PVK_DYNAMIC_EXTENT 0
+
+/* Graphics pipeline description
+ * Plain data describing everything a graphics pipeline is created from, so that it can be hashed, compared and 
+ * handed over to the worker threads. The create functions below fill one and forward it to pvkCreateGraphicsPipelineFromDesc. */
+#define PVK_PIPELINE_MAX_SHADERS 5
+#define PVK_PIPELINE_MAX_VERTEX_BINDINGS 4
+#define PVK_PIPELINE_MAX_VERTEX_ATTRIBUTES 16
+#define PVK_PIPELINE_MAX_COLOR_ATTACHMENTS 8
+
+typedef struct PvkGraphicsPipelineDesc
+{
+	VkPipelineLayout layout;
+	VkRenderPass renderPass;
+	uint32_t subpassIndex;
+	/* PVK_DYNAMIC_EXTENT for dynamic viewport and scissor */
+	uint32_t width;
+	uint32_t height;
+	uint32_t shaderCount;
+	PvkShader shaders[PVK_PIPELINE_MAX_SHADERS];
+	/* Vertex layout */
+	uint32_t vertexBindingCount;
+	VkVertexInputBindingDescription vertexBindings[PVK_PIPELINE_MAX_VERTEX_BINDINGS];
+	uint32_t vertexAttributeCount;
+	VkVertexInputAttributeDescription vertexAttributes[PVK_PIPELINE_MAX_VERTEX_ATTRIBUTES];
+	VkPrimitiveTopology topology;
+	/* Rasterization */
+	VkPolygonMode polygonMode;
+	VkCullModeFlags cullMode;
+	VkFrontFace frontFace;
+	/* Depth */
+	VkBool32 depthTestEnable;
+	VkBool32 depthWriteEnable;
+	VkCompareOp depthCompareOp;
+	/* Blending, no color blend state is created if colorAttachmentCount is 0 (depth only subpasses) */
+	uint32_t colorAttachmentCount;
+	VkPipelineColorBlendAttachmentState colorAttachments[PVK_PIPELINE_MAX_COLOR_ATTACHMENTS];
+} PvkGraphicsPipelineDesc;
+
+/* triangle lists, back face culling and depth test/write, no vertex input, no color attachments */
+PVK_LINKAGE PvkGraphicsPipelineDesc __pvkGetGraphicsPipelineDescBase(VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t shaderCount, const PvkShader* shaders);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkGraphicsPipelineDesc __pvkGetGraphicsPipelineDescBase(VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t shaderCount, const PvkShader* shaders)
+{
+	PVK_ASSERT(shaderCount <= PVK_PIPELINE_MAX_SHADERS);
+	PvkGraphicsPipelineDesc desc = { };
+	{
+		desc.layout = layout;
+		desc.renderPass = renderPass;
+		desc.subpassIndex = subpassIndex;
+		desc.width = width;
+		desc.height = height;
+		desc.shaderCount = shaderCount;
+		desc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		desc.polygonMode = VK_POLYGON_MODE_FILL;
+		desc.cullMode = VK_CULL_MODE_BACK_BIT;
+		desc.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		desc.depthTestEnable = VK_TRUE;
+		desc.depthWriteEnable = VK_TRUE;
+		desc.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	};
+	for(uint32_t i = 0; i < shaderCount; i++)
+		desc.shaders[i] = shaders[i];
+	return desc;
+}
+#endif
+
+/* single binding of interleaved PvkVertex (or PvkCompactVertex), replaces the vertex layout so it must be called before pvkGraphicsPipelineDescAddInstanceLayout.
+ * positionOnly declares the position attribute alone, for the depth only passes: it is then read from the position stream
+ * if the format has one (the geometries must be bound with pvkBindGeometryPositions), otherwise with the stride of the whole vertex.
+ * the vertex shader has to match the format: PVK_VERTEX_FORMAT_COMPACT_BIT gives a vec2 octahedral normal at location 1 (see shaders/shader.compact.vert) */
+PVK_LINKAGE void pvkGraphicsPipelineDescSetVertexFormat(PvkGraphicsPipelineDesc* desc, PvkVertexFormatFlags format, bool positionOnly);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkGraphicsPipelineDescSetVertexFormat(PvkGraphicsPipelineDesc* desc, PvkVertexFormatFlags format, bool positionOnly)
+{
+	desc->vertexBindingCount = 1;
+	if(positionOnly)
+	{
+		uint32_t stride = (format & PVK_VERTEX_FORMAT_POSITION_STREAM_BIT) ? PVK_POSITION_VERTEX_SIZE : pvkGetVertexSize(format);
+		desc->vertexBindings[0] = (VkVertexInputBindingDescription) { 0, stride, VK_VERTEX_INPUT_RATE_VERTEX };
+		desc->vertexAttributeCount = 1;
+		/* the position is the first member of both PvkVertex and PvkCompactVertex */
+		desc->vertexAttributes[0] = __pvkGetVertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0);
+		return;
+	}
+
+	desc->vertexAttributeCount = PVK_VERTEX_ATTRIBUTE_COUNT;
+	if(format & PVK_VERTEX_FORMAT_COMPACT_BIT)
+	{
+		desc->vertexBindings[0] = (VkVertexInputBindingDescription) { 0, PVK_COMPACT_VERTEX_SIZE, VK_VERTEX_INPUT_RATE_VERTEX };
+		desc->vertexAttributes[0] = __pvkGetVertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, PVK_COMPACT_VERTEX_POSITION_OFFSET);
+		desc->vertexAttributes[1] = __pvkGetVertexInputAttributeDescription(0, 1, VK_FORMAT_R16G16_SNORM, PVK_COMPACT_VERTEX_NORMAL_OFFSET);
+		desc->vertexAttributes[2] = __pvkGetVertexInputAttributeDescription(0, 2, VK_FORMAT_R16G16_SFLOAT, PVK_COMPACT_VERTEX_TEXCOORD_OFFSET);
+		desc->vertexAttributes[3] = __pvkGetVertexInputAttributeDescription(0, 3, VK_FORMAT_R8G8B8A8_UNORM, PVK_COMPACT_VERTEX_COLOR_OFFSET);
+		return;
+	}
+	desc->vertexBindings[0] = (VkVertexInputBindingDescription) { 0, PVK_VERTEX_SIZE, VK_VERTEX_INPUT_RATE_VERTEX };
+	desc->vertexAttributes[0] = __pvkGetVertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, PVK_VERTEX_POSITION_OFFSET);
+	desc->vertexAttributes[1] = __pvkGetVertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32B32_SFLOAT, PVK_VERTEX_NORMAL_OFFSET);
+	desc->vertexAttributes[2] = __pvkGetVertexInputAttributeDescription(0, 2, VK_FORMAT_R32G32_SFLOAT, PVK_VERTEX_TEXCOORD_OFFSET);
+	desc->vertexAttributes[3] = __pvkGetVertexInputAttributeDescription(0, 3, VK_FORMAT_R32G32B32A32_SFLOAT, PVK_VERTEX_COLOR_OFFSET);
+}
+#endif
+
+/* adds the per instance binding (PvkInstance, VK_VERTEX_INPUT_RATE_INSTANCE) after the PvkVertex one, 
+ * for the pipelines drawn with pvkDrawGeometryInstanced */
+PVK_LINKAGE void pvkGraphicsPipelineDescAddInstanceLayout(PvkGraphicsPipelineDesc* desc);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkGraphicsPipelineDescAddInstanceLayout(PvkGraphicsPipelineDesc* desc)
+{
+	PVK_ASSERT((desc->vertexBindingCount == PVK_INSTANCE_BINDING) && ((desc->vertexAttributeCount + PVK_INSTANCE_ATTRIBUTE_COUNT) <= PVK_PIPELINE_MAX_VERTEX_ATTRIBUTES));
+	desc->vertexBindings[desc->vertexBindingCount++] = (VkVertexInputBindingDescription) { PVK_INSTANCE_BINDING, PVK_INSTANCE_SIZE, VK_VERTEX_INPUT_RATE_INSTANCE };
+	/* a mat4 attribute takes one location per column */
+	for(uint32_t i = 0; i < 4; i++)
+		desc->vertexAttributes[desc->vertexAttributeCount++] = __pvkGetVertexInputAttributeDescription(PVK_INSTANCE_BINDING, PVK_INSTANCE_FIRST_LOCATION + i, 
+																VK_FORMAT_R32G32B32A32_SFLOAT, PVK_INSTANCE_MODEL_MATRIX_OFFSET + sizeof(PvkVec4) * i);
+	desc->vertexAttributes[desc->vertexAttributeCount++] = __pvkGetVertexInputAttributeDescription(PVK_INSTANCE_BINDING, PVK_INSTANCE_FIRST_LOCATION + 4, 
+																VK_FORMAT_R32G32B32A32_SFLOAT, PVK_INSTANCE_COLOR_OFFSET);
+}
+#endif
+
+/* returns false if a vertex input of the (reflected) vertex shader has no attribute in desc, 
+ * i.e. the layout set with pvkGraphicsPipelineDescSetVertexFormat (and pvkGraphicsPipelineDescAddInstanceLayout) doesn't match the shader */
+PVK_LINKAGE bool pvkGraphicsPipelineDescCheckVertexInputs(const PvkGraphicsPipelineDesc* desc, const PvkShaderReflection* vertexReflection);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkGraphicsPipelineDescCheckVertexInputs(const PvkGraphicsPipelineDesc* desc, const PvkShaderReflection* vertexReflection)
+{
+	bool isMatching = true;
+	for(uint32_t i = 0; i < vertexReflection->vertexInputCount; i++)
+	{
+		uint32_t location = vertexReflection->vertexInputs[i].location;
+		uint32_t j = 0;
+		for(; (j < desc->vertexAttributeCount) && (desc->vertexAttributes[j].location != location); j++);
+		if(j < desc->vertexAttributeCount)
+			continue;
+		PVK_WARNING("No vertex attribute at location = %u", location);
+		isMatching = false;
+	}
+	return isMatching;
+}
+#endif
+
+/* opaque color attachments, blending disabled */
+PVK_STATIC PVK_INLINE void __pvkGraphicsPipelineDescSetOpaqueColorAttachments(PvkGraphicsPipelineDesc* desc, uint32_t colorAttachmentCount)
+{
+	PVK_ASSERT(colorAttachmentCount <= PVK_PIPELINE_MAX_COLOR_ATTACHMENTS);
+	desc->colorAttachmentCount = colorAttachmentCount;
+	for(uint32_t i = 0; i < colorAttachmentCount; i++)
+	{
+		desc->colorAttachments[i] = (VkPipelineColorBlendAttachmentState) { };
+		desc->colorAttachments[i].blendEnable = VK_FALSE;
+		desc->colorAttachments[i].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	}
+}
+
+/* the description pvkCreateGraphicsPipeline creates the pipeline from, interleaved PvkVertex (see pvkGraphicsPipelineDescSetVertexFormat) */
+PVK_LINKAGE PvkGraphicsPipelineDesc pvkGetGraphicsPipelineDesc(VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t colorAttachmentCount, uint32_t width, uint32_t height, uint32_t shaderCount, const PvkShader* shaders);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkGraphicsPipelineDesc pvkGetGraphicsPipelineDesc(VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t colorAttachmentCount, uint32_t width, uint32_t height, uint32_t shaderCount, const PvkShader* shaders)
+{
+	PvkGraphicsPipelineDesc desc = __pvkGetGraphicsPipelineDescBase(layout, renderPass, subpassIndex, width, height, shaderCount, shaders);
+	pvkGraphicsPipelineDescSetVertexFormat(&desc, 0, false);
+	__pvkGraphicsPipelineDescSetOpaqueColorAttachments(&desc, colorAttachmentCount);
+	return desc;
+}
+#endif
+
+/* the description pvkCreateShadowMapGraphicsPipeline creates the pipeline from, only the positions of interleaved PvkVertex are fetched */
+PVK_LINKAGE PvkGraphicsPipelineDesc pvkGetShadowMapGraphicsPipelineDesc(VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t shaderCount, const PvkShader* shaders);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkGraphicsPipelineDesc pvkGetShadowMapGraphicsPipelineDesc(VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t shaderCount, const PvkShader* shaders)
+{
+	PvkGraphicsPipelineDesc desc = __pvkGetGraphicsPipelineDescBase(layout, renderPass, subpassIndex, width, height, shaderCount, shaders);
+	pvkGraphicsPipelineDescSetVertexFormat(&desc, 0, true);
+	return desc;
+}
+#endif
+
+/* hashed field by field (only the used array elements), so the padding and the unused elements don't affect it */
+PVK_LINKAGE uint64_t pvkGetGraphicsPipelineDescHash(const PvkGraphicsPipelineDesc* desc);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE uint64_t pvkGetGraphicsPipelineDescHash(const PvkGraphicsPipelineDesc* desc)
+{
+	uint64_t hash = PVK_HASH_SEED;
+	__PVK_HASH_FIELD(hash, desc->layout);
+	__PVK_HASH_FIELD(hash, desc->renderPass);
+	__PVK_HASH_FIELD(hash, desc->subpassIndex);
+	__PVK_HASH_FIELD(hash, desc->width);
+	__PVK_HASH_FIELD(hash, desc->height);
+	__PVK_HASH_FIELD(hash, desc->shaderCount);
+	for(uint32_t i = 0; i < desc->shaderCount; i++)
+	{
+		__PVK_HASH_FIELD(hash, desc->shaders[i].handle);
+		__PVK_HASH_FIELD(hash, desc->shaders[i].type);
+	}
+	/* the Vulkan structs below have no padding */
+	__PVK_HASH_FIELD(hash, desc->vertexBindingCount);
+	hash = __pvkHashBytes(hash, desc->vertexBindings, sizeof(VkVertexInputBindingDescription) * desc->vertexBindingCount);
+	__PVK_HASH_FIELD(hash, desc->vertexAttributeCount);
+	hash = __pvkHashBytes(hash, desc->vertexAttributes, sizeof(VkVertexInputAttributeDescription) * desc->vertexAttributeCount);
+	__PVK_HASH_FIELD(hash, desc->topology);
+	__PVK_HASH_FIELD(hash, desc->polygonMode);
+	__PVK_HASH_FIELD(hash, desc->cullMode);
+	__PVK_HASH_FIELD(hash, desc->frontFace);
+	__PVK_HASH_FIELD(hash, desc->depthTestEnable);
+	__PVK_HASH_FIELD(hash, desc->depthWriteEnable);
+	__PVK_HASH_FIELD(hash, desc->depthCompareOp);
+	__PVK_HASH_FIELD(hash, desc->colorAttachmentCount);
+	hash = __pvkHashBytes(hash, desc->colorAttachments, sizeof(VkPipelineColorBlendAttachmentState) * desc->colorAttachmentCount);
+	return hash;
+}
+#endif
+
+PVK_LINKAGE bool pvkGraphicsPipelineDescEquals(const PvkGraphicsPipelineDesc* desc1, const PvkGraphicsPipelineDesc* desc2);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkGraphicsPipelineDescEquals(const PvkGraphicsPipelineDesc* desc1, const PvkGraphicsPipelineDesc* desc2)
+{
+	if((desc1->layout != desc2->layout) || (desc1->renderPass != desc2->renderPass) || (desc1->subpassIndex != desc2->subpassIndex)
+		|| (desc1->width != desc2->width) || (desc1->height != desc2->height)
+		|| (desc1->shaderCount != desc2->shaderCount) || (desc1->vertexBindingCount != desc2->vertexBindingCount)
+		|| (desc1->vertexAttributeCount != desc2->vertexAttributeCount) || (desc1->topology != desc2->topology)
+		|| (desc1->polygonMode != desc2->polygonMode) || (desc1->cullMode != desc2->cullMode) || (desc1->frontFace != desc2->frontFace)
+		|| (desc1->depthTestEnable != desc2->depthTestEnable) || (desc1->depthWriteEnable != desc2->depthWriteEnable)
+		|| (desc1->depthCompareOp != desc2->depthCompareOp) || (desc1->colorAttachmentCount != desc2->colorAttachmentCount))
+		return false;
+	for(uint32_t i = 0; i < desc1->shaderCount; i++)
+		if((desc1->shaders[i].handle != desc2->shaders[i].handle) || (desc1->shaders[i].type != desc2->shaders[i].type))
+			return false;
+	return (memcmp(desc1->vertexBindings, desc2->vertexBindings, sizeof(VkVertexInputBindingDescription) * desc1->vertexBindingCount) == 0)
+		&& (memcmp(desc1->vertexAttributes, desc2->vertexAttributes, sizeof(VkVertexInputAttributeDescription) * desc1->vertexAttributeCount) == 0)
+		&& (memcmp(desc1->colorAttachments, desc2->colorAttachments, sizeof(VkPipelineColorBlendAttachmentState) * desc1->colorAttachmentCount) == 0);
+}
+#endif
+
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipelineFromDesc(VkDevice device, VkPipelineCache pipelineCache, const PvkGraphicsPipelineDesc* desc);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipelineFromDesc(VkDevice device, VkPipelineCache pipelineCache, const PvkGraphicsPipelineDesc* desc)
+{
+	/* Shader modules */
+	VkPipelineShaderStageCreateInfo stageCInfos[PVK_PIPELINE_MAX_SHADERS];
+	for(uint32_t i = 0; i < desc->shaderCount; i++)
+	{
+		stageCInfos[i] = (VkPipelineShaderStageCreateInfo) { };
+		{
+			stageCInfos[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			stageCInfos[i].module = desc->shaders[i].handle;
+			stageCInfos[i].pName = "main";
+			stageCInfos[i].stage = __pkvShaderTypeToVulkanShaderStage(desc->shaders[i].type);
 		};
 	}
-	return infos;
+
+	/* Vertex buffer layouts and their description */
+	VkPipelineVertexInputStateCreateInfo vertexInputStateCInfo = { };
+	{
+		vertexInputStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertexInputStateCInfo.vertexBindingDescriptionCount = desc->vertexBindingCount;
+		vertexInputStateCInfo.pVertexBindingDescriptions = desc->vertexBindings;
+		vertexInputStateCInfo.vertexAttributeDescriptionCount = desc->vertexAttributeCount;
+		vertexInputStateCInfo.pVertexAttributeDescriptions = desc->vertexAttributes;
+	};
+
+	/* Primitive assembly */
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCInfo = { };
+	{
+		inputAssemblyStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssemblyStateCInfo.topology = desc->topology;
+		inputAssemblyStateCInfo.primitiveRestartEnable = VK_FALSE;
+	};
+
+	/* Viewport configuration */
+	VkViewport viewport = { };
+	{
+		viewport.x = 0;
+		viewport.y = 0;
+		viewport.width = desc->width;
+		viewport.height = desc->height;
+		viewport.minDepth = 0;
+		viewport.maxDepth = 1.0f;
+	};
+	VkRect2D scissor = { };
+	{
+		scissor.offset = (VkOffset2D) { 0, 0 };
+		scissor.extent = (VkExtent2D) { desc->width, desc->height };
+	};
+
+	bool isDynamicExtent = (desc->width == PVK_DYNAMIC_EXTENT) || (desc->height == PVK_DYNAMIC_EXTENT);
+
+	VkPipelineViewportStateCreateInfo viewportStateCInfo = { };
+	{
+		viewportStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportStateCInfo.viewportCount = 1;
+		viewportStateCInfo.pViewports = isDynamicExtent ? NULL : &viewport;
+		viewportStateCInfo.scissorCount = 1;
+		viewportStateCInfo.pScissors = isDynamicExtent ? NULL : &scissor;
+	};
+
+	VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicStateCInfo = { };
+	{
+		dynamicStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicStateCInfo.dynamicStateCount = 2;
+		dynamicStateCInfo.pDynamicStates = dynamicStates;
+	};
+
+	/* Rasterization configuration */
+	VkPipelineRasterizationStateCreateInfo rasterizationStateCInfo = { };
+	{
+		rasterizationStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizationStateCInfo.depthClampEnable = VK_FALSE;
+		rasterizationStateCInfo.rasterizerDiscardEnable = VK_FALSE;
+		rasterizationStateCInfo.polygonMode = desc->polygonMode;
+		rasterizationStateCInfo.cullMode = desc->cullMode;
+		rasterizationStateCInfo.frontFace = desc->frontFace;
+		rasterizationStateCInfo.lineWidth = 1.0f;
+	};
+
+	/* Multisampling */
+	VkPipelineMultisampleStateCreateInfo multisamplingStateCInfo = { };
+	{
+		multisamplingStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisamplingStateCInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		multisamplingStateCInfo.sampleShadingEnable = VK_FALSE;
+	};
+
+	/* Depth stencil configuration */
+	VkPipelineDepthStencilStateCreateInfo dephtStencilStateCInfo = { };
+	{
+		dephtStencilStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		dephtStencilStateCInfo.depthTestEnable = desc->depthTestEnable;
+		dephtStencilStateCInfo.depthWriteEnable = desc->depthWriteEnable;
+		dephtStencilStateCInfo.depthCompareOp = desc->depthCompareOp;
+		dephtStencilStateCInfo.stencilTestEnable = VK_FALSE;
+		dephtStencilStateCInfo.depthBoundsTestEnable = VK_FALSE;
+	};
+
+	/* Color attachment configuration */
+	VkPipelineColorBlendStateCreateInfo colorBlend = { };
+	{
+		colorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlend.logicOpEnable = VK_FALSE;
+		colorBlend.attachmentCount = desc->colorAttachmentCount;
+		colorBlend.pAttachments = desc->colorAttachments;
+	};
+
+	VkGraphicsPipelineCreateInfo pipelineCInfo = { };
+	{
+		pipelineCInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineCInfo.stageCount = desc->shaderCount;
+		pipelineCInfo.pStages = stageCInfos;
+		pipelineCInfo.pVertexInputState = &vertexInputStateCInfo;
+		pipelineCInfo.pInputAssemblyState = &inputAssemblyStateCInfo;
+		pipelineCInfo.pViewportState = &viewportStateCInfo;
+		pipelineCInfo.pMultisampleState = &multisamplingStateCInfo;
+		pipelineCInfo.pRasterizationState = &rasterizationStateCInfo;
+		pipelineCInfo.pDepthStencilState = &dephtStencilStateCInfo;
+		pipelineCInfo.pColorBlendState = (desc->colorAttachmentCount > 0) ? &colorBlend : NULL;
+		pipelineCInfo.pDynamicState = isDynamicExtent ? &dynamicStateCInfo : NULL;
+		pipelineCInfo.layout = desc->layout;
+		pipelineCInfo.renderPass = desc->renderPass;
+		pipelineCInfo.subpass = desc->subpassIndex;
+	};
+
+	VkPipeline pipeline;
+	PVK_CHECK(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCInfo, NULL, &pipeline));
+	return pipeline;
+}
+#endif
+
+PVK_LINKAGE VkPipeline pvkCreateShadowMapGraphicsPipeline2(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t count, const PvkShader* shaders);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkCreateShadowMapGraphicsPipeline2(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t count, const PvkShader* shaders)
+{
+	PvkGraphicsPipelineDesc desc = pvkGetShadowMapGraphicsPipelineDesc(layout, renderPass, subpassIndex, width, height, count, shaders);
+	return pvkCreateGraphicsPipelineFromDesc(device, pipelineCache, &desc);
+}
+#endif
+
+PVK_LINKAGE VkPipeline pvkCreateShadowMapGraphicsPipelineWithCache(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t count, ...);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkCreateShadowMapGraphicsPipelineWithCache(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t count, ...)
+{
+	PvkShader shaders[count];
+	va_list shaderModuleList;
+	va_start(shaderModuleList, count);
+	for(uint32_t i = 0; i < count; i++)
+		shaders[i] = va_arg(shaderModuleList, PvkShader);
+	va_end(shaderModuleList);
+	return pvkCreateShadowMapGraphicsPipeline2(device, pipelineCache, layout, renderPass, subpassIndex, width, height, count, shaders);
+}
+#endif
+
+PVK_LINKAGE VkPipeline pvkCreateShadowMapGraphicsPipeline(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t count, ...);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkCreateShadowMapGraphicsPipeline(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t count, ...)
+{
+	PvkShader shaders[count];
+	va_list shaderModuleList;
+	va_start(shaderModuleList, count);
+	for(uint32_t i = 0; i < count; i++)
+		shaders[i] = va_arg(shaderModuleList, PvkShader);
+	va_end(shaderModuleList);
+	return pvkCreateShadowMapGraphicsPipeline2(device, VK_NULL_HANDLE, layout, renderPass, subpassIndex, width, height, count, shaders);
+}
+#endif
+
+PVK_LINKAGE VkPipeline __pvkCreateGraphicsPipelineProfile0(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t width, uint32_t height, uint32_t count, va_list args);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline __pvkCreateGraphicsPipelineProfile0(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t width, uint32_t height, uint32_t count, va_list args)
+{
+	PvkShader shaders[count];
+	for(uint32_t i = 0; i < count; i++)
+		shaders[i] = va_arg(args, PvkShader);
+
+	/* no vertex input, single color attachment */
+	PvkGraphicsPipelineDesc desc = __pvkGetGraphicsPipelineDescBase(layout, renderPass, 0, width, height, count, shaders);
+	__pvkGraphicsPipelineDescSetOpaqueColorAttachments(&desc, 1);
+	return pvkCreateGraphicsPipelineFromDesc(device, pipelineCache, &desc);
+}
+#endif
+
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipelineProfile0WithCache(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t width, uint32_t height, uint32_t count, ...);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipelineProfile0WithCache(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t width, uint32_t height, uint32_t count, ...)
+{
+	va_list shaderModuleList;
+	va_start(shaderModuleList, count);
+	VkPipeline pipeline = __pvkCreateGraphicsPipelineProfile0(device, pipelineCache, layout, renderPass, width, height, count, shaderModuleList);
+	va_end(shaderModuleList);
+	return pipeline;
+}
+#endif
+
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipelineProfile0(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t width, uint32_t height, uint32_t count, ...);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipelineProfile0(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t width, uint32_t height, uint32_t count, ...)
+{
+	va_list shaderModuleList;
+	va_start(shaderModuleList, count);
+	VkPipeline pipeline = __pvkCreateGraphicsPipelineProfile0(device, VK_NULL_HANDLE, layout, renderPass, width, height, count, shaderModuleList);
+	va_end(shaderModuleList);
+	return pipeline;
+}
+#endif
+
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipeline2(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t colorAttachmentCount, uint32_t width, uint32_t height, uint32_t count, const PvkShader* shaders);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipeline2(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t colorAttachmentCount, uint32_t width, uint32_t height, uint32_t count, const PvkShader* shaders)
+{
+	PvkGraphicsPipelineDesc desc = pvkGetGraphicsPipelineDesc(layout, renderPass, subpassIndex, colorAttachmentCount, width, height, count, shaders);
+	return pvkCreateGraphicsPipelineFromDesc(device, pipelineCache, &desc);
+}
+#endif
+
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipelineWithCache(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t colorAttachmentCount, uint32_t width, uint32_t height, uint32_t count, ...);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipelineWithCache(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t colorAttachmentCount, uint32_t width, uint32_t height, uint32_t count, ...)
+{
+	PvkShader shaders[count];
+	va_list shaderModuleList;
+	va_start(shaderModuleList, count);
+	for(uint32_t i = 0; i < count; i++)
+		shaders[i] = va_arg(shaderModuleList, PvkShader);
+	va_end(shaderModuleList);
+	return pvkCreateGraphicsPipeline2(device, pipelineCache, layout, renderPass, subpassIndex, colorAttachmentCount, width, height, count, shaders);
+}
+#endif
+
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipeline(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t colorAttachmentCount, uint32_t width, uint32_t height, uint32_t count, ...);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkCreateGraphicsPipeline(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t colorAttachmentCount, uint32_t width, uint32_t height, uint32_t count, ...)
+{
+	PvkShader shaders[count];
+	va_list shaderModuleList;
+	va_start(shaderModuleList, count);
+	for(uint32_t i = 0; i < count; i++)
+		shaders[i] = va_arg(shaderModuleList, PvkShader);
+	va_end(shaderModuleList);
+	return pvkCreateGraphicsPipeline2(device, VK_NULL_HANDLE, layout, renderPass, subpassIndex, colorAttachmentCount, width, height, count, shaders);
+}
+#endif
+
+/* Pipeline registry
+ * Returns the already created pipeline for a description identical to one seen before, owns the pipelines it returns.
+ * The lookup is a linear scan over the hashes, which is plenty for the number of pipelines an application has.
+ * The registry isn't thread-safe, it must only be used from one thread at a time (a PvkPipelineBuilder given a registry
+ * touches it only in pvkPipelineBuilderSubmit and pvkPipelineBuildWait, never on its worker threads). */
+typedef struct PvkPipelineRegistryEntry
+{
+	uint64_t hash;
+	PvkGraphicsPipelineDesc desc;
+	VkPipeline pipeline;
+} PvkPipelineRegistryEntry;
+
+typedef struct PvkPipelineRegistry
+{
+	VkDevice device;
+	VkPipelineCache pipelineCache;
+	PvkPipelineRegistryEntry* entries;
+	uint32_t entryCount;
+	uint32_t entryCapacity;
+	/* stats */
+	uint32_t hitCount;
+	uint32_t missCount;
+} PvkPipelineRegistry;
+
+PVK_LINKAGE PvkPipelineRegistry* pvkCreatePipelineRegistry(VkDevice device, VkPipelineCache pipelineCache);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkPipelineRegistry* pvkCreatePipelineRegistry(VkDevice device, VkPipelineCache pipelineCache)
+{
+	PvkPipelineRegistry* registry = PVK_NEW(PvkPipelineRegistry);
+	registry->device = device;
+	registry->pipelineCache = pipelineCache;
+	return registry;
+}
+#endif
+
+/* destroys all the pipelines of the registry */
+PVK_LINKAGE void pvkDestroyPipelineRegistry(PvkPipelineRegistry* registry);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyPipelineRegistry(PvkPipelineRegistry* registry)
+{
+	for(uint32_t i = 0; i < registry->entryCount; i++)
+		vkDestroyPipeline(registry->device, registry->entries[i].pipeline, NULL);
+	if(registry->entries != NULL)
+		PVK_FREE(registry->entries);
+	PVK_DELETE(registry);
+}
+#endif
+
+/* returns VK_NULL_HANDLE if no pipeline has been registered for the description yet */
+PVK_LINKAGE VkPipeline pvkPipelineRegistryFind(PvkPipelineRegistry* registry, const PvkGraphicsPipelineDesc* desc);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkPipelineRegistryFind(PvkPipelineRegistry* registry, const PvkGraphicsPipelineDesc* desc)
+{
+	uint64_t hash = pvkGetGraphicsPipelineDescHash(desc);
+	for(uint32_t i = 0; i < registry->entryCount; i++)
+	{
+		PvkPipelineRegistryEntry* entry = &registry->entries[i];
+		if((entry->hash == hash) && pvkGraphicsPipelineDescEquals(&entry->desc, desc))
+			return entry->pipeline;
+	}
+	return VK_NULL_HANDLE;
+}
+#endif
+
+/* registers a pipeline created elsewhere (i.e. by a PvkPipelineBuilder), the registry takes its ownership */
+PVK_LINKAGE void pvkPipelineRegistryAdd(PvkPipelineRegistry* registry, const PvkGraphicsPipelineDesc* desc, VkPipeline pipeline);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkPipelineRegistryAdd(PvkPipelineRegistry* registry, const PvkGraphicsPipelineDesc* desc, VkPipeline pipeline)
+{
+	PVK_ASSERT(pvkPipelineRegistryFind(registry, desc) == VK_NULL_HANDLE);
+	if(registry->entryCount == registry->entryCapacity)
+	{
+		registry->entryCapacity = (registry->entryCapacity == 0) ? 16 : (registry->entryCapacity * 2);
+		registry->entries = (PvkPipelineRegistryEntry*)realloc(registry->entries, sizeof(PvkPipelineRegistryEntry) * registry->entryCapacity);
+		PVK_ASSERT(registry->entries != NULL);
+	}
+	PvkPipelineRegistryEntry* entry = &registry->entries[registry->entryCount++];
+	entry->hash = pvkGetGraphicsPipelineDescHash(desc);
+	entry->desc = *desc;
+	entry->pipeline = pipeline;
+}
+#endif
+
+/* returns the registered pipeline for the description, creates (and registers) it only if there is none */
+PVK_LINKAGE VkPipeline pvkPipelineRegistryGet(PvkPipelineRegistry* registry, const PvkGraphicsPipelineDesc* desc);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkPipelineRegistryGet(PvkPipelineRegistry* registry, const PvkGraphicsPipelineDesc* desc)
+{
+	VkPipeline pipeline = pvkPipelineRegistryFind(registry, desc);
+	if(pipeline != VK_NULL_HANDLE)
+	{
+		registry->hitCount++;
+		return pipeline;
+	}
+	registry->missCount++;
+	pipeline = pvkCreateGraphicsPipelineFromDesc(registry->device, registry->pipelineCache, desc);
+	pvkPipelineRegistryAdd(registry, desc, pipeline);
+	return pipeline;
+}
+#endif
+
+/* Parallel pipeline compilation
+ * The pipelines are compiled on a pool of worker threads, the VkPipelineCache is shared by all of them 
+ * (pipeline caches are internally synchronized by the driver). */
+
+/* handle to a pipeline being compiled, poll it with pvkPipelineBuildIsDone and redeem it with pvkPipelineBuildWait */
+typedef struct PvkPipelineBuild
+{
+	PvkGraphicsPipelineDesc desc;
+	VkPipeline pipeline;
+	bool isDone;
+	/* the pipeline has been found in PvkPipelineBuilder::registry at submission, it isn't compiled */
+	bool isRegistered;
+	struct PvkPipelineBuild* next;
+} PvkPipelineBuild;
+
+typedef struct PvkPipelineBuilder
+{
+	VkDevice device;
+	VkPipelineCache pipelineCache;
+	/* optional, owns the built pipelines, only accessed by the thread submitting and waiting on the builds */
+	PvkPipelineRegistry* registry;
+	pthread_t* threads;
+	uint32_t threadCount;
+	/* protects everything below */
+	pthread_mutex_t mutex;
+	/* signaled when a build is queued or the builder is stopping */
+	pthread_cond_t workCondition;
+	/* signaled when a build is done */
+	pthread_cond_t doneCondition;
+	/* FIFO of the queued builds */
+	PvkPipelineBuild* head;
+	PvkPipelineBuild* tail;
+	bool isStopping;
+	/* stats */
+	uint32_t builtCount;
+	/* pvkGetTimeNs() when the last build has been done, so that the build time can be measured without what the caller did meanwhile */
+	uint64_t lastDoneTime;
+} PvkPipelineBuilder;
+
+/* number of the online CPU cores, 4 if it can't be queried */
+PVK_LINKAGE uint32_t pvkGetProcessorCount();
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE uint32_t pvkGetProcessorCount()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	if(count > 0)
+		return (uint32_t)count;
+#endif
+	return 4;
+}
+#endif
+
+PVK_LINKAGE void* __pvkPipelineBuilderWorker(void* userData);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void* __pvkPipelineBuilderWorker(void* userData)
+{
+	PvkPipelineBuilder* builder = (PvkPipelineBuilder*)userData;
+	pthread_mutex_lock(&builder->mutex);
+	while(true)
+	{
+		while((builder->head == NULL) && !builder->isStopping)
+			pthread_cond_wait(&builder->workCondition, &builder->mutex);
+		/* the queued builds are completed before stopping */
+		if(builder->head == NULL)
+			break;
+		PvkPipelineBuild* build = builder->head;
+		builder->head = build->next;
+		if(builder->head == NULL)
+			builder->tail = NULL;
+		pthread_mutex_unlock(&builder->mutex);
+
+		VkPipeline pipeline = pvkCreateGraphicsPipelineFromDesc(builder->device, builder->pipelineCache, &build->desc);
+
+		pthread_mutex_lock(&builder->mutex);
+		build->pipeline = pipeline;
+		build->isDone = true;
+		builder->builtCount++;
+		builder->lastDoneTime = pvkGetTimeNs();
+		pthread_cond_broadcast(&builder->doneCondition);
+	}
+	pthread_mutex_unlock(&builder->mutex);
+	return NULL;
+}
+#endif
+
+/* threadCount = 0 creates one worker per CPU core
+ * registry: optional, the descriptions already in it aren't compiled again and the pipelines returned by pvkPipelineBuildWait
+ * 			 are registered in it (and owned by it) */
+PVK_LINKAGE PvkPipelineBuilder* pvkCreatePipelineBuilder2(VkDevice device, VkPipelineCache pipelineCache, uint32_t threadCount, PvkPipelineRegistry* registry);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkPipelineBuilder* pvkCreatePipelineBuilder2(VkDevice device, VkPipelineCache pipelineCache, uint32_t threadCount, PvkPipelineRegistry* registry)
+{
+	PvkPipelineBuilder* builder = PVK_NEW(PvkPipelineBuilder);
+	builder->device = device;
+	builder->pipelineCache = pipelineCache;
+	builder->registry = registry;
+	builder->threadCount = (threadCount == 0) ? pvkGetProcessorCount() : threadCount;
+	builder->threads = PVK_NEWV(pthread_t, builder->threadCount);
+	pthread_mutex_init(&builder->mutex, NULL);
+	pthread_cond_init(&builder->workCondition, NULL);
+	pthread_cond_init(&builder->doneCondition, NULL);
+	for(uint32_t i = 0; i < builder->threadCount; i++)
+		if(pthread_create(&builder->threads[i], NULL, __pvkPipelineBuilderWorker, builder) != 0)
+			PVK_FETAL_ERROR("Unable to create pipeline builder thread %u", i);
+	return builder;
+}
+#endif
+
+PVK_LINKAGE PvkPipelineBuilder* pvkCreatePipelineBuilder(VkDevice device, VkPipelineCache pipelineCache, uint32_t threadCount);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkPipelineBuilder* pvkCreatePipelineBuilder(VkDevice device, VkPipelineCache pipelineCache, uint32_t threadCount)
+{
+	return pvkCreatePipelineBuilder2(device, pipelineCache, threadCount, NULL);
+}
+#endif
+
+/* finishes the queued builds before destroying the builder, the builds which haven't been redeemed with pvkPipelineBuildWait are leaked */
+PVK_LINKAGE void pvkDestroyPipelineBuilder(PvkPipelineBuilder* builder);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyPipelineBuilder(PvkPipelineBuilder* builder)
+{
+	pthread_mutex_lock(&builder->mutex);
+	builder->isStopping = true;
+	pthread_cond_broadcast(&builder->workCondition);
+	pthread_mutex_unlock(&builder->mutex);
+	for(uint32_t i = 0; i < builder->threadCount; i++)
+		pthread_join(builder->threads[i], NULL);
+	pthread_cond_destroy(&builder->doneCondition);
+	pthread_cond_destroy(&builder->workCondition);
+	pthread_mutex_destroy(&builder->mutex);
+	PVK_DELETE(builder->threads);
+	PVK_DELETE(builder);
+}
+#endif
+
+/* queues count pipelines for compilation and returns immediately, outBuilds receives a handle for each of them,
+ * the descriptions already in the builder's registry are done immediately with the registered pipeline */
+PVK_LINKAGE void pvkPipelineBuilderSubmit(PvkPipelineBuilder* builder, uint32_t count, const PvkGraphicsPipelineDesc* descs, PvkPipelineBuild** outBuilds);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkPipelineBuilderSubmit(PvkPipelineBuilder* builder, uint32_t count, const PvkGraphicsPipelineDesc* descs, PvkPipelineBuild** outBuilds)
+{
+	for(uint32_t i = 0; i < count; i++)
+	{
+		outBuilds[i] = PVK_NEW(PvkPipelineBuild);
+		outBuilds[i]->desc = descs[i];
+		/* the registry is looked up here, on the submitting thread, the workers never touch it */
+		if(builder->registry != NULL)
+		{
+			outBuilds[i]->pipeline = pvkPipelineRegistryFind(builder->registry, &descs[i]);
+			outBuilds[i]->isRegistered = outBuilds[i]->pipeline != VK_NULL_HANDLE;
+			outBuilds[i]->isDone = outBuilds[i]->isRegistered;
+			if(outBuilds[i]->isRegistered)
+				builder->registry->hitCount++;
+		}
+	}
+	pthread_mutex_lock(&builder->mutex);
+	PVK_ASSERT(!builder->isStopping);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		if(outBuilds[i]->isDone)
+		{
+			builder->lastDoneTime = pvkGetTimeNs();
+			continue;
+		}
+		if(builder->tail == NULL)
+			builder->head = outBuilds[i];
+		else
+			builder->tail->next = outBuilds[i];
+		builder->tail = outBuilds[i];
+	}
+	pthread_cond_broadcast(&builder->workCondition);
+	pthread_mutex_unlock(&builder->mutex);
+}
+#endif
+
+PVK_LINKAGE bool pvkPipelineBuildIsDone(PvkPipelineBuilder* builder, PvkPipelineBuild* build);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkPipelineBuildIsDone(PvkPipelineBuilder* builder, PvkPipelineBuild* build)
+{
+	pthread_mutex_lock(&builder->mutex);
+	bool isDone = build->isDone;
+	pthread_mutex_unlock(&builder->mutex);
+	return isDone;
+}
+#endif
+
+/* blocks until the pipeline is compiled and returns it, the build handle is freed.
+ * with a registry, the pipeline is registered (owned by the registry), and if an identical description has been registered
+ * meanwhile (i.e. the same description submitted twice before either was waited on) the duplicate is destroyed and the
+ * registered pipeline is returned instead */
+PVK_LINKAGE VkPipeline pvkPipelineBuildWait(PvkPipelineBuilder* builder, PvkPipelineBuild* build);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipeline pvkPipelineBuildWait(PvkPipelineBuilder* builder, PvkPipelineBuild* build)
+{
+	pthread_mutex_lock(&builder->mutex);
+	while(!build->isDone)
+		pthread_cond_wait(&builder->doneCondition, &builder->mutex);
+	pthread_mutex_unlock(&builder->mutex);
+	VkPipeline pipeline = build->pipeline;
+	if((builder->registry != NULL) && !build->isRegistered)
+	{
+		VkPipeline registeredPipeline = pvkPipelineRegistryFind(builder->registry, &build->desc);
+		if(registeredPipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(builder->device, pipeline, NULL);
+			pipeline = registeredPipeline;
+			builder->registry->hitCount++;
+		}
+		else
+		{
+			pvkPipelineRegistryAdd(builder->registry, &build->desc, pipeline);
+			builder->registry->missCount++;
+		}
+	}
+	PVK_DELETE(build);
+	return pipeline;
+}
+#endif
+
+/* creates a new layout on every call, PvkLayoutCache returns a shared one for identical set layouts and push constant ranges
+ * pushConstantRanges: only 128 bytes of push constants are guaranteed (VkPhysicalDeviceLimits::maxPushConstantsSize) */
+PVK_LINKAGE VkPipelineLayout pvkCreatePipelineLayout2(VkDevice device, uint32_t setLayoutCount, const VkDescriptorSetLayout* setLayouts, uint32_t pushConstantRangeCount, const VkPushConstantRange* pushConstantRanges);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipelineLayout pvkCreatePipelineLayout2(VkDevice device, uint32_t setLayoutCount, const VkDescriptorSetLayout* setLayouts, uint32_t pushConstantRangeCount, const VkPushConstantRange* pushConstantRanges)
+{
+	VkPipelineLayoutCreateInfo cInfo = { };
+	{
+		cInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		cInfo.setLayoutCount = setLayoutCount;
+		cInfo.pSetLayouts = setLayouts;
+		cInfo.pushConstantRangeCount = pushConstantRangeCount;
+		cInfo.pPushConstantRanges = pushConstantRanges;
+	};
+	VkPipelineLayout layout;
+	PVK_CHECK(vkCreatePipelineLayout(device, &cInfo, NULL, &layout));
+	return layout;
+}
+#endif
+
+PVK_STATIC PVK_INLINE VkPipelineLayout pvkCreatePipelineLayout(VkDevice device, uint32_t setLayoutCount, VkDescriptorSetLayout* setLayouts)
+{
+	return pvkCreatePipelineLayout2(device, setLayoutCount, setLayouts, 0, NULL);
+}
+
+/* Hash index
+ * Open addressing table of the indices of the entries of an array, the entries start with their uint64_t hash 
+ * so that the table can be rebuilt when it grows. The slots hold the entry index + 1, 0 is an empty slot. */
+typedef struct PvkHashIndex
+{
+	uint32_t* slots;
+	/* power of 2 */
+	uint32_t capacity;
+	uint32_t count;
+} PvkHashIndex;
+
+#define PVK_HASH_INDEX_FOR_EACH_SLOT(index, hash, slot) \
+	for(uint32_t slot = ((index)->capacity == 0) ? 0 : ((uint32_t)(hash) & ((index)->capacity - 1)); \
+		((index)->capacity != 0) && ((index)->slots[slot] != 0); \
+		slot = (slot + 1) & ((index)->capacity - 1))
+
+PVK_LINKAGE void __pvkHashIndexInsert(PvkHashIndex* index, const void* entries, size_t entryStride, uint32_t entryIndex);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void __pvkHashIndexInsert(PvkHashIndex* index, const void* entries, size_t entryStride, uint32_t entryIndex)
+{
+	/* kept at most half full */
+	if(((index->count + 1) * 2) > index->capacity)
+	{
+		if(index->slots != NULL)
+			PVK_DELETE(index->slots);
+		index->capacity = (index->capacity == 0) ? 32 : (index->capacity * 2);
+		index->slots = PVK_NEWV(uint32_t, index->capacity);
+		index->count = 0;
+		for(uint32_t i = 0; i < entryIndex; i++)
+			__pvkHashIndexInsert(index, entries, entryStride, i);
+	}
+	uint64_t hash = *(const uint64_t*)((const uint8_t*)entries + entryStride * entryIndex);
+	uint32_t slot = (uint32_t)hash & (index->capacity - 1);
+	while(index->slots[slot] != 0)
+		slot = (slot + 1) & (index->capacity - 1);
+	index->slots[slot] = entryIndex + 1;
+	index->count++;
+}
+#endif
+
+PVK_STATIC PVK_INLINE void __pvkDestroyHashIndex(PvkHashIndex* index)
+{
+	if(index->slots != NULL)
+		PVK_DELETE(index->slots);
+	*index = (PvkHashIndex) { };
+}
+
+/* Layout cache
+ * Hash-consed descriptor set layouts and pipeline layouts: a layout is created only once for identical bindings 
+ * (or set layouts and push constant ranges) and then shared, so the layouts can be compared by their handles. 
+ * The cache owns all of them. */
+#define PVK_PIPELINE_LAYOUT_MAX_SETS 8
+
+typedef struct PvkSetLayoutCacheEntry
+{
+	uint64_t hash;
+	uint32_t bindingCount;
+	/* sorted by binding */
+	VkDescriptorSetLayoutBinding* bindings;
+	VkDescriptorSetLayout handle;
+} PvkSetLayoutCacheEntry;
+
+typedef struct PvkPipelineLayoutCacheEntry
+{
+	uint64_t hash;
+	uint32_t setLayoutCount;
+	VkDescriptorSetLayout setLayouts[PVK_PIPELINE_LAYOUT_MAX_SETS];
+	uint32_t pushConstantRangeCount;
+	VkPushConstantRange pushConstantRanges[PVK_PIPELINE_MAX_SHADERS];
+	VkPipelineLayout handle;
+} PvkPipelineLayoutCacheEntry;
+
+typedef struct PvkLayoutCache
+{
+	VkDevice device;
+	PvkSetLayoutCacheEntry* setLayouts;
+	uint32_t setLayoutCount;
+	uint32_t setLayoutCapacity;
+	PvkHashIndex setLayoutIndex;
+	PvkPipelineLayoutCacheEntry* pipelineLayouts;
+	uint32_t pipelineLayoutCount;
+	uint32_t pipelineLayoutCapacity;
+	PvkHashIndex pipelineLayoutIndex;
+	/* stats */
+	uint32_t hitCount;
+} PvkLayoutCache;
+
+PVK_LINKAGE PvkLayoutCache* pvkCreateLayoutCache(VkDevice device);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkLayoutCache* pvkCreateLayoutCache(VkDevice device)
+{
+	PvkLayoutCache* cache = PVK_NEW(PvkLayoutCache);
+	cache->device = device;
+	return cache;
+}
+#endif
+
+/* destroys all the layouts of the cache */
+PVK_LINKAGE void pvkDestroyLayoutCache(PvkLayoutCache* cache);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyLayoutCache(PvkLayoutCache* cache)
+{
+	for(uint32_t i = 0; i < cache->pipelineLayoutCount; i++)
+		vkDestroyPipelineLayout(cache->device, cache->pipelineLayouts[i].handle, NULL);
+	for(uint32_t i = 0; i < cache->setLayoutCount; i++)
+	{
+		vkDestroyDescriptorSetLayout(cache->device, cache->setLayouts[i].handle, NULL);
+		if(cache->setLayouts[i].bindings != NULL)
+			PVK_DELETE(cache->setLayouts[i].bindings);
+	}
+	if(cache->pipelineLayouts != NULL)
+		PVK_FREE(cache->pipelineLayouts);
+	if(cache->setLayouts != NULL)
+		PVK_FREE(cache->setLayouts);
+	__pvkDestroyHashIndex(&cache->pipelineLayoutIndex);
+	__pvkDestroyHashIndex(&cache->setLayoutIndex);
+	PVK_DELETE(cache);
+}
+#endif
+
+/* returns the shared set layout for the bindings (in any order), immutable samplers aren't supported */
+PVK_LINKAGE VkDescriptorSetLayout pvkLayoutCacheGetDescriptorSetLayout(PvkLayoutCache* cache, uint32_t bindingCount, const VkDescriptorSetLayoutBinding* bindings);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkDescriptorSetLayout pvkLayoutCacheGetDescriptorSetLayout(PvkLayoutCache* cache, uint32_t bindingCount, const VkDescriptorSetLayoutBinding* bindings)
+{
+	/* the key is the bindings sorted by binding */
+	VkDescriptorSetLayoutBinding sortedBindings[bindingCount + 1];
+	uint64_t hash = PVK_HASH_SEED;
+	__PVK_HASH_FIELD(hash, bindingCount);
+	for(uint32_t i = 0; i < bindingCount; i++)
+	{
+		PVK_ASSERT(bindings[i].pImmutableSamplers == NULL);
+		uint32_t j = i;
+		for(; (j > 0) && (sortedBindings[j - 1].binding > bindings[i].binding); j--)
+			sortedBindings[j] = sortedBindings[j - 1];
+		sortedBindings[j] = (VkDescriptorSetLayoutBinding) { };
+		sortedBindings[j].binding = bindings[i].binding;
+		sortedBindings[j].descriptorType = bindings[i].descriptorType;
+		sortedBindings[j].descriptorCount = bindings[i].descriptorCount;
+		sortedBindings[j].stageFlags = bindings[i].stageFlags;
+	}
+	for(uint32_t i = 0; i < bindingCount; i++)
+	{
+		__PVK_HASH_FIELD(hash, sortedBindings[i].binding);
+		__PVK_HASH_FIELD(hash, sortedBindings[i].descriptorType);
+		__PVK_HASH_FIELD(hash, sortedBindings[i].descriptorCount);
+		__PVK_HASH_FIELD(hash, sortedBindings[i].stageFlags);
+	}
+
+	PVK_HASH_INDEX_FOR_EACH_SLOT(&cache->setLayoutIndex, hash, slot)
+	{
+		PvkSetLayoutCacheEntry* entry = &cache->setLayouts[cache->setLayoutIndex.slots[slot] - 1];
+		if((entry->hash == hash) && (entry->bindingCount == bindingCount) 
+			&& (memcmp(entry->bindings, sortedBindings, sizeof(VkDescriptorSetLayoutBinding) * bindingCount) == 0))
+		{
+			cache->hitCount++;
+			return entry->handle;
+		}
+	}
+
+	VkDescriptorSetLayoutCreateInfo cInfo = { };
+	{
+		cInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		cInfo.bindingCount = bindingCount;
+		cInfo.pBindings = sortedBindings;
+	};
+	VkDescriptorSetLayout setLayout;
+	PVK_CHECK(vkCreateDescriptorSetLayout(cache->device, &cInfo, NULL, &setLayout));
+
+	if(cache->setLayoutCount == cache->setLayoutCapacity)
+	{
+		cache->setLayoutCapacity = (cache->setLayoutCapacity == 0) ? 16 : (cache->setLayoutCapacity * 2);
+		cache->setLayouts = (PvkSetLayoutCacheEntry*)realloc(cache->setLayouts, sizeof(PvkSetLayoutCacheEntry) * cache->setLayoutCapacity);
+		PVK_ASSERT(cache->setLayouts != NULL);
+	}
+	PvkSetLayoutCacheEntry* entry = &cache->setLayouts[cache->setLayoutCount];
+	entry->hash = hash;
+	entry->bindingCount = bindingCount;
+	entry->bindings = (bindingCount > 0) ? PVK_NEWV(VkDescriptorSetLayoutBinding, bindingCount) : NULL;
+	if(bindingCount > 0)
+		memcpy(entry->bindings, sortedBindings, sizeof(VkDescriptorSetLayoutBinding) * bindingCount);
+	entry->handle = setLayout;
+	__pvkHashIndexInsert(&cache->setLayoutIndex, cache->setLayouts, sizeof(PvkSetLayoutCacheEntry), cache->setLayoutCount++);
+	return setLayout;
+}
+#endif
+
+/* returns the shared pipeline layout, the set layouts should come from the same cache */
+PVK_LINKAGE VkPipelineLayout pvkLayoutCacheGetPipelineLayout(PvkLayoutCache* cache, uint32_t setLayoutCount, const VkDescriptorSetLayout* setLayouts, uint32_t pushConstantRangeCount, const VkPushConstantRange* pushConstantRanges);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipelineLayout pvkLayoutCacheGetPipelineLayout(PvkLayoutCache* cache, uint32_t setLayoutCount, const VkDescriptorSetLayout* setLayouts, uint32_t pushConstantRangeCount, const VkPushConstantRange* pushConstantRanges)
+{
+	PVK_ASSERT(setLayoutCount <= PVK_PIPELINE_LAYOUT_MAX_SETS);
+	PVK_ASSERT(pushConstantRangeCount <= PVK_PIPELINE_MAX_SHADERS);
+	/* the set layouts are hash-consed too, so hashing their handles is enough */
+	uint64_t hash = PVK_HASH_SEED;
+	__PVK_HASH_FIELD(hash, setLayoutCount);
+	hash = __pvkHashBytes(hash, setLayouts, sizeof(VkDescriptorSetLayout) * setLayoutCount);
+	__PVK_HASH_FIELD(hash, pushConstantRangeCount);
+	hash = __pvkHashBytes(hash, pushConstantRanges, sizeof(VkPushConstantRange) * pushConstantRangeCount);
+
+	PVK_HASH_INDEX_FOR_EACH_SLOT(&cache->pipelineLayoutIndex, hash, slot)
+	{
+		PvkPipelineLayoutCacheEntry* entry = &cache->pipelineLayouts[cache->pipelineLayoutIndex.slots[slot] - 1];
+		if((entry->hash == hash) && (entry->setLayoutCount == setLayoutCount) && (entry->pushConstantRangeCount == pushConstantRangeCount)
+			&& (memcmp(entry->setLayouts, setLayouts, sizeof(VkDescriptorSetLayout) * setLayoutCount) == 0)
+			&& (memcmp(entry->pushConstantRanges, pushConstantRanges, sizeof(VkPushConstantRange) * pushConstantRangeCount) == 0))
+		{
+			cache->hitCount++;
+			return entry->handle;
+		}
+	}
+
+	VkPipelineLayoutCreateInfo cInfo = { };
+	{
+		cInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		cInfo.setLayoutCount = setLayoutCount;
+		cInfo.pSetLayouts = setLayouts;
+		cInfo.pushConstantRangeCount = pushConstantRangeCount;
+		cInfo.pPushConstantRanges = pushConstantRanges;
+	};
+	VkPipelineLayout layout;
+	PVK_CHECK(vkCreatePipelineLayout(cache->device, &cInfo, NULL, &layout));
+
+	if(cache->pipelineLayoutCount == cache->pipelineLayoutCapacity)
+	{
+		cache->pipelineLayoutCapacity = (cache->pipelineLayoutCapacity == 0) ? 16 : (cache->pipelineLayoutCapacity * 2);
+		cache->pipelineLayouts = (PvkPipelineLayoutCacheEntry*)realloc(cache->pipelineLayouts, sizeof(PvkPipelineLayoutCacheEntry) * cache->pipelineLayoutCapacity);
+		PVK_ASSERT(cache->pipelineLayouts != NULL);
+	}
+	PvkPipelineLayoutCacheEntry* entry = &cache->pipelineLayouts[cache->pipelineLayoutCount];
+	*entry = (PvkPipelineLayoutCacheEntry) { };
+	entry->hash = hash;
+	entry->setLayoutCount = setLayoutCount;
+	memcpy(entry->setLayouts, setLayouts, sizeof(VkDescriptorSetLayout) * setLayoutCount);
+	entry->pushConstantRangeCount = pushConstantRangeCount;
+	memcpy(entry->pushConstantRanges, pushConstantRanges, sizeof(VkPushConstantRange) * pushConstantRangeCount);
+	entry->handle = layout;
+	__pvkHashIndexInsert(&cache->pipelineLayoutIndex, cache->pipelineLayouts, sizeof(PvkPipelineLayoutCacheEntry), cache->pipelineLayoutCount++);
+	return layout;
+}
+#endif
+
+PVK_STATIC PVK_INLINE const PvkPipelineLayoutCacheEntry* __pvkLayoutCacheFindPipelineLayout(PvkLayoutCache* cache, VkPipelineLayout layout)
+{
+	for(uint32_t i = 0; i < cache->pipelineLayoutCount; i++)
+		if(cache->pipelineLayouts[i].handle == layout)
+			return &cache->pipelineLayouts[i];
+	return NULL;
+}
+
+/* true if the descriptor sets bound at [0, setIndex] with one of the layouts stay valid for the other 
+ * (same push constant ranges and same set layouts up to setIndex), both must come from the cache */
+PVK_LINKAGE bool pvkLayoutCacheIsCompatibleForSet(PvkLayoutCache* cache, VkPipelineLayout layout1, VkPipelineLayout layout2, uint32_t setIndex);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkLayoutCacheIsCompatibleForSet(PvkLayoutCache* cache, VkPipelineLayout layout1, VkPipelineLayout layout2, uint32_t setIndex)
+{
+	if(layout1 == layout2)
+		return true;
+	const PvkPipelineLayoutCacheEntry* entry1 = __pvkLayoutCacheFindPipelineLayout(cache, layout1);
+	const PvkPipelineLayoutCacheEntry* entry2 = __pvkLayoutCacheFindPipelineLayout(cache, layout2);
+	PVK_ASSERT((entry1 != NULL) && (entry2 != NULL));
+	if((setIndex >= entry1->setLayoutCount) || (setIndex >= entry2->setLayoutCount) 
+		|| (entry1->pushConstantRangeCount != entry2->pushConstantRangeCount)
+		|| (memcmp(entry1->pushConstantRanges, entry2->pushConstantRanges, sizeof(VkPushConstantRange) * entry1->pushConstantRangeCount) != 0))
+		return false;
+	/* the set layouts are shared, comparing the handles compares the layouts */
+	for(uint32_t i = 0; i <= setIndex; i++)
+		if(entry1->setLayouts[i] != entry2->setLayouts[i])
+			return false;
+	return true;
+}
+#endif
+
+/* merges the bindings and the push constant ranges of the shaders of a pipeline and returns its layout, outSetLayouts (optional)
+ * receives the set layouts (PVK_PIPELINE_LAYOUT_MAX_SETS at most) to allocate the descriptor sets from.
+ * descriptorStageFlags are added to the stages each binding is reflected from (except for the input attachments, 
+ * which are fragment only), pass the stages of all the pipelines sharing a set so that they get the same set layout.
+ * dynamicUniformSetMask: the uniform buffers of the sets with their bit set are VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+ * SPIR-V doesn't tell them apart */
+PVK_LINKAGE VkPipelineLayout pvkLayoutCacheGetReflectedPipelineLayout2(PvkLayoutCache* cache, uint32_t shaderCount, const PvkShaderReflection* const* reflections, VkShaderStageFlags descriptorStageFlags, uint32_t dynamicUniformSetMask, uint32_t* outSetLayoutCount, VkDescriptorSetLayout* outSetLayouts);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkPipelineLayout pvkLayoutCacheGetReflectedPipelineLayout2(PvkLayoutCache* cache, uint32_t shaderCount, const PvkShaderReflection* const* reflections, VkShaderStageFlags descriptorStageFlags, uint32_t dynamicUniformSetMask, uint32_t* outSetLayoutCount, VkDescriptorSetLayout* outSetLayouts)
+{
+	uint32_t setCount = 0;
+	uint32_t setBindingCounts[PVK_PIPELINE_LAYOUT_MAX_SETS] = { };
+	VkDescriptorSetLayoutBinding setBindings[PVK_PIPELINE_LAYOUT_MAX_SETS][PVK_REFLECTION_MAX_BINDINGS];
+	uint32_t pushConstantRangeCount = 0;
+	VkPushConstantRange pushConstantRanges[PVK_PIPELINE_MAX_SHADERS];
+	PVK_ASSERT(shaderCount <= PVK_PIPELINE_MAX_SHADERS);
+
+	for(uint32_t i = 0; i < shaderCount; i++)
+	{
+		const PvkShaderReflection* reflection = reflections[i];
+		for(uint32_t j = 0; j < reflection->bindingCount; j++)
+		{
+			const PvkReflectedBinding* reflected = &reflection->bindings[j];
+			if(reflected->set >= PVK_PIPELINE_LAYOUT_MAX_SETS)
+				PVK_FETAL_ERROR("Descriptor set index %u exceeds PVK_PIPELINE_LAYOUT_MAX_SETS", reflected->set);
+			VkShaderStageFlags stageFlags = reflection->stage;
+			if(reflected->type != VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT)
+				stageFlags |= descriptorStageFlags;
+			VkDescriptorType type = reflected->type;
+			if((type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) && (dynamicUniformSetMask & (1u << reflected->set)))
+				type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			uint32_t* bindingCount = &setBindingCounts[reflected->set];
+			VkDescriptorSetLayoutBinding* bindings = setBindings[reflected->set];
+			/* sorted insertion, the stages are merged if another shader already declared the binding */
+			uint32_t k = 0;
+			for(; (k < *bindingCount) && (bindings[k].binding < reflected->binding); k++);
+			if((k < *bindingCount) && (bindings[k].binding == reflected->binding))
+			{
+				if((bindings[k].descriptorType != type) || (bindings[k].descriptorCount != reflected->count))
+					PVK_FETAL_ERROR("Shaders disagree on the descriptor at set = %u, binding = %u", reflected->set, reflected->binding);
+				bindings[k].stageFlags |= stageFlags;
+				continue;
+			}
+			PVK_ASSERT(*bindingCount < PVK_REFLECTION_MAX_BINDINGS);
+			memmove(&bindings[k + 1], &bindings[k], sizeof(VkDescriptorSetLayoutBinding) * (*bindingCount - k));
+			bindings[k] = (VkDescriptorSetLayoutBinding) { };
+			bindings[k].binding = reflected->binding;
+			bindings[k].descriptorType = type;
+			bindings[k].descriptorCount = reflected->count;
+			bindings[k].stageFlags = stageFlags;
+			*bindingCount += 1;
+			if(reflected->set >= setCount)
+				setCount = reflected->set + 1;
+		}
+
+		if(reflection->pushConstantSize == 0)
+			continue;
+		/* the stages using the same range share it */
+		uint32_t k = 0;
+		for(; k < pushConstantRangeCount; k++)
+			if((pushConstantRanges[k].offset == reflection->pushConstantOffset) && (pushConstantRanges[k].size == reflection->pushConstantSize))
+				break;
+		if(k == pushConstantRangeCount)
+			pushConstantRanges[pushConstantRangeCount++] = (VkPushConstantRange) { 0, reflection->pushConstantOffset, reflection->pushConstantSize };
+		pushConstantRanges[k].stageFlags |= reflection->stage;
+	}
+
+	/* the sets not used by any shader in between get an empty layout */
+	VkDescriptorSetLayout setLayouts[PVK_PIPELINE_LAYOUT_MAX_SETS];
+	for(uint32_t i = 0; i < setCount; i++)
+		setLayouts[i] = pvkLayoutCacheGetDescriptorSetLayout(cache, setBindingCounts[i], setBindings[i]);
+	if(outSetLayoutCount != NULL)
+		*outSetLayoutCount = setCount;
+	if(outSetLayouts != NULL)
+		memcpy(outSetLayouts, setLayouts, sizeof(VkDescriptorSetLayout) * setCount);
+	return pvkLayoutCacheGetPipelineLayout(cache, setCount, setLayouts, pushConstantRangeCount, pushConstantRanges);
+}
+#endif
+
+PVK_STATIC PVK_INLINE VkPipelineLayout pvkLayoutCacheGetReflectedPipelineLayout(PvkLayoutCache* cache, uint32_t shaderCount, const PvkShaderReflection* const* reflections, VkShaderStageFlags descriptorStageFlags, uint32_t* outSetLayoutCount, VkDescriptorSetLayout* outSetLayouts)
+{
+	return pvkLayoutCacheGetReflectedPipelineLayout2(cache, shaderCount, reflections, descriptorStageFlags, 0, outSetLayoutCount, outSetLayouts);
+}
+
+/* Vulkan Buffer */
+PVK_LINKAGE VkBuffer __pvkCreateBuffer(VkDevice device, VkBufferUsageFlags usageFlags, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkBuffer __pvkCreateBuffer(VkDevice device, VkBufferUsageFlags usageFlags, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices)
+{
+	// union operation
+	uint32_t uniqueQueueFamilyCount;
+	uint32_t uniqueQueueFamilyIndices[queueFamilyCount];
+	__pvkUnionUInt32(queueFamilyCount, queueFamilyIndices, &uniqueQueueFamilyCount, uniqueQueueFamilyIndices);
+
+	VkBufferCreateInfo cInfo = { };
+	{
+		cInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		cInfo.usage = usageFlags;
+		cInfo.size = size;
+		cInfo.queueFamilyIndexCount = uniqueQueueFamilyCount;
+		cInfo.pQueueFamilyIndices = uniqueQueueFamilyIndices;
+		cInfo.sharingMode = (uniqueQueueFamilyCount > 1) ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	};
+
+	VkBuffer buffer;
+	PVK_CHECK(vkCreateBuffer(device, &cInfo, NULL, &buffer));
+	return buffer;
+}
+#endif
+
+typedef struct PvkBuffer
+{
+	VkBuffer handle;
+	VkDeviceMemory memory;
+	/* allocation.block is NULL if the buffer owns the memory */
+	PvkMemoryAllocation allocation;
+	/* persistently mapped pointer to the start of the buffer, NULL if the memory isn't HOST_VISIBLE */
+	void* mappedData;
+	/* 0 if the memory is HOST_COHERENT, otherwise writes must be flushed in multiples of this */
+	VkDeviceSize nonCoherentAtomSize;
+} PvkBuffer;
+
+
+PVK_LINKAGE PvkBuffer pvkCreateBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkBufferUsageFlags flags, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkBuffer pvkCreateBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkBufferUsageFlags flags, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices)
+{
+	VkBuffer buffer = __pvkCreateBuffer(device, flags, size, queueFamilyCount, queueFamilyIndices);
+	VkMemoryRequirements bufferMemoryRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &bufferMemoryRequirements);
+	__pvkCheckForMemoryTypesSupport(physicalDevice, bufferMemoryRequirements.memoryTypeBits);
+	uint32_t memoryTypeIndex = __pvkGetMemoryTypeIndexFromMemoryProperty(physicalDevice, mflags);
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	VkMemoryPropertyFlags propertyFlags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+
+	VkDeviceSize nonCoherentAtomSize = 0;
+	if((propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+	}
+	VkDeviceMemory memory = pvkAllocateMemory(device, __pvkAlignUp(bufferMemoryRequirements.size, nonCoherentAtomSize), memoryTypeIndex);
+	PVK_CHECK(vkBindBufferMemory(device, buffer, memory, 0));
+
+	/* host visible buffers are mapped once for their whole lifetime */
+	void* mappedData = NULL;
+	if(propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		PVK_CHECK(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mappedData));
+	return (PvkBuffer) { buffer, memory, { }, mappedData, nonCoherentAtomSize };
+}
+#endif
+
+PVK_LINKAGE PvkBuffer pvkCreateBufferWithAllocator(PvkMemoryAllocator* allocator, VkMemoryPropertyFlags mflags, VkBufferUsageFlags flags, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkBuffer pvkCreateBufferWithAllocator(PvkMemoryAllocator* allocator, VkMemoryPropertyFlags mflags, VkBufferUsageFlags flags, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices)
+{
+	VkDevice device = allocator->device;
+	VkBuffer buffer = __pvkCreateBuffer(device, flags, size, queueFamilyCount, queueFamilyIndices);
+	VkMemoryRequirements bufferMemoryRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &bufferMemoryRequirements);
+	PvkMemoryAllocation allocation = pvkMemoryAllocatorAllocate(allocator, &bufferMemoryRequirements, mflags, true);
+	PVK_CHECK(vkBindBufferMemory(device, buffer, allocation.block->memory, allocation.offset));
+	void* mappedData = (allocation.block->mappedData != NULL) ? ((char*)allocation.block->mappedData + allocation.offset) : NULL;
+	return (PvkBuffer) { buffer, allocation.block->memory, allocation, mappedData, allocation.block->nonCoherentAtomSize };
+}
+#endif
+
+PVK_LINKAGE void pvkDestroyBuffer(VkDevice device, PvkBuffer buffer);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyBuffer(VkDevice device, PvkBuffer buffer)
+{
+	vkDestroyBuffer(device, buffer.handle, NULL);
+	if(buffer.allocation.block != NULL)
+		pvkMemoryAllocatorFree(buffer.allocation.block->allocator, buffer.allocation);
+	else
+	{
+		if(buffer.mappedData != NULL)
+			vkUnmapMemory(device, buffer.memory);
+		vkFreeMemory(device, buffer.memory, NULL);
+	}
+}
+#endif
+
+/* NOTE: maps the memory at offset 0, so it must not be used with sub-allocated (PvkMemoryAllocator) memory 
+ * nor with memory which is already mapped (host visible PvkBuffers), use pvkUploadToBuffer for those */
+PVK_LINKAGE void pvkUploadToMemory(VkDevice device, VkDeviceMemory memory, void* data, size_t size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkUploadToMemory(VkDevice device, VkDeviceMemory memory, void* data, size_t size)
+{
+	void* dst;
+	PVK_CHECK(vkMapMemory(device, memory, 0, size, 0, &dst));
+	memcpy(dst, data, size);
+	vkUnmapMemory(device, memory);
+}
+#endif
+
+/* copies into the persistently mapped memory of a host visible buffer, no vkMapMemory/vkUnmapMemory involved */
+PVK_LINKAGE void pvkUploadToBuffer(VkDevice device, PvkBuffer* buffer, VkDeviceSize offset, const void* data, size_t size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkUploadToBuffer(VkDevice device, PvkBuffer* buffer, VkDeviceSize offset, const void* data, size_t size)
+{
+	PVK_ASSERT(buffer->mappedData != NULL);
+	memcpy((char*)buffer->mappedData + offset, data, size);
+	if(buffer->nonCoherentAtomSize == 0)
+		return;
+
+	/* the flushed range is relative to the VkDeviceMemory and must be aligned to nonCoherentAtomSize */
+	VkDeviceSize atomSize = buffer->nonCoherentAtomSize;
+	VkDeviceSize begin = buffer->allocation.offset + offset;
+	VkDeviceSize end = __pvkAlignUp(begin + size, atomSize);
+	begin = (begin / atomSize) * atomSize;
+	VkMappedMemoryRange range = { };
+	{
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = buffer->memory;
+		range.offset = begin;
+		range.size = end - begin;
+	};
+	PVK_CHECK(vkFlushMappedMemoryRanges(device, 1, &range));
+}
+#endif
+
+/* Staging Ring Buffer
+ * Uploads into DEVICE_LOCAL resources go through a fixed size host visible ring buffer: the data is copied into the ring
+ * and a copy command is recorded into the current batch, all the copies of a batch are submitted at once with pvkStagingRingFlush
+ * (or earlier, when the ring runs out of space). Each submitted batch is tracked with a fence and its part of the ring
+ * is reclaimed once the fence is signaled.
+ * With pvkCreateStagingRing the copies are made visible to all the later submissions on the same queue, so the ring should be
+ * created for the queue which renders with the uploaded resources.
+ * With pvkCreateStagingRing2 the copies are executed on a (dedicated transfer) queue and the ownership of the uploaded resources
+ * is released to another queue family, see below. */
+#define PVK_STAGING_RING_BATCH_COUNT 4
+/* maximum number of resources whose ownership can be transferred by a single batch, the batch is flushed when it is reached */
+#define PVK_STAGING_RING_MAX_OWNERSHIP_TRANSFERS 32
+
+typedef uint64_t PvkUploadTicket;
+
+typedef struct PvkStagingBatch
+{
+	VkCommandBuffer commandBuffer;
+	VkFence fence;
+	/* number of ring bytes consumed by this batch, including the alignment padding and the wasted end of the ring on wrap around */
+	VkDeviceSize byteCount;
+	uint32_t copyCount;
+	/* true while the copies are in flight */
+	bool isPending;
+	PvkUploadTicket ticket;
+
+	/* queue family ownership transfers (pvkCreateStagingRing2 only), the release barriers are recorded right after the copies, 
+	 * the matching acquire barriers are submitted to the destination queue along with the copies, waiting on copySemaphore */
+	VkBufferMemoryBarrier bufferBarriers[PVK_STAGING_RING_MAX_OWNERSHIP_TRANSFERS];
+	VkImageMemoryBarrier imageBarriers[PVK_STAGING_RING_MAX_OWNERSHIP_TRANSFERS];
+	uint32_t bufferBarrierCount;
+	uint32_t imageBarrierCount;
+	VkCommandBuffer acquireCommandBuffer;
+	VkFence acquireFence;
+	/* signaled by the copy submission, waited on by the acquire submission */
+	VkSemaphore copySemaphore;
+	/* true while the acquire barriers are in flight */
+	bool isAcquiring;
+} PvkStagingBatch;
+
+typedef struct PvkStagingRing
+{
+	VkDevice device;
+	VkQueue queue;
+	uint32_t queueFamilyIndex;
+	VkCommandPool commandPool;
+	/* queue which uses the uploaded resources, same as queue if there is no ownership transfer */
+	VkQueue dstQueue;
+	uint32_t dstQueueFamilyIndex;
+	VkCommandPool dstCommandPool;
+	PvkBuffer buffer;
+	VkDeviceSize size;
+	VkDeviceSize imageCopyAlignment;
+	VkDeviceSize head;
+	VkDeviceSize usedBytes;
+	PvkStagingBatch batches[PVK_STAGING_RING_BATCH_COUNT];
+	/* index of the batch being recorded, it is followed by the older batches in circular order */
+	uint32_t batchIndex;
+	PvkUploadTicket submittedTicket;
+	/* all the uploads up to and including this ticket are complete and (if transferred) owned by the destination queue family */
+	PvkUploadTicket completedTicket;
+	/* stats */
+	uint64_t uploadedBytes;
+	uint32_t submitCount;
+	/* number of times an upload had to wait for the GPU to free ring space */
+	uint32_t stallCount;
+} PvkStagingRing;
+
+PVK_STATIC PVK_INLINE bool __pvkStagingRingTransfersOwnership(PvkStagingRing* ring)
+{
+	return ring->queueFamilyIndex != ring->dstQueueFamilyIndex;
+}
+
+/* queue, queueFamilyIndex: the queue which executes the copies (preferably a dedicated transfer queue, see pvkFindTransferQueueFamilyIndex)
+ * dstQueue, dstQueueFamilyIndex: the queue which uses the uploaded resources, the destination resources must be created with 
+ * VK_SHARING_MODE_EXCLUSIVE (a single queue family index) so that their ownership can be transferred */
+PVK_LINKAGE PvkStagingRing* pvkCreateStagingRing2(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, VkQueue dstQueue, uint32_t dstQueueFamilyIndex, VkDeviceSize size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkStagingRing* pvkCreateStagingRing2(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, VkQueue dstQueue, uint32_t dstQueueFamilyIndex, VkDeviceSize size)
+{
+	PvkStagingRing* ring = PVK_NEW(PvkStagingRing);
+	ring->device = device;
+	ring->queue = queue;
+	ring->queueFamilyIndex = queueFamilyIndex;
+	ring->dstQueue = dstQueue;
+	ring->dstQueueFamilyIndex = dstQueueFamilyIndex;
+	ring->size = size;
+	ring->buffer = pvkCreateBuffer(physicalDevice, device, 
+									VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+									VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size, 1, &queueFamilyIndex);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	/* bufferOffset of VkBufferImageCopy must be a multiple of 4 and of the texel block size */
+	ring->imageCopyAlignment = (properties.limits.optimalBufferCopyOffsetAlignment > 16) ? properties.limits.optimalBufferCopyOffsetAlignment : 16;
+
+	ring->commandPool = pvkCreateCommandPool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, queueFamilyIndex);
+	VkCommandBuffer* commandBuffers = __pvkAllocateCommandBuffers(device, ring->commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, PVK_STAGING_RING_BATCH_COUNT);
+	for(uint32_t i = 0; i < PVK_STAGING_RING_BATCH_COUNT; i++)
+	{
+		ring->batches[i].commandBuffer = commandBuffers[i];
+		ring->batches[i].fence = pvkCreateFence(device, 0);
+	}
+	PVK_DELETE(commandBuffers);
+
+	if(__pvkStagingRingTransfersOwnership(ring))
+	{
+		ring->dstCommandPool = pvkCreateCommandPool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, dstQueueFamilyIndex);
+		commandBuffers = __pvkAllocateCommandBuffers(device, ring->dstCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, PVK_STAGING_RING_BATCH_COUNT);
+		for(uint32_t i = 0; i < PVK_STAGING_RING_BATCH_COUNT; i++)
+		{
+			ring->batches[i].acquireCommandBuffer = commandBuffers[i];
+			ring->batches[i].acquireFence = pvkCreateFence(device, 0);
+			ring->batches[i].copySemaphore = pvkCreateSemaphore(device);
+		}
+		PVK_DELETE(commandBuffers);
+	}
+	return ring;
+}
+#endif
+
+PVK_LINKAGE PvkStagingRing* pvkCreateStagingRing(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkStagingRing* pvkCreateStagingRing(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize size)
+{
+	return pvkCreateStagingRing2(physicalDevice, device, queue, queueFamilyIndex, queue, queueFamilyIndex, size);
+}
+#endif
+
+/* records the acquire half of the ownership transfers of the batch */
+PVK_LINKAGE void __pvkStagingRingRecordAcquire(PvkStagingRing* ring, PvkStagingBatch* batch);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void __pvkStagingRingRecordAcquire(PvkStagingRing* ring, PvkStagingBatch* batch)
+{
+	/* the acquire barriers must match the release barriers except for the access masks */
+	for(uint32_t i = 0; i < batch->bufferBarrierCount; i++)
+	{
+		batch->bufferBarriers[i].srcAccessMask = 0;
+		batch->bufferBarriers[i].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	}
+	for(uint32_t i = 0; i < batch->imageBarrierCount; i++)
+	{
+		batch->imageBarriers[i].srcAccessMask = 0;
+		batch->imageBarriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+	/* chained to the semaphore wait of the acquire submission, which covers all the commands */
+	pvkBeginCommandBuffer(batch->acquireCommandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	vkCmdPipelineBarrier(batch->acquireCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+							VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+							0, 0, NULL, batch->bufferBarrierCount, batch->bufferBarriers, batch->imageBarrierCount, batch->imageBarriers);
+	pvkEndCommandBuffer(batch->acquireCommandBuffer);
+	batch->bufferBarrierCount = 0;
+	batch->imageBarrierCount = 0;
+}
+#endif
+
+PVK_LINKAGE void __pvkStagingRingReclaim(PvkStagingRing* ring, bool waitForOldest);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void __pvkStagingRingReclaim(PvkStagingRing* ring, bool waitForOldest)
+{
+	/* batches are submitted to a single queue, so they complete in submission order (oldest first) */
+	for(uint32_t i = 0; i < PVK_STAGING_RING_BATCH_COUNT; i++)
+	{
+		PvkStagingBatch* batch = &ring->batches[(ring->batchIndex + i) % PVK_STAGING_RING_BATCH_COUNT];
+		if(!batch->isPending)
+			continue;
+		VkResult result = vkWaitForFences(ring->device, 1, &batch->fence, VK_TRUE, waitForOldest ? UINT64_MAX : 0);
+		if(result == VK_TIMEOUT)
+			break;
+		PVK_CHECK(result);
+		ring->usedBytes -= batch->byteCount;
+		batch->byteCount = 0;
+		batch->isPending = false;
+		waitForOldest = false;
+	}
+
+	/* acquires are submitted in order to a single queue as well */
+	for(uint32_t i = 0; i < PVK_STAGING_RING_BATCH_COUNT; i++)
+	{
+		PvkStagingBatch* batch = &ring->batches[(ring->batchIndex + i) % PVK_STAGING_RING_BATCH_COUNT];
+		if(batch->isPending)
+			break;
+		if(batch->isAcquiring)
+		{
+			VkResult result = vkWaitForFences(ring->device, 1, &batch->acquireFence, VK_TRUE, 0);
+			if(result == VK_TIMEOUT)
+				break;
+			PVK_CHECK(result);
+			batch->isAcquiring = false;
+		}
+		if(batch->ticket > ring->completedTicket)
+			ring->completedTicket = batch->ticket;
+	}
 }
 #endif
 
-typedef struct PvkVertex
+/* blocks until the batch has completed, including its acquire submission */
+PVK_LINKAGE void __pvkStagingRingWaitBatch(PvkStagingRing* ring, PvkStagingBatch* batch);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void __pvkStagingRingWaitBatch(PvkStagingRing* ring, PvkStagingBatch* batch)
 {
-	// attribute at location = 0 : position of the vertex
-	PvkVec3 position;
+	/* the batches complete in order, so this also completes all the batches older than this one */
+	while(batch->isPending)
+		__pvkStagingRingReclaim(ring, true);
+	if(batch->isAcquiring)
+	{
+		PVK_CHECK(vkWaitForFences(ring->device, 1, &batch->acquireFence, VK_TRUE, UINT64_MAX));
+		__pvkStagingRingReclaim(ring, false);
+	}
+}
+#endif
 
-	// attribute at location = 1 : normal of the vertex
-	PvkVec3 normal;
+/* submits all the copies recorded so far, returns the ticket which can be used to query their completion */
+PVK_LINKAGE PvkUploadTicket pvkStagingRingFlush(PvkStagingRing* ring);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkUploadTicket pvkStagingRingFlush(PvkStagingRing* ring)
+{
+	PvkStagingBatch* batch = &ring->batches[ring->batchIndex];
+	if(batch->copyCount == 0)
+		return ring->submittedTicket;
 
-	// attribute at location = 2 : texture coordinates of the vertex
-	PvkVec2 texcoord;
+	if(!__pvkStagingRingTransfersOwnership(ring))
+	{
+		/* make the copies visible to the vertex input, index, uniform and shader reads of the later submissions */
+		VkMemoryBarrier barrier = { };
+		{
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		};
+		vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, 
+								VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+								0, 1, &barrier, 0, NULL, 0, NULL);
+	}
+	pvkEndCommandBuffer(batch->commandBuffer);
 
-	// attribute at location = 3 : color of the vertex
-	PvkVec4 color;
+	/* the acquire is submitted right away and ordered after the copies on the GPU, 
+	 * so the destination queue owns the resources as soon as possible without the host having to poll for the copies */
+	bool isAcquiring = (batch->bufferBarrierCount + batch->imageBarrierCount) > 0;
+	PVK_CHECK(vkResetFences(ring->device, 1, &batch->fence));
+	VkSubmitInfo sInfo = { };
+	{
+		sInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		sInfo.commandBufferCount = 1;
+		sInfo.pCommandBuffers = &batch->commandBuffer;
+		sInfo.signalSemaphoreCount = isAcquiring ? 1 : 0;
+		sInfo.pSignalSemaphores = &batch->copySemaphore;
+	};
+	PVK_CHECK(vkQueueSubmit(ring->queue, 1, &sInfo, batch->fence));
+	if(isAcquiring)
+	{
+		__pvkStagingRingRecordAcquire(ring, batch);
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		PVK_CHECK(vkResetFences(ring->device, 1, &batch->acquireFence));
+		VkSubmitInfo acquireInfo = { };
+		{
+			acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			acquireInfo.waitSemaphoreCount = 1;
+			acquireInfo.pWaitSemaphores = &batch->copySemaphore;
+			acquireInfo.pWaitDstStageMask = &waitStage;
+			acquireInfo.commandBufferCount = 1;
+			acquireInfo.pCommandBuffers = &batch->acquireCommandBuffer;
+		};
+		PVK_CHECK(vkQueueSubmit(ring->dstQueue, 1, &acquireInfo, batch->acquireFence));
+		batch->isAcquiring = true;
+	}
+	batch->isPending = true;
+	batch->copyCount = 0;
+	batch->ticket = ++ring->submittedTicket;
+	ring->submitCount++;
+
+	ring->batchIndex = (ring->batchIndex + 1) % PVK_STAGING_RING_BATCH_COUNT;
+	/* all the batches are in flight, wait for the oldest one (which is the next to record into) */
+	PvkStagingBatch* next = &ring->batches[ring->batchIndex];
+	if(next->isPending || next->isAcquiring)
+		__pvkStagingRingWaitBatch(ring, next);
+	return batch->ticket;
+}
+#endif
 
-} PvkVertex;
+/* returns true if all the uploads submitted with the ticket have completed, never blocks */
+PVK_LINKAGE bool pvkStagingRingIsComplete(PvkStagingRing* ring, PvkUploadTicket ticket);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkStagingRingIsComplete(PvkStagingRing* ring, PvkUploadTicket ticket)
+{
+	if(ticket <= ring->completedTicket)
+		return true;
+	__pvkStagingRingReclaim(ring, false);
+	return ticket <= ring->completedTicket;
+}
+#endif
 
-#define PVK_VERTEX_SIZE sizeof(PvkVertex)
-#define PVK_VERTEX_ATTRIBUTE_COUNT 4
-#define PVK_VERTEX_POSITION_OFFSET offsetof(PvkVertex, position)
-#define PVK_VERTEX_NORMAL_OFFSET offsetof(PvkVertex, normal)
-#define PVK_VERTEX_TEXCOORD_OFFSET offsetof(PvkVertex, texcoord)
-#define PVK_VERTEX_COLOR_OFFSET offsetof(PvkVertex, color)
+/* blocks until all the uploads submitted with the ticket have completed */
+PVK_LINKAGE void pvkStagingRingWait(PvkStagingRing* ring, PvkUploadTicket ticket);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkStagingRingWait(PvkStagingRing* ring, PvkUploadTicket ticket)
+{
+	PVK_ASSERT(ticket <= ring->submittedTicket);
+	while(!pvkStagingRingIsComplete(ring, ticket))
+	{
+		/* wait for the oldest batch which hasn't completed yet */
+		for(uint32_t i = 0; i < PVK_STAGING_RING_BATCH_COUNT; i++)
+		{
+			PvkStagingBatch* batch = &ring->batches[(ring->batchIndex + i) % PVK_STAGING_RING_BATCH_COUNT];
+			if(batch->isPending || batch->isAcquiring)
+			{
+				__pvkStagingRingWaitBatch(ring, batch);
+				break;
+			}
+		}
+	}
+}
+#endif
 
-PVK_STATIC PVK_INLINE PVK_CONSTEXPR VkVertexInputAttributeDescription __pvkGetVertexInputAttributeDescription(uint32_t binding, uint32_t location, VkFormat format, uint32_t offset)
+PVK_LINKAGE VkDeviceSize __pvkStagingRingAllocate(PvkStagingRing* ring, VkDeviceSize size, VkDeviceSize alignment);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkDeviceSize __pvkStagingRingAllocate(PvkStagingRing* ring, VkDeviceSize size, VkDeviceSize alignment)
 {
-	VkVertexInputAttributeDescription dsc = { };
+	PVK_ASSERT(size <= ring->size);
+	__pvkStagingRingReclaim(ring, false);
+	while(true)
 	{
-		dsc.location = location;
-		dsc.binding = binding;
-		dsc.format = format;
-		dsc.offset = offset;
-	};
-	return dsc;
+		if(ring->usedBytes == 0)
+			ring->head = 0;
+		VkDeviceSize offset = __pvkAlignUp(ring->head, alignment);
+		/* doesn't fit before the end of the ring, wrap around and waste the remaining bytes */
+		if((offset + size) > ring->size)
+			offset = 0;
+		VkDeviceSize requiredBytes = (offset >= ring->head) ? ((offset + size) - ring->head) : ((ring->size - ring->head) + size);
+		if((ring->usedBytes + requiredBytes) <= ring->size)
+		{
+			ring->head = offset + size;
+			ring->usedBytes += requiredBytes;
+			ring->batches[ring->batchIndex].byteCount += requiredBytes;
+			return offset;
+		}
+
+		/* out of space, submit whatever has been recorded so far and wait for the oldest batch */
+		ring->stallCount++;
+		pvkStagingRingFlush(ring);
+		__pvkStagingRingReclaim(ring, true);
+	}
 }
+#endif
 
-PVK_LINKAGE VkPipeline __pvkCreateGraphicsPipeline(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t vertInputBindCount, VkVertexInputBindingDescription* vertexBindingDescriptions, uint32_t vertInputAttrCount, VkVertexInputAttributeDescription* vertexAttributeDescriptions, VkPipelineColorBlendStateCreateInfo* colorBlend, bool enableDepth, uint32_t count, va_list args);
+PVK_LINKAGE VkCommandBuffer __pvkStagingRingGetCommandBuffer(PvkStagingRing* ring);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE VkPipeline __pvkCreateGraphicsPipeline(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t vertInputBindCount, VkVertexInputBindingDescription* vertexBindingDescriptions, uint32_t vertInputAttrCount, VkVertexInputAttributeDescription* vertexAttributeDescriptions, VkPipelineColorBlendStateCreateInfo* colorBlend, bool enableDepth, uint32_t count, va_list args)
+PVK_LINKAGE VkCommandBuffer __pvkStagingRingGetCommandBuffer(PvkStagingRing* ring)
 {
-	/* Shader modules */
-	PvkShader shaderModules[count];
-	for(int i = 0; i < count; i++)
-		shaderModules[i] = va_arg(args, PvkShader);
-	VkPipelineShaderStageCreateInfo* stageCInfos = __pvkCreatePipelineShaderStageCreateInfos(count, shaderModules);
+	PvkStagingBatch* batch = &ring->batches[ring->batchIndex];
+	if(batch->copyCount == 0)
+		pvkBeginCommandBuffer(batch->commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	batch->copyCount++;
+	return batch->commandBuffer;
+}
+#endif
 
-	/* Vertex buffer layouts and their description */
-	VkPipelineVertexInputStateCreateInfo vertexInputStateCInfo = { };
+/* records the release half of an ownership transfer and keeps the barrier around for the acquire half */
+PVK_LINKAGE void __pvkStagingRingReleaseBuffer(PvkStagingRing* ring, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void __pvkStagingRingReleaseBuffer(PvkStagingRing* ring, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
+{
+	PvkStagingBatch* batch = &ring->batches[ring->batchIndex];
+	VkBufferMemoryBarrier* barrier = &batch->bufferBarriers[batch->bufferBarrierCount++];
+	*barrier = (VkBufferMemoryBarrier) { };
 	{
-		vertexInputStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputStateCInfo.vertexBindingDescriptionCount = vertInputBindCount;
-		vertexInputStateCInfo.pVertexBindingDescriptions = vertexBindingDescriptions;
-		vertexInputStateCInfo.vertexAttributeDescriptionCount = vertInputAttrCount;
-		vertexInputStateCInfo.pVertexAttributeDescriptions = vertexAttributeDescriptions;
+		barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier->srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier->dstAccessMask = 0;
+		barrier->srcQueueFamilyIndex = ring->queueFamilyIndex;
+		barrier->dstQueueFamilyIndex = ring->dstQueueFamilyIndex;
+		barrier->buffer = buffer;
+		barrier->offset = offset;
+		barrier->size = size;
 	};
+	vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 1, barrier, 0, NULL);
+	if(batch->bufferBarrierCount == PVK_STAGING_RING_MAX_OWNERSHIP_TRANSFERS)
+		pvkStagingRingFlush(ring);
+}
+#endif
 
-	/* Primitive assembly */
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCInfo = { };
+PVK_LINKAGE void pvkStagingRingUploadToBuffer(PvkStagingRing* ring, VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkStagingRingUploadToBuffer(PvkStagingRing* ring, VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+	/* uploads larger than half of the ring are split, so a single upload never has to wait for the whole ring to drain */
+	VkDeviceSize maxChunkSize = ring->size / 2;
+	while(size > 0)
 	{
-		inputAssemblyStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssemblyStateCInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		inputAssemblyStateCInfo.primitiveRestartEnable = VK_FALSE;
-	};
+		VkDeviceSize chunkSize = (size < maxChunkSize) ? size : maxChunkSize;
+		VkDeviceSize offset = __pvkStagingRingAllocate(ring, chunkSize, 4);
+		pvkUploadToBuffer(ring->device, &ring->buffer, offset, data, chunkSize);
+		VkBufferCopy region = { offset, dstOffset, chunkSize };
+		vkCmdCopyBuffer(__pvkStagingRingGetCommandBuffer(ring), ring->buffer.handle, dstBuffer, 1, &region);
+		if(__pvkStagingRingTransfersOwnership(ring))
+			__pvkStagingRingReleaseBuffer(ring, dstBuffer, dstOffset, chunkSize);
+		ring->uploadedBytes += chunkSize;
+		data = (const char*)data + chunkSize;
+		dstOffset += chunkSize;
+		size -= chunkSize;
+	}
+}
+#endif
 
-	/* Viewport configuration */
-	VkViewport viewport = { };
+/* uploads tightly packed texels into the first mip level of a 2D image, the image is left in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL */
+PVK_LINKAGE void pvkStagingRingUploadToImage(PvkStagingRing* ring, VkImage image, VkImageAspectFlags aspectMask, uint32_t width, uint32_t height, const void* data, VkDeviceSize size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkStagingRingUploadToImage(PvkStagingRing* ring, VkImage image, VkImageAspectFlags aspectMask, uint32_t width, uint32_t height, const void* data, VkDeviceSize size)
+{
+	VkDeviceSize offset = __pvkStagingRingAllocate(ring, size, ring->imageCopyAlignment);
+	pvkUploadToBuffer(ring->device, &ring->buffer, offset, data, size);
+	VkCommandBuffer commandBuffer = __pvkStagingRingGetCommandBuffer(ring);
+
+	VkImageMemoryBarrier barrier = { };
 	{
-		viewport.x = 0;
-		viewport.y = 0;
-		viewport.width = width;
-		viewport.height = height;
-		viewport.minDepth = 0;
-		viewport.maxDepth = 1.0f;
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = (VkImageSubresourceRange) { aspectMask, 0, 1, 0, 1 };
 	};
-	VkRect2D scissor = { };
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+	VkBufferImageCopy region = { };
 	{
-		scissor.offset = (VkOffset2D) { 0, 0 };
-		scissor.extent = (VkExtent2D) { width, height };
+		region.bufferOffset = offset;
+		region.imageSubresource = (VkImageSubresourceLayers) { aspectMask, 0, 0, 1 };
+		region.imageExtent = (VkExtent3D) { width, height, 1 };
 	};
+	vkCmdCopyBufferToImage(commandBuffer, ring->buffer.handle, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
-	VkPipelineViewportStateCreateInfo viewportStateCInfo = { };
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	if(__pvkStagingRingTransfersOwnership(ring))
 	{
-		viewportStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportStateCInfo.viewportCount = 1;
-		viewportStateCInfo.pViewports = &viewport;
-		viewportStateCInfo.scissorCount = 1;
-		viewportStateCInfo.pScissors = &scissor;
-	};
+		/* release, the layout transition happens as part of the ownership transfer */
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = ring->queueFamilyIndex;
+		barrier.dstQueueFamilyIndex = ring->dstQueueFamilyIndex;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+		PvkStagingBatch* batch = &ring->batches[ring->batchIndex];
+		batch->imageBarriers[batch->imageBarrierCount++] = barrier;
+		ring->uploadedBytes += size;
+		if(batch->imageBarrierCount == PVK_STAGING_RING_MAX_OWNERSHIP_TRANSFERS)
+			pvkStagingRingFlush(ring);
+		return;
+	}
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+	ring->uploadedBytes += size;
+}
+#endif
 
-	/* Rasterization configuration */
-	VkPipelineRasterizationStateCreateInfo rasterizationStateCInfo = { };
+/* submits the pending copies and blocks until all of them have been executed */
+PVK_LINKAGE void pvkStagingRingWaitIdle(PvkStagingRing* ring);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkStagingRingWaitIdle(PvkStagingRing* ring)
+{
+	pvkStagingRingWait(ring, pvkStagingRingFlush(ring));
+}
+#endif
+
+PVK_LINKAGE void pvkDestroyStagingRing(PvkStagingRing* ring);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyStagingRing(PvkStagingRing* ring)
+{
+	pvkStagingRingWaitIdle(ring);
+	for(uint32_t i = 0; i < PVK_STAGING_RING_BATCH_COUNT; i++)
 	{
-		rasterizationStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizationStateCInfo.depthClampEnable = VK_FALSE;
-		rasterizationStateCInfo.rasterizerDiscardEnable = VK_FALSE;
-		rasterizationStateCInfo.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizationStateCInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizationStateCInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterizationStateCInfo.lineWidth = 1.0f;
-	};
+		vkDestroyFence(ring->device, ring->batches[i].fence, NULL);
+		if(__pvkStagingRingTransfersOwnership(ring))
+		{
+			vkDestroyFence(ring->device, ring->batches[i].acquireFence, NULL);
+			vkDestroySemaphore(ring->device, ring->batches[i].copySemaphore, NULL);
+		}
+	}
+	vkDestroyCommandPool(ring->device, ring->commandPool, NULL);
+	if(__pvkStagingRingTransfersOwnership(ring))
+		vkDestroyCommandPool(ring->device, ring->dstCommandPool, NULL);
+	pvkDestroyBuffer(ring->device, ring->buffer);
+	PVK_DELETE(ring);
+}
+#endif
 
-	/* Multisampling */
-	VkPipelineMultisampleStateCreateInfo multisamplingStateCInfo = { };
+/* Timeline Semaphores (VK_KHR_timeline_semaphore)
+ * A PvkTimeline is a single monotonically increasing counter for a queue: every submission through pvkTimelineSubmit signals
+ * the next value, the host waits on values instead of fences and other queues depend on (timeline, value) pairs. 
+ * The device must have been created with pvkCreateLogicalDeviceWithExtensions2(..., timelineSemaphore = true, ...). 
+ * Swapchain acquire/present still need binary semaphores, pvkTimelineSubmit accepts one of each. */
+typedef struct PvkTimeline
+{
+	VkDevice device;
+	VkQueue queue;
+	VkSemaphore semaphore;
+	/* value signaled by the latest submission */
+	uint64_t pendingValue;
+	/* latest value known to be reached, only refreshed when a query or a wait needs it */
+	uint64_t completedValue;
+	/* the instance is created for Vulkan 1.0, so the extension entry points are loaded at runtime */
+	PFN_vkWaitSemaphores waitSemaphores;
+	PFN_vkGetSemaphoreCounterValue getSemaphoreCounterValue;
+	/* stats */
+	uint64_t waitCount;
+	uint64_t blockCount;
+	uint64_t blockedTimeNs;
+} PvkTimeline;
+
+/* makes a submission wait until timeline reaches value, in the pipeline stages of stageMask */
+typedef struct PvkTimelineWait
+{
+	PvkTimeline* timeline;
+	uint64_t value;
+	VkPipelineStageFlags stageMask;
+} PvkTimelineWait;
+
+PVK_LINKAGE PvkTimeline* pvkCreateTimeline(VkDevice device, VkQueue queue);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkTimeline* pvkCreateTimeline(VkDevice device, VkQueue queue)
+{
+	PvkTimeline* timeline = PVK_NEW(PvkTimeline);
+	timeline->device = device;
+	timeline->queue = queue;
+	timeline->waitSemaphores = (PFN_vkWaitSemaphores)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+	timeline->getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValue)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+	if((timeline->waitSemaphores == NULL) || (timeline->getSemaphoreCounterValue == NULL))
+		PVK_FETAL_ERROR("Unable to load the VK_KHR_timeline_semaphore functions, is the extension enabled?");
+
+	VkSemaphoreTypeCreateInfo typeInfo = { };
 	{
-		multisamplingStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisamplingStateCInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		multisamplingStateCInfo.sampleShadingEnable = VK_FALSE;
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
 	};
+	VkSemaphoreCreateInfo cInfo = { };
+	{ cInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO; cInfo.pNext = &typeInfo; };
+	PVK_CHECK(vkCreateSemaphore(device, &cInfo, NULL, &timeline->semaphore));
+	return timeline;
+}
+#endif
 
-	/* Depth stencil configuration */
-	VkPipelineDepthStencilStateCreateInfo dephtStencilStateCInfo = { };
+/* returns true if the timeline has reached value, never blocks */
+PVK_LINKAGE bool pvkTimelineIsComplete(PvkTimeline* timeline, uint64_t value);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkTimelineIsComplete(PvkTimeline* timeline, uint64_t value)
+{
+	if(value <= timeline->completedValue)
+		return true;
+	PVK_CHECK(timeline->getSemaphoreCounterValue(timeline->device, timeline->semaphore, &timeline->completedValue));
+	return value <= timeline->completedValue;
+}
+#endif
+
+/* blocks (for at most timeout nano seconds) until the timeline reaches value, returns false if the timeout expired */
+PVK_LINKAGE bool pvkTimelineWait(PvkTimeline* timeline, uint64_t value, uint64_t timeout);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool pvkTimelineWait(PvkTimeline* timeline, uint64_t value, uint64_t timeout)
+{
+	PVK_ASSERT(value <= timeline->pendingValue);
+	timeline->waitCount++;
+	if(pvkTimelineIsComplete(timeline, value))
+		return true;
+
+	VkSemaphoreWaitInfo waitInfo = { };
 	{
-		dephtStencilStateCInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		dephtStencilStateCInfo.depthTestEnable = enableDepth ? VK_TRUE : VK_FALSE;
-		dephtStencilStateCInfo.depthWriteEnable = enableDepth ? VK_TRUE : VK_FALSE;
-		dephtStencilStateCInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		dephtStencilStateCInfo.stencilTestEnable = VK_FALSE;
-		dephtStencilStateCInfo.depthBoundsTestEnable = VK_FALSE;
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &timeline->semaphore;
+		waitInfo.pValues = &value;
 	};
+	timeline->blockCount++;
+	uint64_t start = pvkGetTimeNs();
+	VkResult result = timeline->waitSemaphores(timeline->device, &waitInfo, timeout);
+	timeline->blockedTimeNs += pvkGetTimeNs() - start;
+	if(result == VK_TIMEOUT)
+		return false;
+	PVK_CHECK(result);
+	if(value > timeline->completedValue)
+		timeline->completedValue = value;
+	return true;
+}
+#endif
 
-	VkGraphicsPipelineCreateInfo pipelineCInfo = { };
+/* submits the command buffers to the timeline's queue and returns the value signaled once they have completed
+ * waits: timeline values (of this or other queues' timelines) to wait for before the given stages
+ * binaryWait, binarySignal: optional (VK_NULL_HANDLE) binary semaphores, i.e. for vkAcquireNextImageKHR and vkQueuePresentKHR */
+PVK_LINKAGE uint64_t pvkTimelineSubmit(PvkTimeline* timeline, uint32_t commandBufferCount, VkCommandBuffer* commandBuffers, 
+										uint32_t waitCount, const PvkTimelineWait* waits, 
+										VkSemaphore binaryWait, VkPipelineStageFlags binaryWaitStage, VkSemaphore binarySignal);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE uint64_t pvkTimelineSubmit(PvkTimeline* timeline, uint32_t commandBufferCount, VkCommandBuffer* commandBuffers, 
+										uint32_t waitCount, const PvkTimelineWait* waits, 
+										VkSemaphore binaryWait, VkPipelineStageFlags binaryWaitStage, VkSemaphore binarySignal)
+{
+	/* the values of the binary semaphores are ignored, but the value arrays must still have an entry for them */
+	VkSemaphore waitSemaphores[waitCount + 1];
+	uint64_t waitValues[waitCount + 1];
+	VkPipelineStageFlags waitStages[waitCount + 1];
+	uint32_t waitSemaphoreCount = 0;
+	for(uint32_t i = 0; i < waitCount; i++, waitSemaphoreCount++)
 	{
-		pipelineCInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineCInfo.stageCount = count;
-		pipelineCInfo.pStages = stageCInfos;
-		pipelineCInfo.pVertexInputState = &vertexInputStateCInfo;
-		pipelineCInfo.pInputAssemblyState = &inputAssemblyStateCInfo;
-		pipelineCInfo.pViewportState = &viewportStateCInfo;
-		pipelineCInfo.pMultisampleState = &multisamplingStateCInfo;
-		pipelineCInfo.pRasterizationState = &rasterizationStateCInfo;
-		pipelineCInfo.pDepthStencilState = &dephtStencilStateCInfo;
-		pipelineCInfo.pColorBlendState = colorBlend;
-		pipelineCInfo.layout = layout;
-		pipelineCInfo.renderPass = renderPass;
-		pipelineCInfo.subpass = subpassIndex;
+		waitSemaphores[waitSemaphoreCount] = waits[i].timeline->semaphore;
+		waitValues[waitSemaphoreCount] = waits[i].value;
+		waitStages[waitSemaphoreCount] = waits[i].stageMask;
+	}
+	if(binaryWait != VK_NULL_HANDLE)
+	{
+		waitSemaphores[waitSemaphoreCount] = binaryWait;
+		waitValues[waitSemaphoreCount] = 0;
+		waitStages[waitSemaphoreCount] = binaryWaitStage;
+		waitSemaphoreCount++;
+	}
+
+	uint64_t signalValue = timeline->pendingValue + 1;
+	VkSemaphore signalSemaphores[2] = { timeline->semaphore, binarySignal };
+	uint64_t signalValues[2] = { signalValue, 0 };
+	uint32_t signalSemaphoreCount = (binarySignal != VK_NULL_HANDLE) ? 2 : 1;
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = { };
+	{
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = waitSemaphoreCount;
+		timelineInfo.pWaitSemaphoreValues = waitValues;
+		timelineInfo.signalSemaphoreValueCount = signalSemaphoreCount;
+		timelineInfo.pSignalSemaphoreValues = signalValues;
+	};
+	VkSubmitInfo info = { };
+	{
+		info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		info.pNext = &timelineInfo;
+		info.waitSemaphoreCount = waitSemaphoreCount;
+		info.pWaitSemaphores = waitSemaphores;
+		info.pWaitDstStageMask = waitStages;
+		info.commandBufferCount = commandBufferCount;
+		info.pCommandBuffers = commandBuffers;
+		info.signalSemaphoreCount = signalSemaphoreCount;
+		info.pSignalSemaphores = signalSemaphores;
 	};
+	PVK_CHECK(vkQueueSubmit(timeline->queue, 1, &info, VK_NULL_HANDLE));
+	timeline->pendingValue = signalValue;
+	return signalValue;
+}
+#endif
 
-	VkPipeline pipeline;
-	PVK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCInfo, NULL, &pipeline));
+PVK_LINKAGE void pvkTimelineLogStats(PvkTimeline* timeline);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkTimelineLogStats(PvkTimeline* timeline)
+{
+	PVK_INFO("Timeline: value = %llu, waits = %llu, blocked = %llu, blocked time = %.3f ms",
+				(unsigned long long)timeline->pendingValue, (unsigned long long)timeline->waitCount, 
+				(unsigned long long)timeline->blockCount, timeline->blockedTimeNs / 1000000.0);
+}
+#endif
 
-	PVK_DELETE(stageCInfos);
-	return pipeline;
+PVK_LINKAGE void pvkDestroyTimeline(PvkTimeline* timeline);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyTimeline(PvkTimeline* timeline)
+{
+	pvkTimelineWait(timeline, timeline->pendingValue, UINT64_MAX);
+	vkDestroySemaphore(timeline->device, timeline->semaphore, NULL);
+	PVK_DELETE(timeline);
+}
+#endif
+
+/* Submission batching
+ * Collects the command buffers, waits and signals of several producers during a frame and flushes them with a single vkQueueSubmit.
+ * The additions are grouped into VkSubmitInfos in order: a wait added after command buffers (or a command buffer added after 
+ * signals) starts a new VkSubmitInfo, so each wait only delays the command buffers added after it. */
+#define PVK_SUBMIT_BATCH_MAX_SUBMITS 16
+#define PVK_SUBMIT_BATCH_MAX_COMMAND_BUFFERS 64
+#define PVK_SUBMIT_BATCH_MAX_SEMAPHORES 32
+
+typedef struct PvkSubmitRange
+{
+	uint32_t waitOffset;
+	uint32_t waitCount;
+	uint32_t commandBufferOffset;
+	uint32_t commandBufferCount;
+	uint32_t signalOffset;
+	uint32_t signalCount;
+} PvkSubmitRange;
+
+typedef struct PvkSubmitBatch
+{
+	VkQueue queue;
+	PvkSubmitRange submits[PVK_SUBMIT_BATCH_MAX_SUBMITS];
+	uint32_t submitCount;
+	VkCommandBuffer commandBuffers[PVK_SUBMIT_BATCH_MAX_COMMAND_BUFFERS];
+	uint32_t commandBufferCount;
+	VkSemaphore waitSemaphores[PVK_SUBMIT_BATCH_MAX_SEMAPHORES];
+	uint64_t waitValues[PVK_SUBMIT_BATCH_MAX_SEMAPHORES];
+	VkPipelineStageFlags waitStages[PVK_SUBMIT_BATCH_MAX_SEMAPHORES];
+	uint32_t waitCount;
+	VkSemaphore signalSemaphores[PVK_SUBMIT_BATCH_MAX_SEMAPHORES];
+	uint64_t signalValues[PVK_SUBMIT_BATCH_MAX_SEMAPHORES];
+	uint32_t signalCount;
+	/* true if any timeline semaphore has been added, VkTimelineSemaphoreSubmitInfo is chained only then */
+	bool hasTimelineSemaphores;
+	/* stats */
+	uint64_t flushCount;
+	uint64_t submitInfoCount;
+	uint64_t submittedCommandBufferCount;
+} PvkSubmitBatch;
+
+PVK_LINKAGE PvkSubmitBatch* pvkCreateSubmitBatch(VkQueue queue);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkSubmitBatch* pvkCreateSubmitBatch(VkQueue queue)
+{
+	PvkSubmitBatch* batch = PVK_NEW(PvkSubmitBatch);
+	batch->queue = queue;
+	return batch;
+}
+#endif
+
+PVK_LINKAGE void pvkDestroySubmitBatch(PvkSubmitBatch* batch);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroySubmitBatch(PvkSubmitBatch* batch)
+{
+	PVK_ASSERT(batch->submitCount == 0);
+	PVK_DELETE(batch);
+}
+#endif
+
+/* returns the VkSubmitInfo being filled, starts a new one if 'stage' can't be appended to the current one 
+ * stage: 0 = wait, 1 = command buffer, 2 = signal */
+PVK_LINKAGE PvkSubmitRange* __pvkSubmitBatchGetRange(PvkSubmitBatch* batch, uint32_t stage);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkSubmitRange* __pvkSubmitBatchGetRange(PvkSubmitBatch* batch, uint32_t stage)
+{
+	if(batch->submitCount > 0)
+	{
+		PvkSubmitRange* range = &batch->submits[batch->submitCount - 1];
+		bool isClosed = ((stage == 0) && ((range->commandBufferCount + range->signalCount) > 0))
+						|| ((stage == 1) && (range->signalCount > 0));
+		if(!isClosed)
+			return range;
+	}
+	if(batch->submitCount == PVK_SUBMIT_BATCH_MAX_SUBMITS)
+		PVK_FETAL_ERROR("Submit batch is full, max submits = %u", PVK_SUBMIT_BATCH_MAX_SUBMITS);
+	PvkSubmitRange* range = &batch->submits[batch->submitCount++];
+	*range = (PvkSubmitRange) { batch->waitCount, 0, batch->commandBufferCount, 0, batch->signalCount, 0 };
+	return range;
+}
+#endif
+
+/* value is ignored for binary semaphores */
+PVK_LINKAGE void pvkSubmitBatchAddWait(PvkSubmitBatch* batch, VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stageMask);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkSubmitBatchAddWait(PvkSubmitBatch* batch, VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stageMask)
+{
+	if(batch->waitCount == PVK_SUBMIT_BATCH_MAX_SEMAPHORES)
+		PVK_FETAL_ERROR("Submit batch is full, max wait semaphores = %u", PVK_SUBMIT_BATCH_MAX_SEMAPHORES);
+	__pvkSubmitBatchGetRange(batch, 0)->waitCount++;
+	batch->waitSemaphores[batch->waitCount] = semaphore;
+	batch->waitValues[batch->waitCount] = value;
+	batch->waitStages[batch->waitCount] = stageMask;
+	batch->waitCount++;
+}
+#endif
+
+PVK_LINKAGE void pvkSubmitBatchAddCommandBuffer(PvkSubmitBatch* batch, VkCommandBuffer commandBuffer);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkSubmitBatchAddCommandBuffer(PvkSubmitBatch* batch, VkCommandBuffer commandBuffer)
+{
+	if(batch->commandBufferCount == PVK_SUBMIT_BATCH_MAX_COMMAND_BUFFERS)
+		PVK_FETAL_ERROR("Submit batch is full, max command buffers = %u", PVK_SUBMIT_BATCH_MAX_COMMAND_BUFFERS);
+	__pvkSubmitBatchGetRange(batch, 1)->commandBufferCount++;
+	batch->commandBuffers[batch->commandBufferCount++] = commandBuffer;
+}
+#endif
+
+/* value is ignored for binary semaphores */
+PVK_LINKAGE void pvkSubmitBatchAddSignal(PvkSubmitBatch* batch, VkSemaphore semaphore, uint64_t value);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkSubmitBatchAddSignal(PvkSubmitBatch* batch, VkSemaphore semaphore, uint64_t value)
+{
+	if(batch->signalCount == PVK_SUBMIT_BATCH_MAX_SEMAPHORES)
+		PVK_FETAL_ERROR("Submit batch is full, max signal semaphores = %u", PVK_SUBMIT_BATCH_MAX_SEMAPHORES);
+	__pvkSubmitBatchGetRange(batch, 2)->signalCount++;
+	batch->signalSemaphores[batch->signalCount] = semaphore;
+	batch->signalValues[batch->signalCount] = value;
+	batch->signalCount++;
+}
+#endif
+
+PVK_LINKAGE void pvkSubmitBatchAddTimelineWait(PvkSubmitBatch* batch, PvkTimeline* timeline, uint64_t value, VkPipelineStageFlags stageMask);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkSubmitBatchAddTimelineWait(PvkSubmitBatch* batch, PvkTimeline* timeline, uint64_t value, VkPipelineStageFlags stageMask)
+{
+	batch->hasTimelineSemaphores = true;
+	pvkSubmitBatchAddWait(batch, timeline->semaphore, value, stageMask);
+}
+#endif
+
+/* signals the next value of the timeline once the command buffers added so far have completed, returns that value,
+ * the timeline must belong to the batch's queue */
+PVK_LINKAGE uint64_t pvkSubmitBatchAddTimelineSignal(PvkSubmitBatch* batch, PvkTimeline* timeline);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE uint64_t pvkSubmitBatchAddTimelineSignal(PvkSubmitBatch* batch, PvkTimeline* timeline)
+{
+	PVK_ASSERT(timeline->queue == batch->queue);
+	batch->hasTimelineSemaphores = true;
+	uint64_t value = ++timeline->pendingValue;
+	pvkSubmitBatchAddSignal(batch, timeline->semaphore, value);
+	return value;
+}
+#endif
+
+/* submits everything added since the last flush with a single vkQueueSubmit, fence (optional) is signaled once all of it has completed */
+PVK_LINKAGE void pvkSubmitBatchFlush(PvkSubmitBatch* batch, VkFence fence);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkSubmitBatchFlush(PvkSubmitBatch* batch, VkFence fence)
+{
+	if((batch->submitCount == 0) && (fence == VK_NULL_HANDLE))
+		return;
+
+	VkSubmitInfo infos[PVK_SUBMIT_BATCH_MAX_SUBMITS];
+	VkTimelineSemaphoreSubmitInfo timelineInfos[PVK_SUBMIT_BATCH_MAX_SUBMITS];
+	for(uint32_t i = 0; i < batch->submitCount; i++)
+	{
+		PvkSubmitRange* range = &batch->submits[i];
+		timelineInfos[i] = (VkTimelineSemaphoreSubmitInfo) { };
+		{
+			timelineInfos[i].sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			timelineInfos[i].waitSemaphoreValueCount = range->waitCount;
+			timelineInfos[i].pWaitSemaphoreValues = &batch->waitValues[range->waitOffset];
+			timelineInfos[i].signalSemaphoreValueCount = range->signalCount;
+			timelineInfos[i].pSignalSemaphoreValues = &batch->signalValues[range->signalOffset];
+		};
+		infos[i] = (VkSubmitInfo) { };
+		{
+			infos[i].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			infos[i].pNext = batch->hasTimelineSemaphores ? &timelineInfos[i] : NULL;
+			infos[i].waitSemaphoreCount = range->waitCount;
+			infos[i].pWaitSemaphores = &batch->waitSemaphores[range->waitOffset];
+			infos[i].pWaitDstStageMask = &batch->waitStages[range->waitOffset];
+			infos[i].commandBufferCount = range->commandBufferCount;
+			infos[i].pCommandBuffers = &batch->commandBuffers[range->commandBufferOffset];
+			infos[i].signalSemaphoreCount = range->signalCount;
+			infos[i].pSignalSemaphores = &batch->signalSemaphores[range->signalOffset];
+		};
+	}
+	PVK_CHECK(vkQueueSubmit(batch->queue, batch->submitCount, infos, fence));
+
+	batch->flushCount++;
+	batch->submitInfoCount += batch->submitCount;
+	batch->submittedCommandBufferCount += batch->commandBufferCount;
+	batch->submitCount = 0;
+	batch->commandBufferCount = 0;
+	batch->waitCount = 0;
+	batch->signalCount = 0;
+	batch->hasTimelineSemaphores = false;
+}
+#endif
+
+/* Uniform arena
+ * Linear allocator in a host visible uniform buffer, the buffer is written to a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+ * descriptor once (see pvkDescriptorWriterWriteUniformArena) and each draw only passes the offset of its block 
+ * to vkCmdBindDescriptorSets. The blocks are aligned to minUniformBufferOffsetAlignment and are valid until the arena is reset,
+ * which the caller must only do once the GPU is done with them (PvkFrame resets its arena in pvkFrameContextBegin). */
+typedef struct PvkUniformArena
+{
+	PvkBuffer buffer;
+	VkDeviceSize size;
+	VkDeviceSize alignment;
+	VkDeviceSize offset;
+	/* stats */
+	uint32_t allocationCount;
+	VkDeviceSize highWaterMark;
+} PvkUniformArena;
+
+PVK_LINKAGE PvkUniformArena* pvkCreateUniformArena(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkUniformArena* pvkCreateUniformArena(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices)
+{
+	/* the dynamic offsets are uint32_t */
+	PVK_ASSERT(size <= UINT32_MAX);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	PvkUniformArena* arena = PVK_NEW(PvkUniformArena);
+	arena->buffer = pvkCreateBuffer(physicalDevice, device, 
+									VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+									VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, size, queueFamilyCount, queueFamilyIndices);
+	arena->size = size;
+	arena->alignment = properties.limits.minUniformBufferOffsetAlignment;
+	return arena;
 }
 #endif
 
-PVK_LINKAGE VkPipeline pvkCreateShadowMapGraphicsPipeline(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t count, ...);
+PVK_LINKAGE void pvkDestroyUniformArena(VkDevice device, PvkUniformArena* arena);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE VkPipeline pvkCreateShadowMapGraphicsPipeline(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t width, uint32_t height, uint32_t count, ...)
+PVK_LINKAGE void pvkDestroyUniformArena(VkDevice device, PvkUniformArena* arena)
 {
-	VkVertexInputBindingDescription vertexBindingDescription = { };
-	{
-		vertexBindingDescription.binding = 0;
-		vertexBindingDescription.stride = PVK_VERTEX_SIZE;
-		vertexBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-	};
-	VkVertexInputAttributeDescription* vertexAttributeDescriptions = PVK_NEWV(VkVertexInputAttributeDescription, PVK_VERTEX_ATTRIBUTE_COUNT);
-	vertexAttributeDescriptions[0] = __pvkGetVertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, PVK_VERTEX_POSITION_OFFSET);
-	vertexAttributeDescriptions[1] = __pvkGetVertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32B32_SFLOAT, PVK_VERTEX_NORMAL_OFFSET);
-	vertexAttributeDescriptions[2] = __pvkGetVertexInputAttributeDescription(0, 2, VK_FORMAT_R32G32_SFLOAT, PVK_VERTEX_TEXCOORD_OFFSET);
-	vertexAttributeDescriptions[3] = __pvkGetVertexInputAttributeDescription(0, 3, VK_FORMAT_R32G32B32A32_SFLOAT, PVK_VERTEX_COLOR_OFFSET);
-
-	va_list shaderModuleList;
-	va_start(shaderModuleList, count);
-	VkPipeline pipeline =  __pvkCreateGraphicsPipeline(device, layout, renderPass, subpassIndex, width, height, 1, &vertexBindingDescription, 4, vertexAttributeDescriptions, NULL, true, count, shaderModuleList);
-	va_end(shaderModuleList);
+	pvkDestroyBuffer(device, arena->buffer);
+	PVK_DELETE(arena);
+}
+#endif
 
-	PVK_DELETE(vertexAttributeDescriptions);
-	return pipeline;
+/* returns the (dynamic) offset of 'size' bytes in arena->buffer, outData (if not NULL) receives the persistently mapped pointer to them */
+PVK_LINKAGE uint32_t pvkUniformArenaAllocate(PvkUniformArena* arena, VkDeviceSize size, void** outData);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE uint32_t pvkUniformArenaAllocate(PvkUniformArena* arena, VkDeviceSize size, void** outData)
+{
+	VkDeviceSize offset = __pvkAlignUp(arena->offset, arena->alignment);
+	if((offset + size) > arena->size)
+		PVK_FETAL_ERROR("Uniform arena overflow, requested = %llu bytes, capacity = %llu bytes", 
+							(unsigned long long)(offset + size), (unsigned long long)arena->size);
+	arena->offset = offset + size;
+	arena->allocationCount++;
+	if(arena->offset > arena->highWaterMark)
+		arena->highWaterMark = arena->offset;
+	if(outData != NULL)
+		*outData = (char*)arena->buffer.mappedData + offset;
+	return (uint32_t)offset;
 }
 #endif
 
-PVK_LINKAGE VkPipeline pvkCreateGraphicsPipelineProfile0(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t width, uint32_t height, uint32_t count, ...);
+/* copies data into the arena and returns its (dynamic) offset */
+PVK_LINKAGE uint32_t pvkUniformArenaUpload(PvkUniformArena* arena, const void* data, VkDeviceSize size);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE VkPipeline pvkCreateGraphicsPipelineProfile0(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t width, uint32_t height, uint32_t count, ...)
+PVK_LINKAGE uint32_t pvkUniformArenaUpload(PvkUniformArena* arena, const void* data, VkDeviceSize size)
 {
-	va_list shaderModuleList;
-	va_start(shaderModuleList, count);
+	void* mappedData;
+	uint32_t offset = pvkUniformArenaAllocate(arena, size, &mappedData);
+	memcpy(mappedData, data, size);
+	return offset;
+}
+#endif
 
-	/* Color attachment configuration */
-	VkPipelineColorBlendAttachmentState colorAttachment = { };
-	{
-		colorAttachment.blendEnable = VK_FALSE;
-		colorAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	};
+/* frees all the blocks at once, the GPU must be done with them */
+PVK_STATIC PVK_INLINE void pvkUniformArenaReset(PvkUniformArena* arena)
+{
+	arena->offset = 0;
+}
 
-	VkPipelineColorBlendStateCreateInfo colorBlend = { };
-	{
-		colorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		colorBlend.logicOpEnable = VK_FALSE;
-		colorBlend.attachmentCount = 1;
-		colorBlend.pAttachments = &colorAttachment;
-	};
+/* Descriptor allocator
+ * Hands out descriptor sets from a chain of pools: when the current pool is full (maxSets reached, or VK_ERROR_OUT_OF_POOL_MEMORY /
+ * VK_ERROR_FRAGMENTED_POOL) the next one is taken from the reset pools or created, so the allocator never runs out.
+ * The sets are never freed one by one, pvkDescriptorAllocatorReset frees all of them at once with vkResetDescriptorPool. */
+#define PVK_DESCRIPTOR_ALLOCATOR_MAX_POOL_SIZES 11
 
-	VkPipeline pipeline =  __pvkCreateGraphicsPipeline(device, layout, renderPass, 0, width, height, 0, NULL, 0, NULL, &colorBlend, true, count, shaderModuleList);
-	va_end(shaderModuleList);
-	return pipeline;
+typedef struct PvkDescriptorAllocator
+{
+	VkDevice device;
+	/* capacity of each pool */
+	uint32_t setsPerPool;
+	uint32_t poolSizeCount;
+	VkDescriptorPoolSize poolSizes[PVK_DESCRIPTOR_ALLOCATOR_MAX_POOL_SIZES];
+	/* pool the sets are allocated from, VK_NULL_HANDLE until the first allocation */
+	VkDescriptorPool currentPool;
+	uint32_t currentPoolSetCount;
+	/* filled pools, reset with the current one */
+	VkDescriptorPool* usedPools;
+	uint32_t usedPoolCount;
+	/* reset pools, ready to be reused */
+	VkDescriptorPool* freePools;
+	uint32_t freePoolCount;
+	/* capacity of both usedPools and freePools */
+	uint32_t poolCapacity;
+	/* stats */
+	uint32_t createdPoolCount;
+	uint32_t allocatedSetCount;
+	uint32_t resetCount;
+} PvkDescriptorAllocator;
+
+/* poolSizes: number of descriptors of each type in each pool (for setsPerPool sets) */
+PVK_LINKAGE PvkDescriptorAllocator* pvkCreateDescriptorAllocator(VkDevice device, uint32_t setsPerPool, uint32_t poolSizeCount, const VkDescriptorPoolSize* poolSizes);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkDescriptorAllocator* pvkCreateDescriptorAllocator(VkDevice device, uint32_t setsPerPool, uint32_t poolSizeCount, const VkDescriptorPoolSize* poolSizes)
+{
+	PVK_ASSERT(poolSizeCount <= PVK_DESCRIPTOR_ALLOCATOR_MAX_POOL_SIZES);
+	PvkDescriptorAllocator* allocator = PVK_NEW(PvkDescriptorAllocator);
+	allocator->device = device;
+	allocator->setsPerPool = setsPerPool;
+	allocator->poolSizeCount = poolSizeCount;
+	memcpy(allocator->poolSizes, poolSizes, sizeof(VkDescriptorPoolSize) * poolSizeCount);
+	return allocator;
 }
 #endif
 
-PVK_LINKAGE VkPipeline pvkCreateGraphicsPipeline(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t colorAttachmentCount, uint32_t width, uint32_t height, uint32_t count, ...);
+/* destroys all the pools, and with them all the sets allocated */
+PVK_LINKAGE void pvkDestroyDescriptorAllocator(PvkDescriptorAllocator* allocator);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE VkPipeline pvkCreateGraphicsPipeline(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, uint32_t subpassIndex, uint32_t colorAttachmentCount, uint32_t width, uint32_t height, uint32_t count, ...)
+PVK_LINKAGE void pvkDestroyDescriptorAllocator(PvkDescriptorAllocator* allocator)
 {
-	va_list shaderModuleList;
-	va_start(shaderModuleList, count);
+	if(allocator->currentPool != VK_NULL_HANDLE)
+		vkDestroyDescriptorPool(allocator->device, allocator->currentPool, NULL);
+	for(uint32_t i = 0; i < allocator->usedPoolCount; i++)
+		vkDestroyDescriptorPool(allocator->device, allocator->usedPools[i], NULL);
+	for(uint32_t i = 0; i < allocator->freePoolCount; i++)
+		vkDestroyDescriptorPool(allocator->device, allocator->freePools[i], NULL);
+	if(allocator->usedPools != NULL)
+		PVK_DELETE(allocator->usedPools);
+	if(allocator->freePools != NULL)
+		PVK_DELETE(allocator->freePools);
+	PVK_DELETE(allocator);
+}
+#endif
 
-	/* Color attachment configuration */
-	VkPipelineColorBlendAttachmentState* colorAttachments = PVK_NEWV(VkPipelineColorBlendAttachmentState, colorAttachmentCount);
-	for(uint32_t i = 0; i < colorAttachmentCount; i++)
+/* retires the current pool and makes a reset (or a new) one current */
+PVK_LINKAGE void __pvkDescriptorAllocatorNextPool(PvkDescriptorAllocator* allocator);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void __pvkDescriptorAllocatorNextPool(PvkDescriptorAllocator* allocator)
+{
+	if(allocator->currentPool != VK_NULL_HANDLE)
 	{
-		VkPipelineColorBlendAttachmentState colorAttachment = { };
+		/* every pool is either current, used or free, so the arrays only need to hold all the created pools */
+		if(allocator->createdPoolCount > allocator->poolCapacity)
 		{
-			colorAttachment.blendEnable = VK_FALSE;
-			colorAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		};
-		colorAttachments[i] = colorAttachment;
+			allocator->poolCapacity = allocator->createdPoolCount * 2;
+			VkDescriptorPool* usedPools = PVK_NEWV(VkDescriptorPool, allocator->poolCapacity);
+			VkDescriptorPool* freePools = PVK_NEWV(VkDescriptorPool, allocator->poolCapacity);
+			if(allocator->usedPools != NULL)
+			{
+				memcpy(usedPools, allocator->usedPools, sizeof(VkDescriptorPool) * allocator->usedPoolCount);
+				memcpy(freePools, allocator->freePools, sizeof(VkDescriptorPool) * allocator->freePoolCount);
+				PVK_DELETE(allocator->usedPools);
+				PVK_DELETE(allocator->freePools);
+			}
+			allocator->usedPools = usedPools;
+			allocator->freePools = freePools;
+		}
+		allocator->usedPools[allocator->usedPoolCount++] = allocator->currentPool;
 	}
-
-	VkPipelineColorBlendStateCreateInfo colorBlend = { };
+	allocator->currentPoolSetCount = 0;
+	if(allocator->freePoolCount > 0)
 	{
-		colorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		colorBlend.logicOpEnable = VK_FALSE;
-		colorBlend.attachmentCount = colorAttachmentCount;
-		colorBlend.pAttachments = colorAttachments;
+		allocator->currentPool = allocator->freePools[--allocator->freePoolCount];
+		return;
+	}
+	VkDescriptorPoolCreateInfo cInfo = { };
+	{
+		cInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		cInfo.maxSets = allocator->setsPerPool;
+		cInfo.poolSizeCount = allocator->poolSizeCount;
+		cInfo.pPoolSizes = allocator->poolSizes;
 	};
+	PVK_CHECK(vkCreateDescriptorPool(allocator->device, &cInfo, NULL, &allocator->currentPool));
+	allocator->createdPoolCount++;
+}
+#endif
 
-	VkVertexInputBindingDescription vertexBindingDescription = { };
+/* allocates count sets (count <= setsPerPool) from the same pool into outSets, no heap allocation */
+PVK_LINKAGE void pvkDescriptorAllocatorAllocateMany(PvkDescriptorAllocator* allocator, uint32_t count, const VkDescriptorSetLayout* setLayouts, VkDescriptorSet* outSets);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDescriptorAllocatorAllocateMany(PvkDescriptorAllocator* allocator, uint32_t count, const VkDescriptorSetLayout* setLayouts, VkDescriptorSet* outSets)
+{
+	PVK_ASSERT(count <= allocator->setsPerPool);
+	if((allocator->currentPool == VK_NULL_HANDLE) || ((allocator->currentPoolSetCount + count) > allocator->setsPerPool))
+		__pvkDescriptorAllocatorNextPool(allocator);
+	VkDescriptorSetAllocateInfo allocInfo = { };
 	{
-		vertexBindingDescription.binding = 0;
-		vertexBindingDescription.stride = PVK_VERTEX_SIZE;
-		vertexBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorSetCount = count;
+		allocInfo.pSetLayouts = setLayouts;
 	};
-	VkVertexInputAttributeDescription* vertexAttributeDescriptions = PVK_NEWV(VkVertexInputAttributeDescription, PVK_VERTEX_ATTRIBUTE_COUNT);
-	vertexAttributeDescriptions[0] = __pvkGetVertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, PVK_VERTEX_POSITION_OFFSET);
-	vertexAttributeDescriptions[1] = __pvkGetVertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32B32_SFLOAT, PVK_VERTEX_NORMAL_OFFSET);
-	vertexAttributeDescriptions[2] = __pvkGetVertexInputAttributeDescription(0, 2, VK_FORMAT_R32G32_SFLOAT, PVK_VERTEX_TEXCOORD_OFFSET);
-	vertexAttributeDescriptions[3] = __pvkGetVertexInputAttributeDescription(0, 3, VK_FORMAT_R32G32B32A32_SFLOAT, PVK_VERTEX_COLOR_OFFSET);
+	allocInfo.descriptorPool = allocator->currentPool;
+	VkResult result = vkAllocateDescriptorSets(allocator->device, &allocInfo, outSets);
+	if((result == VK_ERROR_OUT_OF_POOL_MEMORY) || (result == VK_ERROR_FRAGMENTED_POOL))
+	{
+		/* the descriptors of some type ran out before maxSets, retry once with a fresh pool */
+		__pvkDescriptorAllocatorNextPool(allocator);
+		allocInfo.descriptorPool = allocator->currentPool;
+		result = vkAllocateDescriptorSets(allocator->device, &allocInfo, outSets);
+	}
+	PVK_CHECK(result);
+	allocator->currentPoolSetCount += count;
+	allocator->allocatedSetCount += count;
+}
+#endif
 
-	VkPipeline pipeline =  __pvkCreateGraphicsPipeline(device, layout, renderPass, subpassIndex, width, height, 1, &vertexBindingDescription, 4, vertexAttributeDescriptions, &colorBlend, true, count, shaderModuleList);
-	va_end(shaderModuleList);
-	PVK_DELETE(colorAttachments);
-	PVK_DELETE(vertexAttributeDescriptions);
-	return pipeline;
+PVK_LINKAGE VkDescriptorSet pvkDescriptorAllocatorAllocate(PvkDescriptorAllocator* allocator, VkDescriptorSetLayout setLayout);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkDescriptorSet pvkDescriptorAllocatorAllocate(PvkDescriptorAllocator* allocator, VkDescriptorSetLayout setLayout)
+{
+	VkDescriptorSet set;
+	pvkDescriptorAllocatorAllocateMany(allocator, 1, &setLayout, &set);
+	return set;
 }
 #endif
 
-PVK_LINKAGE VkPipelineLayout pvkCreatePipelineLayout(VkDevice device, uint32_t setLayoutCount, VkDescriptorSetLayout* setLayouts);
+/* frees all the sets allocated so far, the GPU must be done with them */
+PVK_LINKAGE void pvkDescriptorAllocatorReset(PvkDescriptorAllocator* allocator);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE VkPipelineLayout pvkCreatePipelineLayout(VkDevice device, uint32_t setLayoutCount, VkDescriptorSetLayout* setLayouts)
+PVK_LINKAGE void pvkDescriptorAllocatorReset(PvkDescriptorAllocator* allocator)
 {
-	VkPipelineLayoutCreateInfo cInfo = { };
+	if(allocator->currentPool == VK_NULL_HANDLE)
+		return;
+	/* the pool stays current, the filled ones go back to the free list */
+	PVK_CHECK(vkResetDescriptorPool(allocator->device, allocator->currentPool, 0));
+	for(uint32_t i = 0; i < allocator->usedPoolCount; i++)
 	{
-		cInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		cInfo.setLayoutCount = setLayoutCount;
-		cInfo.pSetLayouts = setLayouts;
-	};
-	VkPipelineLayout layout;
-	PVK_CHECK(vkCreatePipelineLayout(device, &cInfo, NULL, &layout));
-	return layout;
+		PVK_CHECK(vkResetDescriptorPool(allocator->device, allocator->usedPools[i], 0));
+		allocator->freePools[allocator->freePoolCount++] = allocator->usedPools[i];
+	}
+	allocator->usedPoolCount = 0;
+	allocator->currentPoolSetCount = 0;
+	allocator->resetCount++;
 }
 #endif
 
-/* Vulkan Buffer */
-PVK_LINKAGE VkBuffer __pvkCreateBuffer(VkDevice device, VkBufferUsageFlags usageFlags, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices);
+/* Frames in flight
+ * Each frame slot owns everything the CPU writes while recording a frame: a command buffer, the semaphore of its
+ * acquire and a linear allocator of uniform data. The semaphore waited on by the present belongs to the swapchain image
+ * instead (see PvkSwapchain::renderFinishSemaphores) since the images aren't presented in the order of the frame slots. 
+ * A slot is only reused after its fence is signaled, so the CPU can record frame N + 1 while the GPU is still executing 
+ * frame N without overwriting anything frame N reads.
+ * The slots are tracked with fences, or with the values of a PvkTimeline if one is given to pvkCreateFrameContext2. */
+typedef struct PvkFrame
+{
+	/* index of the slot in PvkFrameContext::frames */
+	uint32_t index;
+	/* signaled once the GPU has executed the frame's submission */
+	VkFence fence;
+	/* timeline value signaled by the frame's submission (PvkFrameContext::timeline only) */
+	uint64_t timelineValue;
+	VkSemaphore imageAvailableSemaphore;
+	VkCommandBuffer commandBuffer;
+	/* linear uniform allocator, reset when the slot is reused */
+	PvkUniformArena* uniformArena;
+	/* transient descriptor sets, reset when the slot is reused (see pvkFrameContextCreateDescriptorAllocators) */
+	PvkDescriptorAllocator* descriptorAllocator;
+} PvkFrame;
+
+typedef struct PvkFrameContext
+{
+	VkDevice device;
+	VkCommandPool commandPool;
+	PvkFrame* frames;
+	uint32_t frameCount;
+	/* fences[i] is frames[i].fence, the slots are handed out in round robin order by pvkFencePoolWaitAny */
+	PvkFencePool* fencePool;
+	/* if not NULL the frames are tracked with its values instead of the fences */
+	PvkTimeline* timeline;
+	/* number of frames begun so far */
+	uint64_t frameNumber;
+} PvkFrameContext;
+
+/* queueFamilyIndex: queue family of the queue the frames are submitted to
+ * uniformBufferSize: per frame capacity of the uniform allocator
+ * timeline: optional, timeline of the queue the frames are submitted to */
+PVK_LINKAGE PvkFrameContext* pvkCreateFrameContext2(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount, VkDeviceSize uniformBufferSize, PvkTimeline* timeline);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE VkBuffer __pvkCreateBuffer(VkDevice device, VkBufferUsageFlags usageFlags, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices)
+PVK_LINKAGE PvkFrameContext* pvkCreateFrameContext2(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount, VkDeviceSize uniformBufferSize, PvkTimeline* timeline)
 {
-	// union operation
-	uint32_t uniqueQueueFamilyCount;
-	uint32_t uniqueQueueFamilyIndices[queueFamilyCount];
-	__pvkUnionUInt32(queueFamilyCount, queueFamilyIndices, &uniqueQueueFamilyCount, uniqueQueueFamilyIndices);
+	PvkFrameContext* context = PVK_NEW(PvkFrameContext);
+	context->device = device;
+	context->frameCount = frameCount;
+	context->timeline = timeline;
+	context->frames = PVK_NEWV(PvkFrame, frameCount);
+	context->commandPool = pvkCreateCommandPool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, queueFamilyIndex);
+	/* created signaled, so the first wait on each slot returns immediately */
+	context->fencePool = pvkCreateFencePool(device, frameCount);
+	VkCommandBuffer* commandBuffers = __pvkAllocateCommandBuffers(device, context->commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, frameCount);
+	for(uint32_t i = 0; i < frameCount; i++)
+	{
+		PvkFrame* frame = &context->frames[i];
+		frame->index = i;
+		frame->fence = context->fencePool->fences[i];
+		frame->imageAvailableSemaphore = pvkCreateSemaphore(device);
+		frame->commandBuffer = commandBuffers[i];
+		frame->uniformArena = pvkCreateUniformArena(physicalDevice, device, uniformBufferSize, 1, &queueFamilyIndex);
+	}
+	PVK_DELETE(commandBuffers);
+	return context;
+}
+#endif
 
-	VkBufferCreateInfo cInfo = { };
+PVK_LINKAGE PvkFrameContext* pvkCreateFrameContext(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount, VkDeviceSize uniformBufferSize);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkFrameContext* pvkCreateFrameContext(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount, VkDeviceSize uniformBufferSize)
+{
+	return pvkCreateFrameContext2(physicalDevice, device, queueFamilyIndex, frameCount, uniformBufferSize, NULL);
+}
+#endif
+
+/* gives each frame slot a descriptor allocator for the sets used by that frame only, they are reset by pvkFrameContextBegin */
+PVK_LINKAGE void pvkFrameContextCreateDescriptorAllocators(PvkFrameContext* context, uint32_t setsPerPool, uint32_t poolSizeCount, const VkDescriptorPoolSize* poolSizes);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkFrameContextCreateDescriptorAllocators(PvkFrameContext* context, uint32_t setsPerPool, uint32_t poolSizeCount, const VkDescriptorPoolSize* poolSizes)
+{
+	for(uint32_t i = 0; i < context->frameCount; i++)
 	{
-		cInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		cInfo.usage = usageFlags;
-		cInfo.size = size;
-		cInfo.queueFamilyIndexCount = uniqueQueueFamilyCount;
-		cInfo.pQueueFamilyIndices = uniqueQueueFamilyIndices;
-		cInfo.sharingMode = (uniqueQueueFamilyCount > 1) ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
-	};
+		PVK_ASSERT(context->frames[i].descriptorAllocator == NULL);
+		context->frames[i].descriptorAllocator = pvkCreateDescriptorAllocator(context->device, setsPerPool, poolSizeCount, poolSizes);
+	}
+}
+#endif
 
-	VkBuffer buffer;
-	PVK_CHECK(vkCreateBuffer(device, &cInfo, NULL, &buffer));
-	return buffer;
+/* blocks until the GPU is done with all the submitted frames, unlike vkDeviceWaitIdle it doesn't wait on the other queues */
+PVK_LINKAGE void pvkFrameContextWaitIdle(PvkFrameContext* context);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkFrameContextWaitIdle(PvkFrameContext* context)
+{
+	if(context->timeline != NULL)
+	{
+		for(uint32_t i = 0; i < context->frameCount; i++)
+			pvkTimelineWait(context->timeline, context->frames[i].timelineValue, UINT64_MAX);
+	}
+	/* in timeline mode the fences are never submitted, so they are still signaled */
+	PVK_CHECK(vkWaitForFences(context->device, context->frameCount, context->fencePool->fences, VK_TRUE, UINT64_MAX));
 }
 #endif
 
-typedef struct PvkBuffer
+PVK_LINKAGE void pvkDestroyFrameContext(PvkFrameContext* context);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyFrameContext(PvkFrameContext* context)
 {
-	VkBuffer handle;
-	VkDeviceMemory memory;
-} PvkBuffer;
+	pvkFrameContextWaitIdle(context);
+	pvkDestroyFencePool(context->device, context->fencePool);
+	for(uint32_t i = 0; i < context->frameCount; i++)
+	{
+		PvkFrame* frame = &context->frames[i];
+		vkDestroySemaphore(context->device, frame->imageAvailableSemaphore, NULL);
+		pvkDestroyUniformArena(context->device, frame->uniformArena);
+		if(frame->descriptorAllocator != NULL)
+			pvkDestroyDescriptorAllocator(frame->descriptorAllocator);
+	}
+	vkDestroyCommandPool(context->device, context->commandPool, NULL);
+	PVK_DELETE(context->frames);
+	PVK_DELETE(context);
+}
+#endif
 
+/* blocks until the GPU is done with the next frame slot and returns it, 
+ * its command buffer, uniform allocator and descriptor allocator are free to be overwritten after this call */
+PVK_LINKAGE PvkFrame* pvkFrameContextBegin(PvkFrameContext* context);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkFrame* pvkFrameContextBegin(PvkFrameContext* context)
+{
+	PvkFrame* frame;
+	if(context->timeline != NULL)
+	{
+		/* waits precisely for the frame which last used this slot, the value is 0 (always reached) if the slot is unused */
+		frame = &context->frames[context->frameNumber % context->frameCount];
+		while(!pvkTimelineWait(context->timeline, frame->timelineValue, PVK_FENCE_POOL_WAIT_TIMEOUT))
+			PVK_WARNING("Frame timeline wait timed out, GPU is taking unusually long");
+	}
+	else
+	{
+		/* the frames are submitted to a single queue, so their fences are signaled in order and the oldest slot is the one returned */
+		uint32_t index;
+		while(!pvkFencePoolWaitAny(context->device, context->fencePool, PVK_FENCE_POOL_WAIT_TIMEOUT, &index))
+			PVK_WARNING("Frame fence wait timed out, GPU is taking unusually long");
+		frame = &context->frames[index];
+	}
+	/* the fence is reset only right before the submission (see pvkFrameContextSubmit),
+	 * so a frame which never gets submitted (i.e. failed swapchain image acquire) can't deadlock the slot */
+	pvkUniformArenaReset(frame->uniformArena);
+	if(frame->descriptorAllocator != NULL)
+		pvkDescriptorAllocatorReset(frame->descriptorAllocator);
+	context->frameNumber++;
+	return frame;
+}
+#endif
 
-PVK_LINKAGE PvkBuffer pvkCreateBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkBufferUsageFlags flags, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices);
+/* submits the frame's command buffer, waits on its imageAvailableSemaphore and signals renderFinishSemaphore and its fence (or timeline value),
+ * renderFinishSemaphore is the one of the acquired swapchain image (PvkSwapchain::renderFinishSemaphores[imageIndex]) */
+PVK_LINKAGE void pvkFrameContextSubmit(PvkFrameContext* context, PvkFrame* frame, VkQueue queue, VkSemaphore renderFinishSemaphore);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE PvkBuffer pvkCreateBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkMemoryPropertyFlags mflags, VkBufferUsageFlags flags, VkDeviceSize size, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices)
+PVK_LINKAGE void pvkFrameContextSubmit(PvkFrameContext* context, PvkFrame* frame, VkQueue queue, VkSemaphore renderFinishSemaphore)
 {
-	VkBuffer buffer = __pvkCreateBuffer(device, flags, size, queueFamilyCount, queueFamilyIndices);
-	VkMemoryRequirements bufferMemoryRequirements;
-	vkGetBufferMemoryRequirements(device, buffer, &bufferMemoryRequirements);
-	__pvkCheckForMemoryTypesSupport(physicalDevice, bufferMemoryRequirements.memoryTypeBits);
-	VkDeviceMemory memory = pvkAllocateMemory(device, bufferMemoryRequirements.size, 
-												__pvkGetMemoryTypeIndexFromMemoryProperty(physicalDevice, mflags));	
-	PVK_CHECK(vkBindBufferMemory(device, buffer, memory, 0));
-	return (PvkBuffer) { buffer, memory };
+	if(context->timeline != NULL)
+	{
+		PVK_ASSERT(context->timeline->queue == queue);
+		frame->timelineValue = pvkTimelineSubmit(context->timeline, 1, &frame->commandBuffer, 0, NULL, 
+													frame->imageAvailableSemaphore, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 
+													renderFinishSemaphore);
+		return;
+	}
+	PVK_CHECK(vkResetFences(context->device, 1, &frame->fence));
+	pvkSubmit(frame->commandBuffer, queue, frame->imageAvailableSemaphore, renderFinishSemaphore, frame->fence);
 }
 #endif
 
-PVK_LINKAGE void pvkDestroyBuffer(VkDevice device, PvkBuffer buffer);
+/* appends the frame's submission to batch (after whatever has been added to it already) and flushes it:
+ * the frame's command buffer waits on its imageAvailableSemaphore and signals renderFinishSemaphore and its fence (or timeline value),
+ * the command buffers added to the batch before this call don't wait for the swapchain image */
+PVK_LINKAGE void pvkFrameContextSubmitBatch(PvkFrameContext* context, PvkFrame* frame, PvkSubmitBatch* batch, VkSemaphore renderFinishSemaphore);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE void pvkDestroyBuffer(VkDevice device, PvkBuffer buffer)
+PVK_LINKAGE void pvkFrameContextSubmitBatch(PvkFrameContext* context, PvkFrame* frame, PvkSubmitBatch* batch, VkSemaphore renderFinishSemaphore)
 {
-	vkDestroyBuffer(device, buffer.handle, NULL);
-	vkFreeMemory(device, buffer.memory, NULL);
+	pvkSubmitBatchAddWait(batch, frame->imageAvailableSemaphore, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	pvkSubmitBatchAddCommandBuffer(batch, frame->commandBuffer);
+	pvkSubmitBatchAddSignal(batch, renderFinishSemaphore, 0);
+	if(context->timeline != NULL)
+	{
+		frame->timelineValue = pvkSubmitBatchAddTimelineSignal(batch, context->timeline);
+		pvkSubmitBatchFlush(batch, VK_NULL_HANDLE);
+		return;
+	}
+	PVK_CHECK(vkResetFences(context->device, 1, &frame->fence));
+	pvkSubmitBatchFlush(batch, frame->fence);
 }
 #endif
 
-PVK_LINKAGE void pvkUploadToMemory(VkDevice device, VkDeviceMemory memory, void* data, size_t size);
+/* vkAcquireNextImageKHR may have signaled the semaphore even though it reported a failure (VK_SUBOPTIMAL_KHR),
+ * a signaled semaphore with no pending wait can't be signaled again, so it is replaced */
+PVK_LINKAGE void pvkFrameRecreateImageAvailableSemaphore(VkDevice device, PvkFrame* frame);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE void pvkUploadToMemory(VkDevice device, VkDeviceMemory memory, void* data, size_t size)
+PVK_LINKAGE void pvkFrameRecreateImageAvailableSemaphore(VkDevice device, PvkFrame* frame)
 {
-	void* dst;
-	PVK_CHECK(vkMapMemory(device, memory, 0, size, 0, &dst));
-	memcpy(dst, data, size);
-	vkUnmapMemory(device, memory);
+	vkDestroySemaphore(device, frame->imageAvailableSemaphore, NULL);
+	frame->imageAvailableSemaphore = pvkCreateSemaphore(device);
 }
 #endif
 
+/* returns the offset of 'size' bytes in frame->uniformArena->buffer, valid until the frame slot is reused,
+ * outData (if not NULL) receives the persistently mapped pointer to them */
+PVK_STATIC PVK_INLINE uint32_t pvkFrameAllocateUniform(PvkFrame* frame, VkDeviceSize size, void** outData)
+{
+	return pvkUniformArenaAllocate(frame->uniformArena, size, outData);
+}
+
+/* copies data into the frame's uniform allocator and returns its offset in frame->uniformArena->buffer */
+PVK_STATIC PVK_INLINE uint32_t pvkFrameUploadUniform(PvkFrame* frame, const void* data, VkDeviceSize size)
+{
+	return pvkUniformArenaUpload(frame->uniformArena, data, size);
+}
+
 /* Vulkan Descriptor sets */
 
 PVK_LINKAGE VkDescriptorSet* pvkAllocateDescriptorSets(VkDevice device, VkDescriptorPool pool, uint32_t setCount, VkDescriptorSetLayout* setLayouts);
@@ -2060,72 +6481,309 @@ PVK_LINKAGE VkDescriptorPool pvkCreateDescriptorPool(VkDevice device, u32 maxSet
 	va_end(args);
 	VkDescriptorPoolCreateInfo cInfo = { };
 	{
-		cInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		cInfo.maxSets = maxSets;
-		cInfo.poolSizeCount = poolSize;
-		cInfo.pPoolSizes = poolSizes;
+		cInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		cInfo.maxSets = maxSets;
+		cInfo.poolSizeCount = poolSize;
+		cInfo.pPoolSizes = poolSizes;
+	};
+
+	VkDescriptorPool pool;
+	PVK_CHECK(vkCreateDescriptorPool(device, &cInfo, NULL, &pool));
+	return pool;
+}
+#endif
+
+PVK_LINKAGE void pvkWriteImageViewToDescriptor(VkDevice device, VkDescriptorSet set, uint32_t binding, VkImageView imageView, VkSampler sampler, VkImageLayout layout, VkDescriptorType descriptorType);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkWriteImageViewToDescriptor(VkDevice device, VkDescriptorSet set, uint32_t binding, VkImageView imageView, VkSampler sampler, VkImageLayout layout, VkDescriptorType descriptorType)
+{
+	VkDescriptorImageInfo imageInfo = { };
+	{
+		imageInfo.imageView = imageView;
+		imageInfo.sampler = sampler;
+		imageInfo.imageLayout = layout;
+	};
+
+	VkWriteDescriptorSet writeInfo = { };
+	{
+		writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeInfo.dstSet = set;
+		writeInfo.dstBinding = binding;
+		writeInfo.dstArrayElement = 0;
+		writeInfo.descriptorCount = 1;
+		writeInfo.descriptorType = descriptorType;
+		writeInfo.pImageInfo = &imageInfo;
+	};
+
+	vkUpdateDescriptorSets(device, 1, &writeInfo, 0, NULL);
+}
+#endif
+
+PVK_LINKAGE void pvkWriteBufferRangeToDescriptor(VkDevice device, VkDescriptorSet set, uint32_t binding, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range, VkDescriptorType descriptorType);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkWriteBufferRangeToDescriptor(VkDevice device, VkDescriptorSet set, uint32_t binding, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range, VkDescriptorType descriptorType)
+{
+	VkDescriptorBufferInfo bufferInfo = { };
+	{
+		bufferInfo.buffer = buffer;
+		bufferInfo.offset = offset;
+		bufferInfo.range = range;
+	};
+
+	VkWriteDescriptorSet writeInfo = { };
+	{
+		writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeInfo.dstSet = set;
+		writeInfo.dstBinding = binding;
+		writeInfo.dstArrayElement = 0;
+		writeInfo.descriptorCount = 1;
+		writeInfo.descriptorType = descriptorType;
+		writeInfo.pBufferInfo = &bufferInfo;
+	};
+
+	vkUpdateDescriptorSets(device, 1, &writeInfo, 0, NULL);
+}
+#endif
+
+PVK_STATIC PVK_INLINE void pvkWriteBufferToDescriptor(VkDevice device, VkDescriptorSet set, uint32_t binding, VkBuffer buffer, VkDescriptorType descriptorType)
+{
+	pvkWriteBufferRangeToDescriptor(device, set, binding, buffer, 0, VK_WHOLE_SIZE, descriptorType);
+}
+
+/* Batched descriptor writes
+ * Collects the writes of any number of sets and submits them with one vkUpdateDescriptorSets call,
+ * the writer lives on the caller's stack and must not be moved between the first write and the flush. */
+#define PVK_DESCRIPTOR_WRITER_MAX_WRITES 32
+
+/* data of one descriptor, also the element of the data passed to pvkUpdateDescriptorSetWithTemplate */
+typedef union PvkDescriptorInfo
+{
+	VkDescriptorImageInfo image;
+	VkDescriptorBufferInfo buffer;
+	VkBufferView texelBufferView;
+} PvkDescriptorInfo;
+
+typedef struct PvkDescriptorWriter
+{
+	VkDevice device;
+	uint32_t writeCount;
+	VkWriteDescriptorSet writes[PVK_DESCRIPTOR_WRITER_MAX_WRITES];
+	PvkDescriptorInfo infos[PVK_DESCRIPTOR_WRITER_MAX_WRITES];
+	/* number of vkUpdateDescriptorSets calls */
+	uint32_t flushCount;
+} PvkDescriptorWriter;
+
+PVK_LINKAGE void pvkDescriptorWriterBegin(PvkDescriptorWriter* writer, VkDevice device);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDescriptorWriterBegin(PvkDescriptorWriter* writer, VkDevice device)
+{
+	writer->device = device;
+	writer->writeCount = 0;
+	writer->flushCount = 0;
+}
+#endif
+
+/* submits the pending writes, the descriptors must not be in use by the GPU */
+PVK_LINKAGE void pvkDescriptorWriterFlush(PvkDescriptorWriter* writer);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDescriptorWriterFlush(PvkDescriptorWriter* writer)
+{
+	if(writer->writeCount == 0)
+		return;
+	vkUpdateDescriptorSets(writer->device, writer->writeCount, writer->writes, 0, NULL);
+	writer->writeCount = 0;
+	writer->flushCount++;
+}
+#endif
+
+PVK_LINKAGE VkWriteDescriptorSet* __pvkDescriptorWriterAdd(PvkDescriptorWriter* writer, VkDescriptorSet set, uint32_t binding, VkDescriptorType descriptorType);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE VkWriteDescriptorSet* __pvkDescriptorWriterAdd(PvkDescriptorWriter* writer, VkDescriptorSet set, uint32_t binding, VkDescriptorType descriptorType)
+{
+	if(writer->writeCount == PVK_DESCRIPTOR_WRITER_MAX_WRITES)
+		pvkDescriptorWriterFlush(writer);
+	VkWriteDescriptorSet* writeInfo = &writer->writes[writer->writeCount];
+	memset(writeInfo, 0, sizeof(VkWriteDescriptorSet));
+	{
+		writeInfo->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeInfo->dstSet = set;
+		writeInfo->dstBinding = binding;
+		writeInfo->dstArrayElement = 0;
+		writeInfo->descriptorCount = 1;
+		writeInfo->descriptorType = descriptorType;
+	};
+	return writeInfo;
+}
+#endif
+
+PVK_LINKAGE void pvkDescriptorWriterWriteImageView(PvkDescriptorWriter* writer, VkDescriptorSet set, uint32_t binding, VkImageView imageView, VkSampler sampler, VkImageLayout layout, VkDescriptorType descriptorType);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDescriptorWriterWriteImageView(PvkDescriptorWriter* writer, VkDescriptorSet set, uint32_t binding, VkImageView imageView, VkSampler sampler, VkImageLayout layout, VkDescriptorType descriptorType)
+{
+	VkWriteDescriptorSet* writeInfo = __pvkDescriptorWriterAdd(writer, set, binding, descriptorType);
+	VkDescriptorImageInfo* imageInfo = &writer->infos[writer->writeCount++].image;
+	{
+		imageInfo->imageView = imageView;
+		imageInfo->sampler = sampler;
+		imageInfo->imageLayout = layout;
 	};
-
-	VkDescriptorPool pool;
-	PVK_CHECK(vkCreateDescriptorPool(device, &cInfo, NULL, &pool));
-	return pool;
+	writeInfo->pImageInfo = imageInfo;
 }
 #endif
 
-PVK_LINKAGE void pvkWriteImageViewToDescriptor(VkDevice device, VkDescriptorSet set, uint32_t binding, VkImageView imageView, VkSampler sampler, VkImageLayout layout, VkDescriptorType descriptorType);
+PVK_LINKAGE void pvkDescriptorWriterWriteBufferRange(PvkDescriptorWriter* writer, VkDescriptorSet set, uint32_t binding, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range, VkDescriptorType descriptorType);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE void pvkWriteImageViewToDescriptor(VkDevice device, VkDescriptorSet set, uint32_t binding, VkImageView imageView, VkSampler sampler, VkImageLayout layout, VkDescriptorType descriptorType)
+PVK_LINKAGE void pvkDescriptorWriterWriteBufferRange(PvkDescriptorWriter* writer, VkDescriptorSet set, uint32_t binding, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range, VkDescriptorType descriptorType)
 {
-	VkDescriptorImageInfo imageInfo = { };
+	VkWriteDescriptorSet* writeInfo = __pvkDescriptorWriterAdd(writer, set, binding, descriptorType);
+	VkDescriptorBufferInfo* bufferInfo = &writer->infos[writer->writeCount++].buffer;
 	{
-		imageInfo.imageView = imageView;
-		imageInfo.sampler = sampler;
-		imageInfo.imageLayout = layout;
+		bufferInfo->buffer = buffer;
+		bufferInfo->offset = offset;
+		bufferInfo->range = range;
 	};
+	writeInfo->pBufferInfo = bufferInfo;
+}
+#endif
 
-	VkWriteDescriptorSet writeInfo = { };
+/* range: size of the largest block bound through the descriptor, at most maxUniformBufferRange */
+PVK_STATIC PVK_INLINE void pvkDescriptorWriterWriteUniformArena(PvkDescriptorWriter* writer, VkDescriptorSet set, uint32_t binding, PvkUniformArena* arena, VkDeviceSize range)
+{
+	pvkDescriptorWriterWriteBufferRange(writer, set, binding, arena->buffer.handle, 0, range, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+}
+
+/* Descriptor update templates
+ * Describes once where the descriptors of a set layout come from, each update then passes a PvkDescriptorInfo array
+ * (one element per descriptor, in the order of the bindings given at creation) instead of building VkWriteDescriptorSets.
+ * The instance is created for Vulkan 1.0, so the device must enable VK_KHR_descriptor_update_template for the template path
+ * (and say so at creation); without it the updates fall back to vkUpdateDescriptorSets. */
+#define PVK_DESCRIPTOR_TEMPLATE_MAX_ENTRIES 16
+
+typedef struct PvkDescriptorTemplate
+{
+	VkDevice device;
+	/* VK_NULL_HANDLE if the extension isn't enabled */
+	VkDescriptorUpdateTemplate handle;
+	uint32_t entryCount;
+	VkDescriptorUpdateTemplateEntry entries[PVK_DESCRIPTOR_TEMPLATE_MAX_ENTRIES];
+	/* number of PvkDescriptorInfo elements each update reads */
+	uint32_t infoCount;
+	PFN_vkUpdateDescriptorSetWithTemplate updateDescriptorSetWithTemplate;
+	PFN_vkDestroyDescriptorUpdateTemplate destroyDescriptorUpdateTemplate;
+} PvkDescriptorTemplate;
+
+/* isExtensionEnabled: true if the device has been created with VK_KHR_descriptor_update_template,
+ * 					   a driver may return the entry points of an extension which hasn't been enabled, so they aren't used to decide it
+ * bindings: the bindings setLayout was created with, only binding, descriptorType and descriptorCount are read */
+PVK_LINKAGE PvkDescriptorTemplate* pvkCreateDescriptorTemplate(VkDevice device, bool isExtensionEnabled, VkDescriptorSetLayout setLayout, uint32_t bindingCount, const VkDescriptorSetLayoutBinding* bindings);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkDescriptorTemplate* pvkCreateDescriptorTemplate(VkDevice device, bool isExtensionEnabled, VkDescriptorSetLayout setLayout, uint32_t bindingCount, const VkDescriptorSetLayoutBinding* bindings)
+{
+	PVK_ASSERT(bindingCount <= PVK_DESCRIPTOR_TEMPLATE_MAX_ENTRIES);
+	PvkDescriptorTemplate* descriptorTemplate = PVK_NEW(PvkDescriptorTemplate);
+	descriptorTemplate->device = device;
+	descriptorTemplate->entryCount = bindingCount;
+	for(uint32_t i = 0; i < bindingCount; i++)
 	{
-		writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeInfo.dstSet = set;
-		writeInfo.dstBinding = binding;
-		writeInfo.dstArrayElement = 0;
-		writeInfo.descriptorCount = 1;
-		writeInfo.descriptorType = descriptorType;
-		writeInfo.pImageInfo = &imageInfo;
+		VkDescriptorUpdateTemplateEntry* entry = &descriptorTemplate->entries[i];
+		entry->dstBinding = bindings[i].binding;
+		entry->dstArrayElement = 0;
+		entry->descriptorCount = bindings[i].descriptorCount;
+		entry->descriptorType = bindings[i].descriptorType;
+		entry->offset = sizeof(PvkDescriptorInfo) * descriptorTemplate->infoCount;
+		entry->stride = sizeof(PvkDescriptorInfo);
+		descriptorTemplate->infoCount += bindings[i].descriptorCount;
+	}
+
+	if(!isExtensionEnabled)
+		return descriptorTemplate;
+	PFN_vkCreateDescriptorUpdateTemplate createDescriptorUpdateTemplate = (PFN_vkCreateDescriptorUpdateTemplate)vkGetDeviceProcAddr(device, "vkCreateDescriptorUpdateTemplateKHR");
+	descriptorTemplate->updateDescriptorSetWithTemplate = (PFN_vkUpdateDescriptorSetWithTemplate)vkGetDeviceProcAddr(device, "vkUpdateDescriptorSetWithTemplateKHR");
+	descriptorTemplate->destroyDescriptorUpdateTemplate = (PFN_vkDestroyDescriptorUpdateTemplate)vkGetDeviceProcAddr(device, "vkDestroyDescriptorUpdateTemplateKHR");
+	if((createDescriptorUpdateTemplate == NULL) || (descriptorTemplate->updateDescriptorSetWithTemplate == NULL) || (descriptorTemplate->destroyDescriptorUpdateTemplate == NULL))
+		PVK_FETAL_ERROR("VK_KHR_descriptor_update_template is enabled but its functions can't be loaded");
+
+	VkDescriptorUpdateTemplateCreateInfo cInfo = { };
+	{
+		cInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		cInfo.descriptorUpdateEntryCount = bindingCount;
+		cInfo.pDescriptorUpdateEntries = descriptorTemplate->entries;
+		cInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		cInfo.descriptorSetLayout = setLayout;
 	};
+	PVK_CHECK(createDescriptorUpdateTemplate(device, &cInfo, NULL, &descriptorTemplate->handle));
+	return descriptorTemplate;
+}
+#endif
 
-	vkUpdateDescriptorSets(device, 1, &writeInfo, 0, NULL);
+PVK_LINKAGE void pvkDestroyDescriptorTemplate(PvkDescriptorTemplate* descriptorTemplate);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyDescriptorTemplate(PvkDescriptorTemplate* descriptorTemplate)
+{
+	if(descriptorTemplate->handle != VK_NULL_HANDLE)
+		descriptorTemplate->destroyDescriptorUpdateTemplate(descriptorTemplate->device, descriptorTemplate->handle, NULL);
+	PVK_DELETE(descriptorTemplate);
 }
 #endif
 
-PVK_LINKAGE void pvkWriteBufferToDescriptor(VkDevice device, VkDescriptorSet set, uint32_t binding, VkBuffer buffer, VkDescriptorType descriptorType);
+/* infos: descriptorTemplate->infoCount elements */
+PVK_LINKAGE void pvkUpdateDescriptorSetWithTemplate(PvkDescriptorTemplate* descriptorTemplate, VkDescriptorSet set, const PvkDescriptorInfo* infos);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE void pvkWriteBufferToDescriptor(VkDevice device, VkDescriptorSet set, uint32_t binding, VkBuffer buffer, VkDescriptorType descriptorType)
+PVK_LINKAGE void pvkUpdateDescriptorSetWithTemplate(PvkDescriptorTemplate* descriptorTemplate, VkDescriptorSet set, const PvkDescriptorInfo* infos)
 {
-	VkDescriptorBufferInfo bufferInfo = { };
+	if(descriptorTemplate->handle != VK_NULL_HANDLE)
 	{
-		bufferInfo.buffer = buffer;
-		bufferInfo.offset = 0;
-		bufferInfo.range = VK_WHOLE_SIZE;
-	};
+		descriptorTemplate->updateDescriptorSetWithTemplate(descriptorTemplate->device, set, descriptorTemplate->handle, infos);
+		return;
+	}
 
-	VkWriteDescriptorSet writeInfo = { };
+	/* one write per descriptor: vkUpdateDescriptorSets reads the descriptors of a write as a packed array of VkDescriptorImageInfo,
+	 * VkDescriptorBufferInfo or VkBufferView, but the PvkDescriptorInfo elements are as large as the largest of them (e.g. a VkBufferView
+	 * is followed by padding), so only the first descriptor of an array binding can be pointed at, the writes are submitted in chunks */
+	VkWriteDescriptorSet writes[PVK_DESCRIPTOR_TEMPLATE_MAX_ENTRIES];
+	uint32_t writeCount = 0;
+	for(uint32_t i = 0; i < descriptorTemplate->entryCount; i++)
 	{
-		writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeInfo.dstSet = set;
-		writeInfo.dstBinding = binding;
-		writeInfo.dstArrayElement = 0;
-		writeInfo.descriptorCount = 1;
-		writeInfo.descriptorType = descriptorType;
-		writeInfo.pBufferInfo = &bufferInfo;
-	};
-
-	vkUpdateDescriptorSets(device, 1, &writeInfo, 0, NULL);
+		const VkDescriptorUpdateTemplateEntry* entry = &descriptorTemplate->entries[i];
+		const PvkDescriptorInfo* entryInfos = infos + entry->offset / sizeof(PvkDescriptorInfo);
+		for(uint32_t j = 0; j < entry->descriptorCount; j++, writeCount++)
+		{
+			if(writeCount == PVK_DESCRIPTOR_TEMPLATE_MAX_ENTRIES)
+			{
+				vkUpdateDescriptorSets(descriptorTemplate->device, writeCount, writes, 0, NULL);
+				writeCount = 0;
+			}
+			VkWriteDescriptorSet* writeInfo = &writes[writeCount];
+			memset(writeInfo, 0, sizeof(VkWriteDescriptorSet));
+			writeInfo->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeInfo->dstSet = set;
+			writeInfo->dstBinding = entry->dstBinding;
+			writeInfo->dstArrayElement = j;
+			writeInfo->descriptorCount = 1;
+			writeInfo->descriptorType = entry->descriptorType;
+			writeInfo->pImageInfo = &entryInfos[j].image;
+			writeInfo->pBufferInfo = &entryInfos[j].buffer;
+			writeInfo->pTexelBufferView = &entryInfos[j].texelBufferView;
+		}
+	}
+	if(writeCount > 0)
+		vkUpdateDescriptorSets(descriptorTemplate->device, writeCount, writes, 0, NULL);
 }
 #endif
 
 /* Geometry */
-typedef uint16_t PvkIndex;
+/* the indices are given as 32 bit, but stored as 16 bit (VK_INDEX_TYPE_UINT16) whenever all the vertices of the geometry can be addressed with them */
+typedef uint32_t PvkIndex;
+
+PVK_STATIC PVK_INLINE VkIndexType pvkGetIndexType(uint32_t vertexCount)
+{
+	return (vertexCount <= 65536) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+PVK_STATIC PVK_INLINE uint32_t pvkGetIndexSize(VkIndexType indexType)
+{
+	return (indexType == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t);
+}
 
 typedef struct PvkGeometryData
 {
@@ -2135,42 +6793,351 @@ typedef struct PvkGeometryData
 	uint32_t indexCount;
 } PvkGeometryData;
 
+/* Geometry pool
+ * The geometries created with a PvkGeometryPool don't own any buffer: their vertices and indices are sub-allocated from a few 
+ * large vertex and index buffers (chunks) shared by all of them, and located in those with PvkGeometry::vertexOffset and firstIndex.
+ * So creating a geometry doesn't allocate device memory (unless a new chunk is needed), and consecutive draws of geometries of
+ * the same chunk don't rebind the vertex and index buffers (see pvkBindGeometry), a PvkDrawList issues them as a single multi draw.
+ * The vertices are stored in the pool's vertex format (see PvkVertexFormatFlagBits), the geometries created without a pool are always PvkVertex.
+ * The chunks are only released when the pool is destroyed.
+ * NOTE: The pool isn't thread safe. */
+#define PVK_GEOMETRY_POOL_DEFAULT_VERTEX_CAPACITY (256 * 1024) /* 12 MB of PvkVertex, 6 MB of PvkCompactVertex */
+#define PVK_GEOMETRY_POOL_DEFAULT_INDEX_BUFFER_SIZE (2 * 1024 * 1024) /* 2 MB, 16 and 32 bit indices share the buffer */
+
+typedef struct PvkGeometryPool PvkGeometryPool;
+
+typedef struct PvkGeometryPoolChunk
+{
+	PvkGeometryPool* pool;
+	PvkBuffer vertexBuffer;
+	PvkBuffer indexBuffer;
+	/* only with PVK_VERTEX_FORMAT_POSITION_STREAM_BIT */
+	PvkBuffer positionBuffer;
+	uint32_t vertexCapacity;
+	VkDeviceSize indexBufferSize;
+	/* sorted by offset, in vertices and in bytes respectively */
+	PvkMemoryFreeRange* freeVertexRanges;
+	PvkMemoryFreeRange* freeIndexRanges;
+	uint32_t geometryCount;
+	struct PvkGeometryPoolChunk* next;
+} PvkGeometryPoolChunk;
+
+struct PvkGeometryPool
+{
+	VkPhysicalDevice physicalDevice;
+	VkDevice device;
+	/* NULL if the chunks are host visible */
+	PvkStagingRing* stagingRing;
+	uint32_t queueFamilyIndexCount;
+	uint32_t* queueFamilyIndices;
+	PvkVertexFormatFlags vertexFormat;
+	/* size of a chunk, unless a single geometry needs more */
+	uint32_t vertexCapacity;
+	VkDeviceSize indexBufferSize;
+	PvkGeometryPoolChunk* chunks;
+	/* stats */
+	uint32_t chunkCount;
+	uint32_t geometryCount;
+	uint32_t usedVertexCount;
+	VkDeviceSize usedIndexBytes;
+};
+
 typedef struct PvkGeometry
 {
 	PvkBuffer vertexBuffer;
 	PvkBuffer indexBuffer;
-	uint16_t indexCount;
+	/* only with PVK_VERTEX_FORMAT_POSITION_STREAM_BIT, indexed with the same vertexOffset as vertexBuffer */
+	PvkBuffer positionBuffer;
+	PvkVertexFormatFlags vertexFormat;
+	uint32_t indexCount;
+	/* see pvkGetIndexType */
+	VkIndexType indexType;
 	PvkMat4 transform;
+	/* location of the geometry in its buffers (firstIndex in indices of indexType), both are 0 unless it has been created with a PvkGeometryPool */
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t vertexCount;
+	/* NULL if the geometry owns its buffers */
+	PvkGeometryPoolChunk* chunk;
 } PvkGeometry;
 
-PVK_LINKAGE PvkGeometry* __pvkCreateGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint16_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, PvkGeometryData* data);
+/* returns data->indices if indexType is VK_INDEX_TYPE_UINT32, otherwise a (PVK_NEW) copy narrowed to 16 bit which must be PVK_DELETEd */
+PVK_LINKAGE const void* __pvkGetIndexData(PvkGeometryData* data, VkIndexType indexType);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE const void* __pvkGetIndexData(PvkGeometryData* data, VkIndexType indexType)
+{
+	if(indexType == VK_INDEX_TYPE_UINT32)
+		return data->indices;
+	uint16_t* indices = PVK_NEWV(uint16_t, data->indexCount);
+	for(uint32_t i = 0; i < data->indexCount; i++)
+	{
+		PVK_ASSERT(data->indices[i] < data->vertexCount);
+		indices[i] = (uint16_t)data->indices[i];
+	}
+	return indices;
+}
+#endif
+
+/* if stagingRing is not NULL then the buffers are created in DEVICE_LOCAL memory and uploaded through the ring,
+ * the copies are submitted with the next pvkStagingRingFlush. Otherwise they are created in HOST_VISIBLE memory.
+ * The ring's buffers are exclusively owned by the ring's destination queue family (queueFamilyIndices are ignored then),
+ * the geometry must not be used before the ticket returned by that flush is complete. */
+PVK_LINKAGE PvkGeometry* __pvkCreateGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, PvkStagingRing* stagingRing, PvkGeometryData* data);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE PvkGeometry* __pvkCreateGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint16_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, PvkGeometryData* data)
+PVK_LINKAGE PvkGeometry* __pvkCreateGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, PvkStagingRing* stagingRing, PvkGeometryData* data)
 {
-	uint64_t vertexBufferSize = sizeof(PvkVertex) * data->vertexCount;
-	uint64_t indexBufferSize = sizeof(PvkIndex) * data->indexCount;
-	PvkBuffer vertexBuffer = pvkCreateBuffer(physicalDevice, device, 
+	VkIndexType indexType = pvkGetIndexType(data->vertexCount);
+	uint64_t vertexBufferSize = sizeof(PvkVertex) * (uint64_t)data->vertexCount;
+	uint64_t indexBufferSize = pvkGetIndexSize(indexType) * (uint64_t)data->indexCount;
+	const void* indices = __pvkGetIndexData(data, indexType);
+	PvkGeometry* geometry = PVK_NEW(PvkGeometry);
+	if(stagingRing != NULL)
+	{
+		geometry->vertexBuffer = pvkCreateBuffer(physicalDevice, device, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+												VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, vertexBufferSize, 1, &stagingRing->dstQueueFamilyIndex);
+		geometry->indexBuffer = pvkCreateBuffer(physicalDevice, device, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+												VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, indexBufferSize, 1, &stagingRing->dstQueueFamilyIndex);
+		pvkStagingRingUploadToBuffer(stagingRing, geometry->vertexBuffer.handle, 0, data->vertices, vertexBufferSize);
+		pvkStagingRingUploadToBuffer(stagingRing, geometry->indexBuffer.handle, 0, indices, indexBufferSize);
+	}
+	else
+	{
+		geometry->vertexBuffer = pvkCreateBuffer(physicalDevice, device, 
 												VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
 												VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBufferSize, queueFamilyIndexCount, queueFamilyIndices);
-	PvkBuffer indexBuffer = pvkCreateBuffer(physicalDevice, device, 
+		geometry->indexBuffer = pvkCreateBuffer(physicalDevice, device, 
 												VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
 												VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBufferSize, queueFamilyIndexCount, queueFamilyIndices);
-	pvkUploadToMemory(device, vertexBuffer.memory, data->vertices, vertexBufferSize);
-	pvkUploadToMemory(device, indexBuffer.memory, data->indices, indexBufferSize);
+		pvkUploadToBuffer(device, &geometry->vertexBuffer, 0, data->vertices, vertexBufferSize);
+		pvkUploadToBuffer(device, &geometry->indexBuffer, 0, indices, indexBufferSize);
+	}
+	if(indices != data->indices)
+		PVK_DELETE(indices);
+	geometry->indexCount = data->indexCount;
+	geometry->indexType = indexType;
+	geometry->vertexCount = data->vertexCount;
+	geometry->transform = pvkMat4Identity();
+	return geometry;
+}
+#endif
+
+/* vertexCapacity, indexBufferSize: size of each chunk (in vertices and in bytes), 0 for PVK_GEOMETRY_POOL_DEFAULT_VERTEX_CAPACITY and PVK_GEOMETRY_POOL_DEFAULT_INDEX_BUFFER_SIZE
+ * if stagingRing is not NULL then the chunks are created in DEVICE_LOCAL memory and the geometries are uploaded through the ring,
+ * as with __pvkCreateGeometry (and queueFamilyIndices are ignored). Otherwise they are created in HOST_VISIBLE memory.
+ * vertexFormat: the PvkVertex of the geometries are converted to it when they are created */
+PVK_LINKAGE PvkGeometryPool* pvkCreateGeometryPool(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, PvkStagingRing* stagingRing, PvkVertexFormatFlags vertexFormat, uint32_t vertexCapacity, VkDeviceSize indexBufferSize);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkGeometryPool* pvkCreateGeometryPool(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, PvkStagingRing* stagingRing, PvkVertexFormatFlags vertexFormat, uint32_t vertexCapacity, VkDeviceSize indexBufferSize)
+{
+	PvkGeometryPool* pool = PVK_NEW(PvkGeometryPool);
+	pool->physicalDevice = physicalDevice;
+	pool->device = device;
+	pool->stagingRing = stagingRing;
+	pool->queueFamilyIndexCount = queueFamilyIndexCount;
+	pool->queueFamilyIndices = PVK_NEWV(uint32_t, queueFamilyIndexCount);
+	memcpy(pool->queueFamilyIndices, queueFamilyIndices, sizeof(uint32_t) * queueFamilyIndexCount);
+	pool->vertexFormat = vertexFormat;
+	pool->vertexCapacity = (vertexCapacity == 0) ? PVK_GEOMETRY_POOL_DEFAULT_VERTEX_CAPACITY : vertexCapacity;
+	pool->indexBufferSize = (indexBufferSize == 0) ? PVK_GEOMETRY_POOL_DEFAULT_INDEX_BUFFER_SIZE : indexBufferSize;
+	return pool;
+}
+#endif
+
+/* destroys all the chunks, the geometries of the pool must have been destroyed already */
+PVK_LINKAGE void pvkDestroyGeometryPool(PvkGeometryPool* pool);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyGeometryPool(PvkGeometryPool* pool)
+{
+	if(pool->geometryCount > 0)
+		PVK_WARNING("Geometry pool is being destroyed while %u geometries are still alive", pool->geometryCount);
+	PvkGeometryPoolChunk* chunk = pool->chunks;
+	while(chunk != NULL)
+	{
+		PvkGeometryPoolChunk* next = chunk->next;
+		pvkDestroyBuffer(pool->device, chunk->vertexBuffer);
+		pvkDestroyBuffer(pool->device, chunk->indexBuffer);
+		if(pool->vertexFormat & PVK_VERTEX_FORMAT_POSITION_STREAM_BIT)
+			pvkDestroyBuffer(pool->device, chunk->positionBuffer);
+		__pvkDestroyFreeRanges(chunk->freeVertexRanges);
+		__pvkDestroyFreeRanges(chunk->freeIndexRanges);
+		PVK_DELETE(chunk);
+		chunk = next;
+	}
+	PVK_DELETE(pool->queueFamilyIndices);
+	PVK_DELETE(pool);
+}
+#endif
+
+PVK_LINKAGE PvkGeometryPoolChunk* __pvkGeometryPoolCreateChunk(PvkGeometryPool* pool, uint32_t vertexCapacity, VkDeviceSize indexBufferSize);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkGeometryPoolChunk* __pvkGeometryPoolCreateChunk(PvkGeometryPool* pool, uint32_t vertexCapacity, VkDeviceSize indexBufferSize)
+{
+	VkMemoryPropertyFlags memoryFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	VkBufferUsageFlags usageFlags = 0;
+	uint32_t queueFamilyIndexCount = pool->queueFamilyIndexCount;
+	uint32_t* queueFamilyIndices = pool->queueFamilyIndices;
+	if(pool->stagingRing != NULL)
+	{
+		memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		usageFlags = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		queueFamilyIndexCount = 1;
+		queueFamilyIndices = &pool->stagingRing->dstQueueFamilyIndex;
+	}
+
+	PvkGeometryPoolChunk* chunk = PVK_NEW(PvkGeometryPoolChunk);
+	chunk->pool = pool;
+	chunk->vertexBuffer = pvkCreateBuffer(pool->physicalDevice, pool->device, memoryFlags, usageFlags | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+											pvkGetVertexSize(pool->vertexFormat) * (VkDeviceSize)vertexCapacity, queueFamilyIndexCount, queueFamilyIndices);
+	if(pool->vertexFormat & PVK_VERTEX_FORMAT_POSITION_STREAM_BIT)
+		chunk->positionBuffer = pvkCreateBuffer(pool->physicalDevice, pool->device, memoryFlags, usageFlags | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+											PVK_POSITION_VERTEX_SIZE * (VkDeviceSize)vertexCapacity, queueFamilyIndexCount, queueFamilyIndices);
+	chunk->indexBuffer = pvkCreateBuffer(pool->physicalDevice, pool->device, memoryFlags, usageFlags | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+											indexBufferSize, queueFamilyIndexCount, queueFamilyIndices);
+	chunk->vertexCapacity = vertexCapacity;
+	chunk->indexBufferSize = indexBufferSize;
+	chunk->freeVertexRanges = PVK_NEW(PvkMemoryFreeRange);
+	chunk->freeVertexRanges->size = vertexCapacity;
+	chunk->freeIndexRanges = PVK_NEW(PvkMemoryFreeRange);
+	chunk->freeIndexRanges->size = indexBufferSize;
+
+	/* push at the front of the list, newest chunks are the most likely to have free space */
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+	pool->chunkCount++;
+	return chunk;
+}
+#endif
+
+/* returns false (and allocates nothing) if either of the ranges doesn't fit into the chunk,
+ * the index range is aligned to the index size so that outFirstIndex (in indices of indexType) addresses it from the start of the buffer */
+PVK_LINKAGE bool __pvkGeometryPoolChunkAllocate(PvkGeometryPoolChunk* chunk, uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType, uint32_t* outFirstVertex, uint32_t* outFirstIndex);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE bool __pvkGeometryPoolChunkAllocate(PvkGeometryPoolChunk* chunk, uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType, uint32_t* outFirstVertex, uint32_t* outFirstIndex)
+{
+	VkDeviceSize indexSize = pvkGetIndexSize(indexType);
+	VkDeviceSize firstVertex, indexDataOffset;
+	if(!__pvkFreeRangesAllocate(&chunk->freeVertexRanges, vertexCount, 1, &firstVertex))
+		return false;
+	if(!__pvkFreeRangesAllocate(&chunk->freeIndexRanges, indexSize * indexCount, indexSize, &indexDataOffset))
+	{
+		__pvkFreeRangesFree(&chunk->freeVertexRanges, firstVertex, vertexCount);
+		return false;
+	}
+	*outFirstVertex = (uint32_t)firstVertex;
+	*outFirstIndex = (uint32_t)(indexDataOffset / indexSize);
+	return true;
+}
+#endif
+
+PVK_LINKAGE void __pvkGeometryPoolUpload(PvkGeometryPool* pool, PvkBuffer* buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void __pvkGeometryPoolUpload(PvkGeometryPool* pool, PvkBuffer* buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+{
+	if(pool->stagingRing != NULL)
+		pvkStagingRingUploadToBuffer(pool->stagingRing, buffer->handle, offset, data, size);
+	else
+		pvkUploadToBuffer(pool->device, buffer, offset, data, size);
+}
+#endif
+
+/* the vertices and the indices are copied into the first chunk with enough free space, the indices stay relative to the 
+ * geometry's own vertices (vertexOffset is added to them by the draws), so 16 bit indices are used whenever the geometry alone
+ * has few enough vertices, however many the chunk holds */
+PVK_LINKAGE PvkGeometry* pvkCreateGeometryWithPool(PvkGeometryPool* pool, PvkGeometryData* data);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkGeometry* pvkCreateGeometryWithPool(PvkGeometryPool* pool, PvkGeometryData* data)
+{
+	VkIndexType indexType = pvkGetIndexType(data->vertexCount);
+	uint32_t firstVertex = 0, firstIndex = 0;
+	PvkGeometryPoolChunk* chunk = pool->chunks;
+	while(chunk != NULL)
+	{
+		if(__pvkGeometryPoolChunkAllocate(chunk, data->vertexCount, data->indexCount, indexType, &firstVertex, &firstIndex))
+			break;
+		chunk = chunk->next;
+	}
+	uint32_t vertexSize = pvkGetVertexSize(pool->vertexFormat);
+	uint64_t vertexDataSize = vertexSize * (uint64_t)data->vertexCount;
+	uint64_t indexDataSize = pvkGetIndexSize(indexType) * (uint64_t)data->indexCount;
+	if(chunk == NULL)
+	{
+		/* geometries larger than a chunk get a chunk of their own size */
+		uint32_t vertexCapacity = (data->vertexCount > pool->vertexCapacity) ? data->vertexCount : pool->vertexCapacity;
+		VkDeviceSize indexBufferSize = (indexDataSize > pool->indexBufferSize) ? indexDataSize : pool->indexBufferSize;
+		chunk = __pvkGeometryPoolCreateChunk(pool, vertexCapacity, indexBufferSize);
+		bool result = __pvkGeometryPoolChunkAllocate(chunk, data->vertexCount, data->indexCount, indexType, &firstVertex, &firstIndex);
+		PVK_ASSERT(result);
+	}
+
+	VkDeviceSize vertexDataOffset = vertexSize * (VkDeviceSize)firstVertex;
+	VkDeviceSize indexDataOffset = pvkGetIndexSize(indexType) * (VkDeviceSize)firstIndex;
+	const void* vertices = data->vertices;
+	if(pool->vertexFormat & PVK_VERTEX_FORMAT_COMPACT_BIT)
+	{
+		PvkCompactVertex* compactVertices = PVK_NEWV(PvkCompactVertex, data->vertexCount);
+		pvkEncodeCompactVertices(data->vertexCount, data->vertices, compactVertices);
+		vertices = compactVertices;
+	}
+	const void* indices = __pvkGetIndexData(data, indexType);
+	__pvkGeometryPoolUpload(pool, &chunk->vertexBuffer, vertexDataOffset, vertices, vertexDataSize);
+	__pvkGeometryPoolUpload(pool, &chunk->indexBuffer, indexDataOffset, indices, indexDataSize);
+	if(pool->vertexFormat & PVK_VERTEX_FORMAT_POSITION_STREAM_BIT)
+	{
+		PvkVec3* positions = PVK_NEWV(PvkVec3, data->vertexCount);
+		for(uint32_t i = 0; i < data->vertexCount; i++)
+			positions[i] = data->vertices[i].position;
+		__pvkGeometryPoolUpload(pool, &chunk->positionBuffer, PVK_POSITION_VERTEX_SIZE * (VkDeviceSize)firstVertex, 
+								positions, PVK_POSITION_VERTEX_SIZE * (uint64_t)data->vertexCount);
+		PVK_DELETE(positions);
+	}
+	if(vertices != data->vertices)
+		PVK_DELETE(vertices);
+	if(indices != data->indices)
+		PVK_DELETE(indices);
+	chunk->geometryCount++;
+	pool->geometryCount++;
+	pool->usedVertexCount += data->vertexCount;
+	pool->usedIndexBytes += indexDataSize;
+
 	PvkGeometry* geometry = PVK_NEW(PvkGeometry);
-	geometry->vertexBuffer = vertexBuffer;
-	geometry->indexBuffer = indexBuffer;
+	geometry->vertexBuffer = chunk->vertexBuffer;
+	geometry->indexBuffer = chunk->indexBuffer;
+	geometry->positionBuffer = chunk->positionBuffer;
+	geometry->vertexFormat = pool->vertexFormat;
 	geometry->indexCount = data->indexCount;
+	geometry->indexType = indexType;
 	geometry->transform = pvkMat4Identity();
+	geometry->firstIndex = firstIndex;
+	geometry->vertexOffset = (int32_t)firstVertex;
+	geometry->vertexCount = data->vertexCount;
+	geometry->chunk = chunk;
 	return geometry;
 }
 #endif
 
-PVK_LINKAGE PvkGeometry* pvkCreatePlaneGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, float size);
+PVK_LINKAGE void pvkGeometryPoolLogStats(PvkGeometryPool* pool);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkGeometryPoolLogStats(PvkGeometryPool* pool)
+{
+	uint64_t vertexCapacity = 0, indexBufferSize = 0;
+	for(PvkGeometryPoolChunk* chunk = pool->chunks; chunk != NULL; chunk = chunk->next)
+	{
+		vertexCapacity += chunk->vertexCapacity;
+		indexBufferSize += chunk->indexBufferSize;
+	}
+	PVK_INFO("Geometry pool: geometries = %u, chunks = %u, vertices = %u / %llu, index bytes = %llu / %llu",
+				pool->geometryCount, pool->chunkCount,
+				pool->usedVertexCount, (unsigned long long)vertexCapacity,
+				(unsigned long long)pool->usedIndexBytes, (unsigned long long)indexBufferSize);
+}
+#endif
+
+/* fills vertices (4 elements) and indices (6 elements) */
+PVK_LINKAGE PvkGeometryData __pvkGetPlaneGeometryData(float size, PvkVertex* vertices, PvkIndex* indices);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE PvkGeometry* pvkCreatePlaneGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, float size)
+PVK_LINKAGE PvkGeometryData __pvkGetPlaneGeometryData(float size, PvkVertex* vertices, PvkIndex* indices)
 {
-	PvkVertex vertices[4] = 
+	PvkVertex srcVertices[4] = 
 	{
 		{ { -0.5f * size, 0, -0.5f * size }, { 0, 1.0f, 0 }, { 0, 1 }, { 1, 1, 1, 1 } },
 		{ {  0.5f * size, 0, -0.5f * size }, { 0, 1.0f, 0 }, { 1, 1 }, { 1, 1, 1, 1 } },
@@ -2178,28 +7145,54 @@ PVK_LINKAGE PvkGeometry* pvkCreatePlaneGeometry(VkPhysicalDevice physicalDevice,
 		{ { -0.5f * size, 0,  0.5f * size }, { 0, 1.0f, 0 }, { 0, 0 }, { 1, 1, 1, 1 } }
 	};
 
-	PvkIndex indices[6] = 
+	PvkIndex srcIndices[6] = 
 	{
 		2, 1, 0,
 		0, 3, 2
 	};
 
+	memcpy(vertices, srcVertices, sizeof(srcVertices));
+	memcpy(indices, srcIndices, sizeof(srcIndices));
+
 	PvkGeometryData geometryData = { };
-	{ 
+	{
 		geometryData.vertices = vertices; 
 		geometryData.vertexCount = 4;
 		geometryData.indices = indices;
 		geometryData.indexCount = 6;
 	};
-	return __pvkCreateGeometry(physicalDevice, device, queueFamilyIndexCount, queueFamilyIndices, &geometryData);
+	return geometryData;
+}
+#endif
+
+PVK_LINKAGE PvkGeometry* pvkCreatePlaneGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, PvkStagingRing* stagingRing, float size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkGeometry* pvkCreatePlaneGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, PvkStagingRing* stagingRing, float size)
+{
+	PvkVertex vertices[4];
+	PvkIndex indices[6];
+	PvkGeometryData geometryData = __pvkGetPlaneGeometryData(size, vertices, indices);
+	return __pvkCreateGeometry(physicalDevice, device, queueFamilyIndexCount, queueFamilyIndices, stagingRing, &geometryData);
 }
 #endif
 
-PVK_LINKAGE PvkGeometry* pvkCreateBoxGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, float size);
+PVK_LINKAGE PvkGeometry* pvkCreatePlaneGeometryWithPool(PvkGeometryPool* pool, float size);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE PvkGeometry* pvkCreateBoxGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, float size)
+PVK_LINKAGE PvkGeometry* pvkCreatePlaneGeometryWithPool(PvkGeometryPool* pool, float size)
 {
-	PvkVertex vertices[24] = 
+	PvkVertex vertices[4];
+	PvkIndex indices[6];
+	PvkGeometryData geometryData = __pvkGetPlaneGeometryData(size, vertices, indices);
+	return pvkCreateGeometryWithPool(pool, &geometryData);
+}
+#endif
+
+/* fills vertices (24 elements) and indices (36 elements) */
+PVK_LINKAGE PvkGeometryData __pvkGetBoxGeometryData(float size, PvkVertex* vertices, PvkIndex* indices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkGeometryData __pvkGetBoxGeometryData(float size, PvkVertex* vertices, PvkIndex* indices)
+{
+	PvkVertex srcVertices[24] = 
 	{
 		// bottom
 		{ { -0.5f * size, -0.5f * size, -0.5f * size }, { 0, -1.0f, 0 }, { 0, 1 }, { 1, 1, 1, 1 } },
@@ -2238,7 +7231,7 @@ PVK_LINKAGE PvkGeometry* pvkCreateBoxGeometry(VkPhysicalDevice physicalDevice, V
 		{ {  0.5f * size, -0.5f * size, 0.5f * size }, { 0, 0, -1.0f }, { 0, 0 }, { 1, 1, 1, 1 } }
 	};
 
-	PvkIndex indices[36] = 
+	PvkIndex srcIndices[36] = 
 	{
 		0, 1, 2,
 		2, 3, 0,
@@ -2253,6 +7246,9 @@ PVK_LINKAGE PvkGeometry* pvkCreateBoxGeometry(VkPhysicalDevice physicalDevice, V
 		20, 21, 22,
 		22, 23, 20
 	};
+	memcpy(vertices, srcVertices, sizeof(srcVertices));
+	memcpy(indices, srcIndices, sizeof(srcIndices));
+
 	PvkGeometryData geometryData = { };
 	{
 		geometryData.vertices = vertices; 
@@ -2260,31 +7256,295 @@ PVK_LINKAGE PvkGeometry* pvkCreateBoxGeometry(VkPhysicalDevice physicalDevice, V
 		geometryData.indices = indices;
 		geometryData.indexCount = 36;
 	};
-	return __pvkCreateGeometry(physicalDevice, device, queueFamilyIndexCount, queueFamilyIndices, &geometryData);
+	return geometryData;
 }
 #endif
 
-PVK_LINKAGE void pvkDrawGeometry(VkCommandBuffer cb, PvkGeometry* geometry);
+PVK_LINKAGE PvkGeometry* pvkCreateBoxGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, PvkStagingRing* stagingRing, float size);
 #ifdef PVK_IMPLEMENTATION
-PVK_LINKAGE void pvkDrawGeometry(VkCommandBuffer cb, PvkGeometry* geometry)
+PVK_LINKAGE PvkGeometry* pvkCreateBoxGeometry(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndexCount, uint32_t* queueFamilyIndices, PvkStagingRing* stagingRing, float size)
+{
+	PvkVertex vertices[24];
+	PvkIndex indices[36];
+	PvkGeometryData geometryData = __pvkGetBoxGeometryData(size, vertices, indices);
+	return __pvkCreateGeometry(physicalDevice, device, queueFamilyIndexCount, queueFamilyIndices, stagingRing, &geometryData);
+}
+#endif
+
+PVK_LINKAGE PvkGeometry* pvkCreateBoxGeometryWithPool(PvkGeometryPool* pool, float size);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkGeometry* pvkCreateBoxGeometryWithPool(PvkGeometryPool* pool, float size)
+{
+	PvkVertex vertices[24];
+	PvkIndex indices[36];
+	PvkGeometryData geometryData = __pvkGetBoxGeometryData(size, vertices, indices);
+	return pvkCreateGeometryWithPool(pool, &geometryData);
+}
+#endif
+
+/* binds the vertex and index buffers of geometry, they stay bound for all the geometries of the same PvkGeometryPool chunk
+ * which have the same index type */
+PVK_LINKAGE void pvkBindGeometry(VkCommandBuffer cb, PvkGeometry* geometry);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkBindGeometry(VkCommandBuffer cb, PvkGeometry* geometry)
 {
 	VkDeviceSize offset = 0;
 	vkCmdBindVertexBuffers(cb, 0, 1, &geometry->vertexBuffer.handle, &offset);
-	vkCmdBindIndexBuffer(cb, geometry->indexBuffer.handle, 0, VK_INDEX_TYPE_UINT16);
-	vkCmdDrawIndexed(cb, geometry->indexCount, 1, 0, 0, 0);
+	vkCmdBindIndexBuffer(cb, geometry->indexBuffer.handle, 0, geometry->indexType);
+}
+#endif
+
+/* binds the position stream and the index buffer of geometry instead, for the depth only pipelines whose vertex format is set 
+ * with positionOnly (see pvkGraphicsPipelineDescSetVertexFormat), the geometry must come from a pool with PVK_VERTEX_FORMAT_POSITION_STREAM_BIT */
+PVK_LINKAGE void pvkBindGeometryPositions(VkCommandBuffer cb, PvkGeometry* geometry);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkBindGeometryPositions(VkCommandBuffer cb, PvkGeometry* geometry)
+{
+	PVK_ASSERT(geometry->vertexFormat & PVK_VERTEX_FORMAT_POSITION_STREAM_BIT);
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(cb, 0, 1, &geometry->positionBuffer.handle, &offset);
+	vkCmdBindIndexBuffer(cb, geometry->indexBuffer.handle, 0, geometry->indexType);
+}
+#endif
+
+/* draws geometry without binding its buffers, see pvkBindGeometry and pvkBindGeometryPositions */
+PVK_STATIC PVK_INLINE void pvkDrawBoundGeometry(VkCommandBuffer cb, PvkGeometry* geometry)
+{
+	vkCmdDrawIndexed(cb, geometry->indexCount, 1, geometry->firstIndex, geometry->vertexOffset, 0);
+}
+
+PVK_LINKAGE void pvkDrawGeometry(VkCommandBuffer cb, PvkGeometry* geometry);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDrawGeometry(VkCommandBuffer cb, PvkGeometry* geometry)
+{
+	pvkBindGeometry(cb, geometry);
+	pvkDrawBoundGeometry(cb, geometry);
+}
+#endif
+
+/* pushes the per object data (e.g. PvkObjectData) before drawing, so that objects drawn with the same pipeline and sets
+ * can have their own transforms without rebinding descriptors or writing to memory, 
+ * layout must have a push constant range covering [offset, offset + size) for stageFlags */
+PVK_LINKAGE void pvkDrawGeometryWithPushConstants(VkCommandBuffer cb, PvkGeometry* geometry, VkPipelineLayout layout, VkShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* data);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDrawGeometryWithPushConstants(VkCommandBuffer cb, PvkGeometry* geometry, VkPipelineLayout layout, VkShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* data)
+{
+	vkCmdPushConstants(cb, layout, stageFlags, offset, size, data);
+	pvkDrawGeometry(cb, geometry);
+}
+#endif
+
+/* draws instanceCount copies of geometry in one call, instanceBuffer holds instanceCount PvkInstances starting at instanceOffset
+ * (e.g. a host visible PvkBuffer created with VK_BUFFER_USAGE_VERTEX_BUFFER_BIT), see pvkGraphicsPipelineDescAddInstanceLayout */
+PVK_LINKAGE void pvkDrawGeometryInstanced(VkCommandBuffer cb, PvkGeometry* geometry, VkBuffer instanceBuffer, VkDeviceSize instanceOffset, uint32_t instanceCount);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDrawGeometryInstanced(VkCommandBuffer cb, PvkGeometry* geometry, VkBuffer instanceBuffer, VkDeviceSize instanceOffset, uint32_t instanceCount)
+{
+	VkBuffer buffers[2] = { geometry->vertexBuffer.handle, instanceBuffer };
+	VkDeviceSize offsets[2] = { 0, instanceOffset };
+	vkCmdBindVertexBuffers(cb, 0, 2, buffers, offsets);
+	vkCmdBindIndexBuffer(cb, geometry->indexBuffer.handle, 0, geometry->indexType);
+	vkCmdDrawIndexed(cb, geometry->indexCount, instanceCount, geometry->firstIndex, geometry->vertexOffset, 0);
 }
 #endif
 
+/* the GPU must be done with the geometry, the ranges of a pool's geometry are immediately reused by the next geometries of the pool */
 PVK_LINKAGE void pvkDestroyGeometry(VkDevice device, PvkGeometry* geometry);
 #ifdef PVK_IMPLEMENTATION
 PVK_LINKAGE void pvkDestroyGeometry(VkDevice device, PvkGeometry* geometry)
 {
-	pvkDestroyBuffer(device, geometry->vertexBuffer);
-	pvkDestroyBuffer(device, geometry->indexBuffer);
+	PvkGeometryPoolChunk* chunk = geometry->chunk;
+	if(chunk != NULL)
+	{
+		/* returns the ranges to the chunk, the buffers are shared */
+		__pvkFreeRangesFree(&chunk->freeVertexRanges, (VkDeviceSize)geometry->vertexOffset, geometry->vertexCount);
+		VkDeviceSize indexSize = pvkGetIndexSize(geometry->indexType);
+		__pvkFreeRangesFree(&chunk->freeIndexRanges, indexSize * geometry->firstIndex, indexSize * geometry->indexCount);
+		chunk->geometryCount--;
+		chunk->pool->geometryCount--;
+		chunk->pool->usedVertexCount -= geometry->vertexCount;
+		chunk->pool->usedIndexBytes -= indexSize * geometry->indexCount;
+	}
+	else
+	{
+		pvkDestroyBuffer(device, geometry->vertexBuffer);
+		pvkDestroyBuffer(device, geometry->indexBuffer);
+	}
 	PVK_DELETE(geometry);
 }
 #endif
 
+/* Indirect draw list
+ * Records the draws of a frame as VkDrawIndexedIndirectCommands (and their PvkInstances) into host visible buffers,
+ * pvkDrawListRecord then issues one vkCmdDrawIndexedIndirect per run of consecutive draws sharing the same vertex and index buffers
+ * and index type (as all the geometries of a PvkGeometryPool chunk with less than 65536 vertices each do),
+ * instead of one bind and draw per object. Each draw reads its PvkInstance through firstInstance, so the pipelines must be
+ * created with pvkGraphicsPipelineDescAddInstanceLayout. The buffers are read by the GPU, so a list must not be reset before the GPU is done
+ * with the frame it was recorded into (one list per frame slot). 
+ * Without the multiDrawIndirect feature each draw is issued separately. The draw counts are known by the CPU when recording,
+ * so vkCmdDrawIndexedIndirectCount (VK_KHR_draw_indirect_count) wouldn't save anything over vkCmdDrawIndexedIndirect here. */
+typedef struct PvkDrawListBatch
+{
+	VkBuffer vertexBuffer;
+	/* VK_NULL_HANDLE if the geometries have no position stream */
+	VkBuffer positionBuffer;
+	VkBuffer indexBuffer;
+	VkIndexType indexType;
+	uint32_t firstDraw;
+	uint32_t drawCount;
+} PvkDrawListBatch;
+
+typedef struct PvkDrawList
+{
+	VkDevice device;
+	uint32_t capacity;
+	uint32_t drawCount;
+	/* VkDrawIndexedIndirectCommand per draw */
+	PvkBuffer indirectBuffer;
+	VkDrawIndexedIndirectCommand* commands;
+	/* PvkInstance per draw, bound to PVK_INSTANCE_BINDING */
+	PvkBuffer instanceBuffer;
+	PvkInstance* instances;
+	PvkDrawListBatch* batches;
+	uint32_t batchCount;
+	/* enabled device features */
+	bool multiDrawIndirect;
+	bool drawIndirectFirstInstance;
+	/* stats of the last pvkDrawListRecord */
+	uint32_t indirectCallCount;
+} PvkDrawList;
+
+/* enabledFeatures: the features device has been created with (see pvkGetLogicalDeviceFeatures), 
+ * capacity: maximum number of draws between two resets */
+PVK_LINKAGE PvkDrawList* pvkCreateDrawList(VkPhysicalDevice physicalDevice, VkDevice device, const VkPhysicalDeviceFeatures* enabledFeatures, uint32_t capacity, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE PvkDrawList* pvkCreateDrawList(VkPhysicalDevice physicalDevice, VkDevice device, const VkPhysicalDeviceFeatures* enabledFeatures, uint32_t capacity, uint32_t queueFamilyCount, uint32_t* queueFamilyIndices)
+{
+	PvkDrawList* list = PVK_NEW(PvkDrawList);
+	list->device = device;
+	list->capacity = capacity;
+	VkMemoryPropertyFlags memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	list->indirectBuffer = pvkCreateBuffer(physicalDevice, device, memoryFlags, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, 
+											sizeof(VkDrawIndexedIndirectCommand) * capacity, queueFamilyCount, queueFamilyIndices);
+	list->commands = (VkDrawIndexedIndirectCommand*)list->indirectBuffer.mappedData;
+	list->instanceBuffer = pvkCreateBuffer(physicalDevice, device, memoryFlags, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
+											PVK_INSTANCE_SIZE * capacity, queueFamilyCount, queueFamilyIndices);
+	list->instances = (PvkInstance*)list->instanceBuffer.mappedData;
+	list->batches = PVK_NEWV(PvkDrawListBatch, capacity);
+	/* a feature supported by the physical device but not enabled on the device can't be used */
+	list->multiDrawIndirect = enabledFeatures->multiDrawIndirect == VK_TRUE;
+	list->drawIndirectFirstInstance = enabledFeatures->drawIndirectFirstInstance == VK_TRUE;
+	return list;
+}
+#endif
+
+PVK_LINKAGE void pvkDestroyDrawList(PvkDrawList* list);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDestroyDrawList(PvkDrawList* list)
+{
+	pvkDestroyBuffer(list->device, list->indirectBuffer);
+	pvkDestroyBuffer(list->device, list->instanceBuffer);
+	PVK_DELETE(list->batches);
+	PVK_DELETE(list);
+}
+#endif
+
+/* the GPU must be done with the draws recorded so far */
+PVK_STATIC PVK_INLINE void pvkDrawListReset(PvkDrawList* list)
+{
+	list->drawCount = 0;
+	list->batchCount = 0;
+}
+
+/* appends a draw of geometry, the draws of geometries sharing their buffers and index type (i.e. of the same PvkGeometryPool chunk) 
+ * should be added one after another */
+PVK_LINKAGE void pvkDrawListAdd(PvkDrawList* list, PvkGeometry* geometry, const PvkInstance* instance);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDrawListAdd(PvkDrawList* list, PvkGeometry* geometry, const PvkInstance* instance)
+{
+	if(list->drawCount == list->capacity)
+		PVK_FETAL_ERROR("Draw list overflow, capacity = %u draws", list->capacity);
+	uint32_t drawIndex = list->drawCount++;
+	VkDrawIndexedIndirectCommand* command = &list->commands[drawIndex];
+	command->indexCount = geometry->indexCount;
+	command->instanceCount = 1;
+	command->firstIndex = geometry->firstIndex;
+	command->vertexOffset = geometry->vertexOffset;
+	/* without drawIndirectFirstInstance firstInstance must be 0, the instance buffer is rebound for each draw instead */
+	command->firstInstance = list->drawIndirectFirstInstance ? drawIndex : 0;
+	list->instances[drawIndex] = *instance;
+
+	PvkDrawListBatch* batch = (list->batchCount > 0) ? &list->batches[list->batchCount - 1] : NULL;
+	if((batch == NULL) || (batch->vertexBuffer != geometry->vertexBuffer.handle) || (batch->indexBuffer != geometry->indexBuffer.handle)
+		|| (batch->indexType != geometry->indexType))
+	{
+		batch = &list->batches[list->batchCount++];
+		batch->vertexBuffer = geometry->vertexBuffer.handle;
+		/* the geometries sharing their vertex buffer share their position stream as well */
+		batch->positionBuffer = (geometry->vertexFormat & PVK_VERTEX_FORMAT_POSITION_STREAM_BIT) ? geometry->positionBuffer.handle : VK_NULL_HANDLE;
+		batch->indexBuffer = geometry->indexBuffer.handle;
+		batch->indexType = geometry->indexType;
+		batch->firstDraw = drawIndex;
+		batch->drawCount = 0;
+	}
+	batch->drawCount++;
+}
+#endif
+
+/* records the draws added since the last reset, the pipeline and the descriptor sets must be bound already,
+ * positionsOnly: binds the position streams instead of the interleaved vertices, for the depth only pipelines whose vertex format 
+ * is set with positionOnly (see pvkBindGeometryPositions), all the geometries must then come from a pool with PVK_VERTEX_FORMAT_POSITION_STREAM_BIT */
+PVK_LINKAGE void pvkDrawListRecord2(PvkDrawList* list, VkCommandBuffer cb, bool positionsOnly);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDrawListRecord2(PvkDrawList* list, VkCommandBuffer cb, bool positionsOnly)
+{
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	list->indirectCallCount = 0;
+	if(list->drawIndirectFirstInstance)
+	{
+		VkDeviceSize instanceOffset = 0;
+		vkCmdBindVertexBuffers(cb, PVK_INSTANCE_BINDING, 1, &list->instanceBuffer.handle, &instanceOffset);
+	}
+	for(uint32_t i = 0; i < list->batchCount; i++)
+	{
+		const PvkDrawListBatch* batch = &list->batches[i];
+		PVK_ASSERT(!positionsOnly || (batch->positionBuffer != VK_NULL_HANDLE));
+		VkDeviceSize vertexOffset = 0;
+		vkCmdBindVertexBuffers(cb, 0, 1, positionsOnly ? &batch->positionBuffer : &batch->vertexBuffer, &vertexOffset);
+		vkCmdBindIndexBuffer(cb, batch->indexBuffer, 0, batch->indexType);
+		VkDeviceSize offset = (VkDeviceSize)stride * batch->firstDraw;
+		if(!list->drawIndirectFirstInstance)
+		{
+			for(uint32_t j = 0; j < batch->drawCount; j++, list->indirectCallCount++)
+			{
+				VkDeviceSize instanceOffset = PVK_INSTANCE_SIZE * (batch->firstDraw + j);
+				vkCmdBindVertexBuffers(cb, PVK_INSTANCE_BINDING, 1, &list->instanceBuffer.handle, &instanceOffset);
+				vkCmdDrawIndexedIndirect(cb, list->indirectBuffer.handle, offset + (VkDeviceSize)stride * j, 1, stride);
+			}
+		}
+		else if(list->multiDrawIndirect)
+		{
+			vkCmdDrawIndexedIndirect(cb, list->indirectBuffer.handle, offset, batch->drawCount, stride);
+			list->indirectCallCount++;
+		}
+		else
+		{
+			for(uint32_t j = 0; j < batch->drawCount; j++, list->indirectCallCount++)
+				vkCmdDrawIndexedIndirect(cb, list->indirectBuffer.handle, offset + (VkDeviceSize)stride * j, 1, stride);
+		}
+	}
+}
+#endif
+
+/* binds the interleaved vertices, see pvkDrawListRecord2 */
+PVK_LINKAGE void pvkDrawListRecord(PvkDrawList* list, VkCommandBuffer cb);
+#ifdef PVK_IMPLEMENTATION
+PVK_LINKAGE void pvkDrawListRecord(PvkDrawList* list, VkCommandBuffer cb)
+{
+	pvkDrawListRecord2(list, cb, false);
+}
+#endif
+
 /* Camera */
 
 PVK_STATIC PVK_INLINE PVK_CONSTEXPR PvkMat4 pvkMat4OrthoProj(float height, float aspectRatio, float n, float f)
@@ -2382,11 +7642,12 @@ typedef struct PvkGlobalData
 	PvkAmbientLight ambLight;		// 16 bytes
 } PvkGlobalData;					// total = 256 + 48 = 304 bytes
 
+/* pushed as push constants, exactly the 128 bytes every device supports */
 typedef struct PvkObjectData
 {
-	PvkMat4 modelMatrix;
-	PvkMat4 normalMatrix;
-} PvkObjectData;
+	PvkMat4 modelMatrix;			// 64 bytes
+	PvkMat4 normalMatrix;			// 64 bytes
+} PvkObjectData;					// total = 128 bytes
 
 #ifdef __cplusplus
 }
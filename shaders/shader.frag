@@ -25,13 +25,7 @@ layout(set = 0, binding = 1) uniform PvkGlobalData
 	PvkAmbientLight ambLight;
 } pvkGlobalData;
 
-layout(set = 1, binding = 2) uniform PvkObjectData
-{
-	mat4 modelMatrix;			// model matrix of the object being rendered
-	mat4 normalMatrix;			// normal matrix of the object being rendered
-} pvkObjectData;
-
-layout(set = 2, binding = 3) uniform sampler2D shadowMap;			// shadow map depth buffer sampler
+layout(set = 1, binding = 3) uniform sampler2D shadowMap;			// shadow map depth buffer sampler
 
 layout(location = 0) in vec2 _texcoord;
 layout(location = 1) in vec3 _normal;
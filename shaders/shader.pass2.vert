@@ -7,7 +7,7 @@ layout(set = 1, binding = 1) uniform PvkGlobalData
 	mat4 viewMatrix;				// view matrix of the camera
 } pvkGlobalData;
 
-layout(set = 2, binding = 2) uniform PvkObjectData
+layout(push_constant) uniform PvkObjectData
 {
 	mat4 modelMatrix;				// model matrix of the object being rendered
 	mat4 normalMatrix;				// normal matrix of the object being rendered
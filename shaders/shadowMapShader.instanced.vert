@@ -0,0 +1,21 @@
+
+#version 450
+
+layout(set = 0, binding = 1) uniform PvkGlobalData
+{
+	mat4 projectionMatrix;			// projection matrix of the light
+	mat4 viewMatrix;				// view matrix of the light
+	mat4 lightProjectionMatrix;		// projection matrix of the light
+	mat4 lightViewMatrix;			// view matrix of the light
+} pvkGlobalData;
+
+layout(location = 0) in vec3 position;
+
+// per instance (PvkInstance), the columns of the model matrix are at location = 4, 5, 6, 7
+layout(location = 4) in mat4 instanceModelMatrix;
+
+void main()
+{
+	vec4 _position = pvkGlobalData.lightProjectionMatrix * pvkGlobalData.lightViewMatrix * instanceModelMatrix * vec4(position, 1.0);
+	gl_Position = _position;
+}
@@ -9,7 +9,7 @@ layout(set = 0, binding = 1) uniform PvkGlobalData
 	mat4 lightViewMatrix;			// view matrix of the light
 } pvkGlobalData;
 
-layout(set = 1, binding = 2) uniform PvkObjectData
+layout(push_constant) uniform PvkObjectData
 {
 	mat4 modelMatrix;				// model matrix of the object being rendered
 	mat4 normalMatrix;				// normal matrix of the object being rendered
@@ -4,6 +4,18 @@
 #include <PlayVk/PlayVk.h>
 
 #define FENCE_WAIT_TIME 5 /* nano seconds */
+#define FRAMES_IN_FLIGHT 2
+#define FRAME_UNIFORM_BUFFER_SIZE (64 * 1024)
+/* small boxes circling the big one, they only cast shadows and are drawn with one instanced draw */
+#define CROWD_SIZE 8
+/* boxes and tilted panels around the edge of the plane, mixed geometries drawn through a PvkDrawList */
+#define POST_COUNT 6
+#define PIPELINE_CACHE_FILE_PATH "pipeline_cache.bin"
+/* packed from the .spv files on the first launch, removed by PlayVk.makefile whenever a shader is rebuilt */
+#define SHADER_ARCHIVE_FILE_PATH "shaders/shaders.pvkpack"
+/* uncomment to compare the persistently mapped upload path against map/memcpy/unmap at startup */
+// #define UPLOAD_BENCHMARK
+#define UPLOAD_BENCHMARK_ITERATIONS 10000
 
 static VkRenderPass pvkCreateShadowMapRenderPass(VkDevice device)
 {
@@ -208,151 +220,187 @@ static VkRenderPass pvkCreateRenderPass2(VkDevice device)
 	return renderPass;
 }
 
-static VkDescriptorSetLayout pvkCreateShadowMapDescriptorSetLayout(VkDevice device)
+#ifdef UPLOAD_BENCHMARK
+static void runUploadBenchmark(VkPhysicalDevice physicalDevice, VkDevice device, PvkBuffer* buffer, void* data, size_t size)
 {
-	VkDescriptorSetLayoutBinding binding = 
-	{
-		.binding = 3,
-		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-		.descriptorCount = 1,
-		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT
-	};
-
-	VkDescriptorSetLayoutCreateInfo cInfo = 
-	{
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = 1,
-		.pBindings = &binding
-	};
-
-	VkDescriptorSetLayout setLayout;
-	PVK_CHECK(vkCreateDescriptorSetLayout(device, &cInfo, NULL, &setLayout));
-	return setLayout;
-}
-
-static VkDescriptorSetLayout pvkCreateDescriptorSetLayout(VkDevice device)
-{
-	VkDescriptorSetLayoutBinding binding = 
-	{
-		.binding = 0,
-		.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-		.descriptorCount = 1,
-		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
-	};
-
-	VkDescriptorSetLayoutCreateInfo cInfo = 
-	{
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = 1,
-		.pBindings = &binding
-	};
-
-	VkDescriptorSetLayout setLayout;
-	PVK_CHECK(vkCreateDescriptorSetLayout(device, &cInfo, NULL, &setLayout));
-	return setLayout;
+	/* old path: map, copy and unmap the whole VkDeviceMemory for every upload */
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, buffer->handle, &requirements);
+	VkDeviceMemory memory = pvkAllocateMemory(device, requirements.size, 
+									__pvkGetMemoryTypeIndexFromMemoryProperty(physicalDevice, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+	uint64_t start = pvkGetTimeNs();
+	for(uint32_t i = 0; i < UPLOAD_BENCHMARK_ITERATIONS; i++)
+		pvkUploadToMemory(device, memory, data, size);
+	uint64_t mapUnmapTime = pvkGetTimeNs() - start;
+	vkFreeMemory(device, memory, NULL);
+
+	/* new path: copy into the persistently mapped pointer */
+	start = pvkGetTimeNs();
+	for(uint32_t i = 0; i < UPLOAD_BENCHMARK_ITERATIONS; i++)
+		pvkUploadToBuffer(device, buffer, 0, data, size);
+	uint64_t persistentTime = pvkGetTimeNs() - start;
+
+	PVK_INFO("Upload benchmark (%llu bytes x %u): map/memcpy/unmap = %.1f ns/upload, persistently mapped = %.1f ns/upload",
+				(unsigned long long)size, UPLOAD_BENCHMARK_ITERATIONS,
+				(double)mapUnmapTime / UPLOAD_BENCHMARK_ITERATIONS,
+				(double)persistentTime / UPLOAD_BENCHMARK_ITERATIONS);
 }
+#endif
 
-static VkDescriptorSetLayout pvkCreateGlobalDescriptorSetLayout(VkDevice device)
+static void recordShadowMapCommandBuffer(u32 width, u32 height, VkCommandBuffer commandBuffer,
+								VkRenderPass shadowMapRenderPass, 
+								VkFramebuffer shadowMapFramebuffer,
+								VkPipeline shadowMapPipeline,
+								VkPipelineLayout shadowMapPipelineLayout,
+								VkDescriptorSet* set,
+								uint32_t globalDataOffset,
+								PvkGeometry* planeGeometry,
+								PvkGeometry* boxGeometry,
+								const PvkObjectData* planeData,
+								const PvkObjectData* boxData,
+								VkPipeline crowdPipeline,
+								VkPipelineLayout crowdPipelineLayout,
+								VkBuffer crowdInstanceBuffer,
+								VkPipeline postPipeline,
+								PvkDrawList* postDrawList)
 {
-	VkDescriptorSetLayoutBinding* bindings = PVK_NEWV(VkDescriptorSetLayoutBinding, 2);
-	bindings[0] = (VkDescriptorSetLayoutBinding)
-	{
-		.binding = 1,
-		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		.descriptorCount = 1,
-		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT		
-	};
-
-	VkDescriptorSetLayoutCreateInfo cInfo = 
-	{
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = 1,
-		.pBindings = bindings
-	};
-
-	VkDescriptorSetLayout setLayout;
-	PVK_CHECK(vkCreateDescriptorSetLayout(device, &cInfo, NULL, &setLayout));
-	PVK_DELETE(bindings);
-	return setLayout;
+	pvkBeginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+	/* shadow map renderpass */
+	VkClearValue shadowMapClearValue = { .depthStencil = { .depth = 1.0f, .stencil = 0 } };
+	pvkBeginRenderPass(commandBuffer, shadowMapRenderPass, shadowMapFramebuffer, width, height, 1, &shadowMapClearValue);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowMapPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowMapPipelineLayout, 0, 1, &set[1], 1, &globalDataOffset);
+	/* the plane and the box come from the same geometry pool chunk, so their position stream is bound only once */
+	pvkBindGeometryPositions(commandBuffer, planeGeometry);
+	vkCmdPushConstants(commandBuffer, shadowMapPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PvkObjectData), planeData);
+	pvkDrawBoundGeometry(commandBuffer, planeGeometry);
+	vkCmdPushConstants(commandBuffer, shadowMapPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PvkObjectData), boxData);
+	pvkDrawBoundGeometry(commandBuffer, boxGeometry);
+	/* the crowd reads its model matrices from the instance buffer instead of the push constants, 
+	 * the pipeline layouts differ in their push constant ranges so the global set is bound again */
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, crowdPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, crowdPipelineLayout, 0, 1, &set[1], 1, &globalDataOffset);
+	pvkDrawGeometryInstanced(commandBuffer, boxGeometry, crowdInstanceBuffer, 0, CROWD_SIZE);
+	/* the posts read their PvkInstance through the same instance layout and only fetch the position stream, 
+	 * one indirect draw per geometry pool chunk */
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, postPipeline);
+	pvkDrawListRecord2(postDrawList, commandBuffer, true);
+	pvkEndRenderPass(commandBuffer);
+
+	pvkEndCommandBuffer(commandBuffer);
 }
 
-static VkDescriptorSetLayout pvkCreateObjectSetLayout(VkDevice device)
-{
-	VkDescriptorSetLayoutBinding binding = 
-	{
-		.binding = 2,
-		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		.descriptorCount = 1,
-		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
-	};
-
-	VkDescriptorSetLayoutCreateInfo cInfo = 
-	{
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = 1,
-		.pBindings = &binding
-	};
-
-	VkDescriptorSetLayout setLayout;
-	PVK_CHECK(vkCreateDescriptorSetLayout(device, &cInfo, NULL, &setLayout));
-	return setLayout;
-}
-
-static void recordCommandBuffers(u32 width, u32 height, VkCommandBuffer* commandBuffers,
+static void recordCommandBuffer(u32 width, u32 height, VkCommandBuffer commandBuffer,
 							    VkClearValue* clearValues,
 								VkRenderPass renderPass, 
-								VkRenderPass shadowMapRenderPass, 
-								VkFramebuffer* shadowMapFramebuffer,
-								VkFramebuffer* framebuffers,
-								VkPipeline shadowMapPipeline,
+								VkFramebuffer framebuffer,
 								VkPipeline pipeline,
 								VkPipeline pipeline2,
-								VkPipelineLayout shadowMapPipelineLayout,
 								VkPipelineLayout pipelineLayout,
 								VkPipelineLayout pipelineLayout2,
 								VkDescriptorSet* set,
+								uint32_t globalDataOffset,
 								PvkGeometry* planeGeometry,
-								PvkGeometry* boxGeometry)
+								PvkGeometry* boxGeometry,
+								const PvkObjectData* planeData,
+								const PvkObjectData* boxData)
 {
-	for(int index = 0; index < 3; index++)
-	{
-		pvkBeginCommandBuffer(commandBuffers[index], VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
-
-		/* shadow map renderpass */
-		VkClearValue shadowMapClearValue = { .depthStencil = { .depth = 1.0f, .stencil = 0 } };
-		pvkBeginRenderPass(commandBuffers[index], shadowMapRenderPass, *shadowMapFramebuffer, width, height, 1, &shadowMapClearValue);
-		vkCmdBindPipeline(commandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, shadowMapPipeline);
-		vkCmdBindDescriptorSets(commandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, shadowMapPipelineLayout, 0, 2, &set[1], 0, NULL);
-		pvkDrawGeometry(commandBuffers[index], planeGeometry);
-		pvkDrawGeometry(commandBuffers[index], boxGeometry);
-		pvkEndRenderPass(commandBuffers[index]);
-
-		/* color renderpass */
-		pvkBeginRenderPass(commandBuffers[index], renderPass, framebuffers[index], width, height, 3, clearValues);
-
-		/* first subpass */
-		vkCmdBindPipeline(commandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-		vkCmdBindDescriptorSets(commandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 3, &set[1], 0, NULL);
-		pvkDrawGeometry(commandBuffers[index], planeGeometry);
-		pvkDrawGeometry(commandBuffers[index], boxGeometry);
-
-		vkCmdNextSubpass(commandBuffers[index], VK_SUBPASS_CONTENTS_INLINE);
-
-		/* second subpass */
-		vkCmdBindPipeline(commandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline2);
-		vkCmdBindDescriptorSets(commandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout2, 0, 3, &set[0], 0, NULL);
-		pvkDrawGeometry(commandBuffers[index], planeGeometry);
-		pvkDrawGeometry(commandBuffers[index], boxGeometry);
-
-		pvkEndRenderPass(commandBuffers[index]);
+	pvkBeginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+	/* color renderpass */
+	pvkBeginRenderPass(commandBuffer, renderPass, framebuffer, width, height, 3, clearValues);
+	/* the plane and the box come from the same geometry pool chunk, the buffers stay bound across the subpasses */
+	pvkBindGeometry(commandBuffer, planeGeometry);
+
+	/* first subpass */
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 2, &set[1], 1, &globalDataOffset);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PvkObjectData), planeData);
+	pvkDrawBoundGeometry(commandBuffer, planeGeometry);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PvkObjectData), boxData);
+	pvkDrawBoundGeometry(commandBuffer, boxGeometry);
+
+	vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+
+	/* second subpass */
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline2);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout2, 0, 2, &set[0], 1, &globalDataOffset);
+	vkCmdPushConstants(commandBuffer, pipelineLayout2, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PvkObjectData), planeData);
+	pvkDrawBoundGeometry(commandBuffer, planeGeometry);
+	vkCmdPushConstants(commandBuffer, pipelineLayout2, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PvkObjectData), boxData);
+	pvkDrawBoundGeometry(commandBuffer, boxGeometry);
+
+	pvkEndRenderPass(commandBuffer);
+
+	pvkEndCommandBuffer(commandBuffer);
+}
 
-		pvkEndCommandBuffer(commandBuffers[index]);
+/* the attachments and framebuffers which depend on the swapchain extent */
+typedef struct RenderTargets
+{
+	PvkImage auxImage;
+	VkImageView auxAttachment;
+	PvkImage depthImage;
+	VkImageView depthAttachment;
+	VkFramebuffer* framebuffers;				// one per swapchain image
+	u32 framebufferCount;
+	PvkImage shadowMapImage;
+	VkImageView shadowMapAttachment;
+	VkFramebuffer* shadowMapFramebuffer;
+} RenderTargets;
+
+static void createRenderTargets(RenderTargets* targets, VkDevice device, PvkMemoryAllocator* memoryAllocator, PvkSwapchain* swapchain,
+								VkRenderPass renderPass, VkRenderPass shadowMapRenderPass, u32 queueFamilyCount, uint32_t* queueFamilyIndices)
+{
+	u32 width = swapchain->width;
+	u32 height = swapchain->height;
+	targets->auxImage = pvkCreateImageWithAllocator(memoryAllocator, 
+										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+										VK_FORMAT_B8G8R8A8_SRGB, width, height, 
+										VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, 
+										queueFamilyCount, queueFamilyIndices);
+	targets->auxAttachment = pvkCreateImageView(device, targets->auxImage.handle, VK_FORMAT_B8G8R8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+	targets->depthImage = pvkCreateImageWithAllocator(memoryAllocator, 
+										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+										VK_FORMAT_D32_SFLOAT, width, height,
+										VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+										queueFamilyCount, queueFamilyIndices);
+	targets->depthAttachment = pvkCreateImageView(device, targets->depthImage.handle, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
+	VkImageView attachments[3 * swapchain->imageCount];
+	for(u32 i = 0; i < swapchain->imageCount; i++)
+	{
+		attachments[3 * i] = swapchain->imageViews[i];
+		attachments[3 * i + 1] = targets->auxAttachment;
+		attachments[3 * i + 2] = targets->depthAttachment;
 	}
+	targets->framebufferCount = swapchain->imageCount;
+	targets->framebuffers = pvkCreateFramebuffers(device, renderPass, width, height, swapchain->imageCount, 3, attachments);
+	targets->shadowMapImage = pvkCreateImageWithAllocator(memoryAllocator,
+												VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+												VK_FORMAT_D32_SFLOAT, width, height,
+												VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+												queueFamilyCount, queueFamilyIndices);
+	targets->shadowMapAttachment = pvkCreateImageView(device, targets->shadowMapImage.handle, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
+	targets->shadowMapFramebuffer = pvkCreateFramebuffers(device, shadowMapRenderPass, width, height, 1, 1, &targets->shadowMapAttachment);
+}
+
+static void destroyRenderTargets(VkDevice device, RenderTargets* targets)
+{
+	pvkDestroyFramebuffers(device, 1, targets->shadowMapFramebuffer);
+	vkDestroyImageView(device, targets->shadowMapAttachment, NULL);
+	pvkDestroyImage(device, targets->shadowMapImage);
+	pvkDestroyFramebuffers(device, targets->framebufferCount, targets->framebuffers);
+	vkDestroyImageView(device, targets->depthAttachment, NULL);
+	pvkDestroyImage(device, targets->depthImage);
+	vkDestroyImageView(device, targets->auxAttachment, NULL);
+	pvkDestroyImage(device, targets->auxImage);
 }
 
 int main()
 {
-	VkInstance instance = pvkCreateVulkanInstanceWithExtensions(2, "VK_KHR_win32_surface", "VK_KHR_surface");
+	/* VK_KHR_get_physical_device_properties2 is needed to query (and enable) the timeline semaphore feature on a 1.0 instance */
+	VkInstance instance = pvkCreateVulkanInstanceWithExtensions(3, "VK_KHR_win32_surface", "VK_KHR_surface", VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 	PvkWindow* window = pvkWindowCreate(800, 800, "Vulkan Multipass Rendering", false, true);
 	VkSurfaceKHR surface = pvkWindowCreateVulkanSurface(window, instance);
 	VkPhysicalDevice physicalGPU = pvkGetPhysicalDevice(instance, surface, 
@@ -362,92 +410,139 @@ int main()
 														VK_PRESENT_MODE_FIFO_KHR, 3, false);
 	uint32_t graphicsQueueFamilyIndex = pvkFindQueueFamilyIndex(physicalGPU, VK_QUEUE_GRAPHICS_BIT);
 	uint32_t presentQueueFamilyIndex = pvkFindQueueFamilyIndexWithPresentSupport(physicalGPU, surface);
+	/* uploads are executed on a dedicated transfer queue if the GPU has one */
+	uint32_t transferQueueFamilyIndex = pvkFindTransferQueueFamilyIndex(physicalGPU);
 	uint32_t queueFamilyIndices[2] = { graphicsQueueFamilyIndex, presentQueueFamilyIndex };
-	VkDevice logicalGPU = pvkCreateLogicalDeviceWithExtensions(instance, 
+	uint32_t deviceQueueFamilyIndices[3] = { graphicsQueueFamilyIndex, presentQueueFamilyIndex, transferQueueFamilyIndex };
+	/* frames are tracked with a timeline semaphore if the GPU supports them, otherwise with fences */
+	bool useTimelineSemaphore = pvkIsTimelineSemaphoreSupported(instance, true, physicalGPU);
+	/* the uniform buffer sets are written with an update template if the GPU supports them, otherwise with vkUpdateDescriptorSets */
+	bool useDescriptorUpdateTemplate = pvkIsDeviceExtensionSupported(physicalGPU, VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+	VkDevice logicalGPU = pvkCreateLogicalDeviceWithExtensions2(instance, 
 																physicalGPU,
-																2, queueFamilyIndices, false,
-																1, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
-	VkQueue graphicsQueue, presentQueue;
+																3, deviceQueueFamilyIndices, false, useTimelineSemaphore,
+																useDescriptorUpdateTemplate ? 2 : 1, VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+	/* multiDrawIndirect and drawIndirectFirstInstance are enabled only if supported, the draw lists have to know which ones are */
+	VkPhysicalDeviceFeatures enabledFeatures = pvkGetLogicalDeviceFeatures(physicalGPU);
+	VkQueue graphicsQueue, presentQueue, transferQueue;
 	vkGetDeviceQueue(logicalGPU, graphicsQueueFamilyIndex, 0, &graphicsQueue);
 	vkGetDeviceQueue(logicalGPU, presentQueueFamilyIndex, 0, &presentQueue);
+	vkGetDeviceQueue(logicalGPU, transferQueueFamilyIndex, 0, &transferQueue);
+
+	/* the compiled pipelines are persisted across launches */
+	PvkPipelineCache* pipelineCache = pvkCreatePipelineCache(physicalGPU, logicalGPU, PIPELINE_CACHE_FILE_PATH);
 
-	VkSwapchainKHR swapchain = pvkCreateSwapchain(logicalGPU, surface, 3, 
+	/* recreated in place on resize, the surface is kept */
+	PvkSwapchain* swapchain = pvkCreateSwapchain2(physicalGPU, logicalGPU, surface, 3, 
 													800, 800, 
 													VK_FORMAT_B8G8R8A8_SRGB, 
 													VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, 
 													VK_PRESENT_MODE_FIFO_KHR,
-													2, queueFamilyIndices, VK_NULL_HANDLE);
+													2, queueFamilyIndices);
 
-	VkCommandPool commandPool = pvkCreateCommandPool(logicalGPU, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, graphicsQueueFamilyIndex);
-	VkCommandBuffer* commandBuffers = pvkAllocateCommandBuffers(logicalGPU, commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	/* command buffers, semaphores, fences and uniform buffers of the frames in flight */
+	PvkTimeline* graphicsTimeline = useTimelineSemaphore ? pvkCreateTimeline(logicalGPU, graphicsQueue) : NULL;
+	PvkFrameContext* frameContext = pvkCreateFrameContext2(physicalGPU, logicalGPU, graphicsQueueFamilyIndex, FRAMES_IN_FLIGHT, FRAME_UNIFORM_BUFFER_SIZE, graphicsTimeline);
+	/* the shadow pass is recorded into its own command buffer per frame slot */
+	VkCommandPool shadowMapCommandPool = pvkCreateCommandPool(logicalGPU, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, graphicsQueueFamilyIndex);
+	VkCommandBuffer* shadowMapCommandBuffers = __pvkAllocateCommandBuffers(logicalGPU, shadowMapCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, FRAMES_IN_FLIGHT);
+	PvkSubmitBatch* submitBatch = pvkCreateSubmitBatch(graphicsQueue);
 
-	VkSemaphore imageAvailableSemaphore = pvkCreateSemaphore(logicalGPU);
-	VkSemaphore renderFinishSemaphore = pvkCreateSemaphore(logicalGPU);
+	/* Device memory for the attachments, sub-allocated from shared blocks */
+	PvkMemoryAllocator* memoryAllocator = pvkCreateMemoryAllocator(physicalGPU, logicalGPU, 0);
 
 	/* Render Pass & Framebuffer attachments */
 	VkRenderPass shadowMapRenderPass = pvkCreateShadowMapRenderPass(logicalGPU);
 	VkRenderPass renderPass = pvkCreateRenderPass2(logicalGPU);
-	VkImageView* swapchainImageViews = pvkCreateSwapchainImageViews(logicalGPU, swapchain, VK_FORMAT_B8G8R8A8_SRGB, NULL);
-	PvkImage auxImage = pvkCreateImage(physicalGPU, logicalGPU, 
-										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-										VK_FORMAT_B8G8R8A8_SRGB, 800, 800, 
-										VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, 
-										2, queueFamilyIndices);
-	VkImageView auxAttachment = pvkCreateImageView(logicalGPU, auxImage.handle, VK_FORMAT_B8G8R8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
-	PvkImage depthImage = pvkCreateImage(physicalGPU, logicalGPU, 
-										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-										VK_FORMAT_D32_SFLOAT, 800, 800,
-										VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-										2, queueFamilyIndices);
-	VkImageView depthAttachment = pvkCreateImageView(logicalGPU, depthImage.handle, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
-	VkImageView attachments[9] = 
-	{
-		swapchainImageViews[0], auxAttachment, depthAttachment,				// framebuffer for swapchain image 0
-		swapchainImageViews[1], auxAttachment, depthAttachment,				// framebuffer for swapchain image 1
-		swapchainImageViews[2], auxAttachment, depthAttachment				// framebuffer for swapchain image 2
-	};
-	VkFramebuffer* framebuffers = pvkCreateFramebuffers(logicalGPU, renderPass, 800, 800, 3, 3, attachments);
-	PvkImage shadowMapImage = pvkCreateImage(physicalGPU, logicalGPU,
-												VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-												VK_FORMAT_D32_SFLOAT, 800, 800,
-												VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-												2, queueFamilyIndices);
+	RenderTargets renderTargets;
+	createRenderTargets(&renderTargets, logicalGPU, memoryAllocator, swapchain, renderPass, shadowMapRenderPass, 2, queueFamilyIndices);
 	VkSampler shadowMapSampler = pvkCreateShadowMapSampler(logicalGPU);
-	VkImageView shadowMapAttachment = pvkCreateImageView(logicalGPU, shadowMapImage.handle, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
-	VkFramebuffer* shadowMapFramebuffer = pvkCreateFramebuffers(logicalGPU, shadowMapRenderPass, 800, 800, 1, 1, &shadowMapAttachment);
-
-	/* Uniform Buffers */
-	PvkBuffer globalUniformBuffer = pvkCreateBuffer(physicalGPU, logicalGPU, 
-													VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-													VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-													sizeof(PvkGlobalData),
-													2, queueFamilyIndices);
-	PvkBuffer objectUniformBuffer = pvkCreateBuffer(physicalGPU, logicalGPU,
-													VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-													VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-													sizeof(PvkObjectData),
-													2, queueFamilyIndices);
 
-	/* Resource Descriptors */
-	VkDescriptorPool descriptorPool = pvkCreateDescriptorPool(logicalGPU, 4, 3, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1,
-																		  	 VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2,
+	/* Graphics Pipeline & Shaders */
+	const char* shaderFilePaths[] = 
+	{
+		/* the geometries use PvkCompactVertex, the .compact.vert variants decode it (the plain ones take PvkVertex) */
+		"shaders/shader.frag.spv", "shaders/shader.compact.vert.spv",
+		"shaders/shader.pass2.frag.spv", "shaders/shader.pass2.compact.vert.spv",
+		"shaders/shadowMapShader.frag.spv", "shaders/shadowMapShader.vert.spv",
+		"shaders/shadowMapShader.instanced.vert.spv"
+	};
+	const uint32_t shaderFileCount = sizeof(shaderFilePaths) / sizeof(shaderFilePaths[0]);
+	PvkShaderCache* shaderCache = pvkCreateShaderCache(logicalGPU);
+	if(!pvkShaderCacheMountArchive(shaderCache, SHADER_ARCHIVE_FILE_PATH))
+	{
+		/* the shaders of this launch are still loaded from their own files */
+		if(pvkWriteShaderArchive(SHADER_ARCHIVE_FILE_PATH, shaderFileCount, shaderFilePaths))
+			PVK_INFO("Shaders packed into \"%s\"", SHADER_ARCHIVE_FILE_PATH);
+	}
+	VkShaderModule fragmentShader = pvkShaderCacheGet(shaderCache, shaderFilePaths[0]);
+	VkShaderModule vertexShader = pvkShaderCacheGet(shaderCache, shaderFilePaths[1]);
+
+	VkShaderModule fragmentShaderPass2 = pvkShaderCacheGet(shaderCache, shaderFilePaths[2]);
+	VkShaderModule vertexShaderPass2 = pvkShaderCacheGet(shaderCache, shaderFilePaths[3]);
+
+	VkShaderModule shadowMapVertexShader = pvkShaderCacheGet(shaderCache, shaderFilePaths[5]);
+	VkShaderModule crowdVertexShader = pvkShaderCacheGet(shaderCache, shaderFilePaths[6]);
+	PVK_INFO("Shader modules: %u created, %u file opens", shaderCache->moduleCount, shaderCache->fileOpenCount);
+	/* the .spv files have been rebuilt without the makefile removing the archive, the next launch gets the new ones */
+	if((shaderCache->staleArchiveEntryCount != 0) && pvkWriteShaderArchive(SHADER_ARCHIVE_FILE_PATH, shaderFileCount, shaderFilePaths))
+		PVK_INFO("Shaders packed again into \"%s\"", SHADER_ARCHIVE_FILE_PATH);
+
+	/* the layouts are reflected from the shaders, the uniform buffers and the shadow map are visible to both the stages
+	 * so that all the pipelines get the same set layouts for them, PvkObjectData is a push constant range of the vertex stage
+	 * and PvkGlobalData is a dynamic uniform buffer in the frame's uniform arena */
+	PvkLayoutCache* layoutCache = pvkCreateLayoutCache(logicalGPU);
+	VkShaderStageFlags descriptorStageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	VkDescriptorSetLayout pipelineSetLayouts[PVK_PIPELINE_LAYOUT_MAX_SETS];
+	VkDescriptorSetLayout pipelineSetLayouts2[PVK_PIPELINE_LAYOUT_MAX_SETS];
+	VkPipelineLayout pipelineLayout = pvkLayoutCacheGetReflectedPipelineLayout2(layoutCache, 2, 
+		(const PvkShaderReflection*[]) { pvkShaderCacheGetReflection(shaderCache, shaderFilePaths[0]), pvkShaderCacheGetReflection(shaderCache, shaderFilePaths[1]) },
+		descriptorStageFlags, 1 << 0, NULL, pipelineSetLayouts);
+	VkPipelineLayout pipelineLayout2 = pvkLayoutCacheGetReflectedPipelineLayout2(layoutCache, 2, 
+		(const PvkShaderReflection*[]) { pvkShaderCacheGetReflection(shaderCache, shaderFilePaths[2]), pvkShaderCacheGetReflection(shaderCache, shaderFilePaths[3]) },
+		descriptorStageFlags, 1 << 1, NULL, pipelineSetLayouts2);
+	VkPipelineLayout shadowMapPipelineLayout = pvkLayoutCacheGetReflectedPipelineLayout2(layoutCache, 1, 
+		(const PvkShaderReflection*[]) { pvkShaderCacheGetReflection(shaderCache, shaderFilePaths[5]) },
+		descriptorStageFlags, 1 << 0, NULL, NULL);
+	/* same global set layout as the shadow map pipeline, but no push constant range */
+	VkPipelineLayout crowdPipelineLayout = pvkLayoutCacheGetReflectedPipelineLayout2(layoutCache, 1, 
+		(const PvkShaderReflection*[]) { pvkShaderCacheGetReflection(shaderCache, shaderFilePaths[6]) },
+		descriptorStageFlags, 1 << 0, NULL, NULL);
+	PVK_INFO("Layouts: %u set layouts, %u pipeline layouts, %u shared", layoutCache->setLayoutCount, layoutCache->pipelineLayoutCount, layoutCache->hitCount);
+
+	/* Resource Descriptors, the uniform buffer set of each frame slot points to the slot's uniform arena
+	 * and is written once, the frames only change its dynamic offset */
+	VkDescriptorPool descriptorPool = pvkCreateDescriptorPool(logicalGPU, 2 + FRAMES_IN_FLIGHT, 3, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1,
+																		  	 VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, FRAMES_IN_FLIGHT,
 																		  	 VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1);
-	VkDescriptorSetLayout setLayouts[4] = 
+	VkDescriptorSetLayout setLayouts[3] = 
 	{ 
-		pvkCreateDescriptorSetLayout(logicalGPU),				// input_attachment (binding = 0)
-		pvkCreateGlobalDescriptorSetLayout(logicalGPU),			// uniform buffer (PvkGlobalData) (binding = 1)
-		pvkCreateObjectSetLayout(logicalGPU),					// uniform buffer (PvkObjectData) (binding = 2)
-		pvkCreateShadowMapDescriptorSetLayout(logicalGPU) 		// shadow map sampler (binding = 3)
+		pipelineSetLayouts2[0],				// input_attachment (binding = 0)
+		pipelineSetLayouts[0],				// uniform buffer (PvkGlobalData) (binding = 1)
+		pipelineSetLayouts[1] 				// shadow map sampler (binding = 3)
 	};
-	VkDescriptorSet* set = pvkAllocateDescriptorSets(logicalGPU, descriptorPool, 4, setLayouts);
-	pvkWriteImageViewToDescriptor(logicalGPU, set[0], 0, auxAttachment, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
-	pvkWriteBufferToDescriptor(logicalGPU, set[1], 1, globalUniformBuffer.handle, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-	pvkWriteBufferToDescriptor(logicalGPU, set[2], 2, objectUniformBuffer.handle, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-	pvkWriteImageViewToDescriptor(logicalGPU, set[3], 3, shadowMapAttachment, shadowMapSampler, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	/* set[0]: input attachment, set[1]: shadow map sampler */
+	VkDescriptorSet* set = pvkAllocateDescriptorSets(logicalGPU, descriptorPool, 2, (VkDescriptorSetLayout[]) { setLayouts[0], setLayouts[2] });
+	VkDescriptorSetLayout globalSetLayouts[FRAMES_IN_FLIGHT];
+	for(int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		globalSetLayouts[i] = setLayouts[1];
+	VkDescriptorSet* globalSets = pvkAllocateDescriptorSets(logicalGPU, descriptorPool, FRAMES_IN_FLIGHT, globalSetLayouts);
+	PvkDescriptorWriter descriptorWriter;
+	pvkDescriptorWriterBegin(&descriptorWriter, logicalGPU);
+	pvkDescriptorWriterWriteImageView(&descriptorWriter, set[0], 0, renderTargets.auxAttachment, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
+	pvkDescriptorWriterWriteImageView(&descriptorWriter, set[1], 3, renderTargets.shadowMapAttachment, shadowMapSampler, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	pvkDescriptorWriterFlush(&descriptorWriter);
+	PvkDescriptorTemplate* globalDataTemplate = pvkCreateDescriptorTemplate(logicalGPU, useDescriptorUpdateTemplate, setLayouts[1], 1, 
+		(VkDescriptorSetLayoutBinding[]) { { .binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = 1 } });
+	for(int i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		PvkDescriptorInfo globalDataInfo = { };
+		globalDataInfo.buffer = (VkDescriptorBufferInfo) { frameContext->frames[i].uniformArena->buffer.handle, 0, sizeof(PvkGlobalData) };
+		pvkUpdateDescriptorSetWithTemplate(globalDataTemplate, globalSets[i], &globalDataInfo);
+	}
 
 	PvkCamera* camera = pvkCreateCamera((float)window->width / window->height, PVK_PROJECTION_TYPE_PERSPECTIVE, 65 DEG);	
 	PvkGlobalData* globalData = PVK_NEW(PvkGlobalData);
-	PvkObjectData* objectData = PVK_NEW(PvkObjectData);
 	globalData->projectionMatrix = pvkMat4Transpose(camera->projection);
 	globalData->viewMatrix = pvkMat4Transpose(camera->view);
 	globalData->dirLight.dir = pvkVec3Normalize((PvkVec3) { 1, -1, 0 });
@@ -457,35 +552,71 @@ int main()
 	globalData->lightViewMatrix = pvkMat4Transpose(pvkMat4Inverse(pvkMat4Mul(pvkMat4Translate((PvkVec3) { -4.0f, 4.0f, 0 }), pvkMat4Rotate((PvkVec3) { -20 DEG, -90 DEG, 0 }))));
 	globalData->ambLight.color = (PvkVec3) { 0.3f, 0.3f, 0.3f };
 	globalData->ambLight.intensity = 1.0f;
-	objectData->modelMatrix = pvkMat4Transpose(pvkMat4Rotate((PvkVec3) { 0 DEG, 0, 0 }));
-	objectData->normalMatrix = pvkMat4Inverse(objectData->modelMatrix);
-	pvkUploadToMemory(logicalGPU, globalUniformBuffer.memory, globalData, sizeof(PvkGlobalData));
-	pvkUploadToMemory(logicalGPU, objectUniformBuffer.memory, objectData, sizeof(PvkObjectData));
-	PVK_DELETE(globalData);
-
-	/* Graphics Pipeline & Shaders */
-	VkShaderModule fragmentShader = pvkCreateShaderModule(logicalGPU, "shaders/shader.frag.spv");
-	VkShaderModule vertexShader = pvkCreateShaderModule(logicalGPU, "shaders/shader.vert.spv");
-
-	VkShaderModule fragmentShaderPass2 = pvkCreateShaderModule(logicalGPU, "shaders/shader.pass2.frag.spv");
-	VkShaderModule vertexShaderPass2 = pvkCreateShaderModule(logicalGPU, "shaders/shader.pass2.vert.spv");
-
-	VkShaderModule shadowMapFragmentShader = pvkCreateShaderModule(logicalGPU, "shaders/shadowMapShader.frag.spv");
-	VkShaderModule shadowMapVertexShader = pvkCreateShaderModule(logicalGPU, "shaders/shadowMapShader.vert.spv");
-
-	VkPipelineLayout pipelineLayout = pvkCreatePipelineLayout(logicalGPU, 3, &setLayouts[1]);
-	VkPipelineLayout pipelineLayout2 = pvkCreatePipelineLayout(logicalGPU, 3, &setLayouts[0]);
-	VkPipelineLayout shadowMapPipelineLayout = pvkCreatePipelineLayout(logicalGPU, 2, &setLayouts[1]);
-	VkPipeline pipeline = pvkCreateGraphicsPipeline(logicalGPU, pipelineLayout, renderPass, 0, 1, 800, 800, 2,
-													(PvkShader) { fragmentShader, PVK_SHADER_TYPE_FRAGMENT },
-													(PvkShader) { vertexShader, PVK_SHADER_TYPE_VERTEX });
-	VkPipeline pipeline2 = pvkCreateGraphicsPipeline(logicalGPU, pipelineLayout2, renderPass, 1, 1, 800, 800, 2,
-													(PvkShader) { fragmentShaderPass2, PVK_SHADER_TYPE_FRAGMENT },
-													(PvkShader) { vertexShaderPass2, PVK_SHADER_TYPE_VERTEX });
-	VkPipeline shadowMapPipeline = pvkCreateShadowMapGraphicsPipeline(logicalGPU, shadowMapPipelineLayout, shadowMapRenderPass, 0, 800, 800, 1,
-													(PvkShader) { shadowMapVertexShader, PVK_SHADER_TYPE_VERTEX });
-	PvkGeometry* planeGeometry = pvkCreatePlaneGeometry(physicalGPU, logicalGPU, 2, queueFamilyIndices, 6);
-	PvkGeometry* boxGeometry = pvkCreateBoxGeometry(physicalGPU, logicalGPU, 2, queueFamilyIndices, 3);
+	/* pushed with each draw, the plane stays in place and the box spins */
+	PvkObjectData planeData, boxData;
+	planeData.modelMatrix = pvkMat4Transpose(pvkMat4Rotate((PvkVec3) { 0 DEG, 0, 0 }));
+	planeData.normalMatrix = pvkMat4Inverse(planeData.modelMatrix);
+	boxData = planeData;
+	/* the instances of the crowd, written by the CPU each frame into the buffer of the frame slot */
+	PvkBuffer crowdInstanceBuffers[FRAMES_IN_FLIGHT];
+	for(int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		crowdInstanceBuffers[i] = pvkCreateBuffer(physicalGPU, logicalGPU, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+													VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, PVK_INSTANCE_SIZE * CROWD_SIZE, 1, &graphicsQueueFamilyIndex);
+	/* refilled each frame as well, so one list per frame slot */
+	PvkDrawList* postDrawLists[FRAMES_IN_FLIGHT];
+	for(int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		postDrawLists[i] = pvkCreateDrawList(physicalGPU, logicalGPU, &enabledFeatures, POST_COUNT, 1, &graphicsQueueFamilyIndex);
+#ifdef UPLOAD_BENCHMARK
+	runUploadBenchmark(physicalGPU, logicalGPU, &frameContext->frames[0].uniformArena->buffer, &boxData, sizeof(PvkObjectData));
+#endif
+
+	/* compiled on the worker threads while the geometry is being uploaded below,
+	 * the viewport and scissor are set when the render passes begin, so the pipelines survive resizes */
+	/* owns the pipelines, a later request for an identical description returns the same pipeline instead of compiling it again */
+	PvkPipelineRegistry* pipelineRegistry = pvkCreatePipelineRegistry(logicalGPU, pipelineCache->handle);
+	PvkPipelineBuilder* pipelineBuilder = pvkCreatePipelineBuilder2(logicalGPU, pipelineCache->handle, 0, pipelineRegistry);
+	PvkGraphicsPipelineDesc pipelineDescs[5] = 
+	{
+		pvkGetGraphicsPipelineDesc(pipelineLayout, renderPass, 0, 1, PVK_DYNAMIC_EXTENT, PVK_DYNAMIC_EXTENT, 2,
+			(PvkShader[]) { { fragmentShader, PVK_SHADER_TYPE_FRAGMENT }, { vertexShader, PVK_SHADER_TYPE_VERTEX } }),
+		pvkGetGraphicsPipelineDesc(pipelineLayout2, renderPass, 1, 1, PVK_DYNAMIC_EXTENT, PVK_DYNAMIC_EXTENT, 2,
+			(PvkShader[]) { { fragmentShaderPass2, PVK_SHADER_TYPE_FRAGMENT }, { vertexShaderPass2, PVK_SHADER_TYPE_VERTEX } }),
+		pvkGetShadowMapGraphicsPipelineDesc(shadowMapPipelineLayout, shadowMapRenderPass, 0, PVK_DYNAMIC_EXTENT, PVK_DYNAMIC_EXTENT, 1,
+			(PvkShader[]) { { shadowMapVertexShader, PVK_SHADER_TYPE_VERTEX } }),
+		pvkGetShadowMapGraphicsPipelineDesc(crowdPipelineLayout, shadowMapRenderPass, 0, PVK_DYNAMIC_EXTENT, PVK_DYNAMIC_EXTENT, 1,
+			(PvkShader[]) { { crowdVertexShader, PVK_SHADER_TYPE_VERTEX } }),
+		pvkGetShadowMapGraphicsPipelineDesc(crowdPipelineLayout, shadowMapRenderPass, 0, PVK_DYNAMIC_EXTENT, PVK_DYNAMIC_EXTENT, 1,
+			(PvkShader[]) { { crowdVertexShader, PVK_SHADER_TYPE_VERTEX } })
+	};
+	/* 24 bytes per vertex for the color passes, and the shadow map pass fetches only the 12 bytes of the position stream */
+	PvkVertexFormatFlags vertexFormat = PVK_VERTEX_FORMAT_COMPACT_BIT | PVK_VERTEX_FORMAT_POSITION_STREAM_BIT;
+	pvkGraphicsPipelineDescSetVertexFormat(&pipelineDescs[0], vertexFormat, false);
+	pvkGraphicsPipelineDescSetVertexFormat(&pipelineDescs[1], vertexFormat, false);
+	pvkGraphicsPipelineDescSetVertexFormat(&pipelineDescs[2], vertexFormat, true);
+	/* pvkDrawGeometryInstanced binds the interleaved vertices, so the crowd reads the position with the stride of the whole vertex */
+	pvkGraphicsPipelineDescSetVertexFormat(&pipelineDescs[3], vertexFormat & ~PVK_VERTEX_FORMAT_POSITION_STREAM_BIT, true);
+	pvkGraphicsPipelineDescAddInstanceLayout(&pipelineDescs[3]);
+	/* the posts are drawn with pvkDrawListRecord2(..., positionsOnly = true), so they fetch the position stream */
+	pvkGraphicsPipelineDescSetVertexFormat(&pipelineDescs[4], vertexFormat, true);
+	pvkGraphicsPipelineDescAddInstanceLayout(&pipelineDescs[4]);
+	for(int i = 3; i < 5; i++)
+		if(!pvkGraphicsPipelineDescCheckVertexInputs(&pipelineDescs[i], pvkShaderCacheGetReflection(shaderCache, shaderFilePaths[6])))
+			PVK_FETAL_ERROR("The instanced shadow map pipeline %d doesn't match the inputs of \"%s\"", i, shaderFilePaths[6]);
+	PvkPipelineBuild* pipelineBuilds[5];
+	uint64_t pipelineStartTime = pvkGetTimeNs();
+	pvkPipelineBuilderSubmit(pipelineBuilder, 5, pipelineDescs, pipelineBuilds);
+
+	/* Geometry, uploaded into device local memory through the staging ring on the transfer queue,
+	 * the ownership of the buffers is then transferred to the graphics queue family */
+	PvkStagingRing* stagingRing = pvkCreateStagingRing2(physicalGPU, logicalGPU, transferQueue, transferQueueFamilyIndex, 
+														graphicsQueue, graphicsQueueFamilyIndex, 4 * 1024 * 1024);
+	uint64_t uploadStartTime = pvkGetTimeNs();
+	PvkGeometryPool* geometryPool = pvkCreateGeometryPool(physicalGPU, logicalGPU, 2, queueFamilyIndices, stagingRing, vertexFormat, 0, 0);
+	/* both geometries share the pool's vertex and index buffers */
+	PvkGeometry* planeGeometry = pvkCreatePlaneGeometryWithPool(geometryPool, 6);
+	PvkGeometry* boxGeometry = pvkCreateBoxGeometryWithPool(geometryPool, 3);
+	/* both geometries are uploaded with a single submission */
+	PvkUploadTicket geometryUploadTicket = pvkStagingRingFlush(stagingRing);
 
 	VkClearValue* clearValues = PVK_NEWV(VkClearValue, 3);
 	for(int i = 0; i < 2; i++)
@@ -497,323 +628,195 @@ int main()
 	}
 	clearValues[2].depthStencil.depth = 1;
 
-	/* Command buffer recording */
-	recordCommandBuffers(800, 800, commandBuffers,
-								clearValues,
-								renderPass, 
-								shadowMapRenderPass, 
-								shadowMapFramebuffer,
-								framebuffers,
-								shadowMapPipeline,
-								pipeline,
-								pipeline2,
-								shadowMapPipelineLayout,
-								pipelineLayout,
-								pipelineLayout2,
-								set,
-								planeGeometry,
-								boxGeometry);
-
-	PvkSemaphoreCircularPool* semaphorePool = pvkCreateSemaphoreCircularPool(logicalGPU, 6);
-	PvkFencePool* fencePool = pvkCreateFencePool(logicalGPU, 3);
+	pvkMemoryAllocatorLogStats(memoryAllocator);
+
+	/* the frames draw the geometry, the rest of the initialization above overlaps with the uploads */
+	pvkStagingRingWait(stagingRing, geometryUploadTicket);
+	PVK_INFO("Geometry uploaded in %.2f ms", (double)(pvkGetTimeNs() - uploadStartTime) / 1000000.0);
+
+	VkPipeline pipeline = pvkPipelineBuildWait(pipelineBuilder, pipelineBuilds[0]);
+	VkPipeline pipeline2 = pvkPipelineBuildWait(pipelineBuilder, pipelineBuilds[1]);
+	VkPipeline shadowMapPipeline = pvkPipelineBuildWait(pipelineBuilder, pipelineBuilds[2]);
+	VkPipeline crowdPipeline = pvkPipelineBuildWait(pipelineBuilder, pipelineBuilds[3]);
+	VkPipeline postPipeline = pvkPipelineBuildWait(pipelineBuilder, pipelineBuilds[4]);
+	/* from the submission to the completion of the last build, the geometry upload above overlaps with it and isn't counted */
+	uint64_t pipelineTime = pipelineBuilder->lastDoneTime - pipelineStartTime;
+	/* compare the first launch (cold) against the next ones (warm) */
+	PVK_INFO("Pipelines created in %.2f ms on %u threads (%s pipeline cache)", (double)pipelineTime / 1000000.0, 
+				pipelineBuilder->threadCount, pipelineCache->isWarm ? "warm" : "cold");
+	pvkDestroyPipelineBuilder(pipelineBuilder);
 
 	float angle = 0;
 	/* Rendering & Presentation */
 	while(!pvkWindowShouldClose(window))
 	{
-		VkFence fence;
-		if(!pvkFencePoolAcquire(logicalGPU, fencePool, &fence))
+		/* a minimized window has a 0 x 0 extent, nothing can be rendered (nor the swapchain recreated) until it is restored */
+		if((window->width == 0) || (window->height == 0))
 		{
-			pvkWindowPollEvents(window);
+			pvkWindowWaitEvents(window);
 			continue;
 		}
-		uint32_t semaphoreIndex;
-		VkSemaphore imageAvailableSemaphore = pvkSemaphoreCircularPoolAcquire(semaphorePool, &semaphoreIndex);
+
+		/* waits until the GPU is done with this frame slot, the frames recorded after it may still be executing */
+		PvkFrame* frame = pvkFrameContextBegin(frameContext);
 		uint32_t index;
-		while(!pvkAcquireNextImageKHR(logicalGPU, swapchain, UINT64_MAX, imageAvailableSemaphore, fence, &index))
+		bool isImageAcquired = pvkAcquireNextImageKHR(logicalGPU, swapchain->handle, UINT64_MAX, frame->imageAvailableSemaphore, VK_NULL_HANDLE, &index);
+		bool isSwapchainOutOfDate = !isImageAcquired;
+		if(isImageAcquired)
 		{
-			PVK_CHECK(vkDeviceWaitIdle(logicalGPU));
-			vkDestroyPipeline(logicalGPU, shadowMapPipeline, NULL);
-			vkDestroyPipeline(logicalGPU, pipeline2, NULL);
-			vkDestroyPipeline(logicalGPU, pipeline, NULL);
-			pvkDestroyFramebuffers(logicalGPU, 1, shadowMapFramebuffer);
-			PVK_DELETE(shadowMapFramebuffer);
-			vkDestroyImageView(logicalGPU, shadowMapAttachment, NULL);
-			pvkDestroyImage(logicalGPU, shadowMapImage);
-			pvkDestroyFramebuffers(logicalGPU, 3, framebuffers);
-			PVK_DELETE(framebuffers);
-			vkDestroyImageView(logicalGPU, depthAttachment, NULL);
-			pvkDestroyImage(logicalGPU, depthImage);
-			vkDestroyImageView(logicalGPU, auxAttachment, NULL);
-			pvkDestroyImage(logicalGPU, auxImage);
-			pvkDestroySwapchainImageViews(logicalGPU, swapchain, swapchainImageViews);
-			vkDestroySwapchainKHR(logicalGPU, swapchain, NULL);
-			vkDestroySurfaceKHR(instance, surface, NULL);
-
-			imageAvailableSemaphore = pvkSemaphoreCircularPoolRecreate(logicalGPU, semaphorePool, semaphoreIndex);
-			pvkResetFences(logicalGPU, 1, &fence);
-
-			surface = pvkWindowCreateVulkanSurface(window, instance);
-			swapchain = pvkCreateSwapchain(logicalGPU, surface, 3, 
-													window->width, window->height, 
-													VK_FORMAT_B8G8R8A8_SRGB, 
-													VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, 
-													VK_PRESENT_MODE_FIFO_KHR,
-													2, queueFamilyIndices, VK_NULL_HANDLE);
-			swapchainImageViews = pvkCreateSwapchainImageViews(logicalGPU, swapchain, VK_FORMAT_B8G8R8A8_SRGB, NULL);
-
-			auxImage = pvkCreateImage(physicalGPU, logicalGPU, 
-										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-										VK_FORMAT_B8G8R8A8_SRGB, window->width, window->height, 
-										VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, 
-										2, queueFamilyIndices);
-			auxAttachment = pvkCreateImageView(logicalGPU, auxImage.handle, VK_FORMAT_B8G8R8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
-			
-			depthImage = pvkCreateImage(physicalGPU, logicalGPU, 
-										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-										VK_FORMAT_D32_SFLOAT, window->width, window->height,
-										VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-										2, queueFamilyIndices);
-			depthAttachment = pvkCreateImageView(logicalGPU, depthImage.handle, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
-			
-			attachments[0] = swapchainImageViews[0];
-			attachments[1] = auxAttachment;
-			attachments[2] = depthAttachment;				// framebuffer for swapchain image 0
-			attachments[3] = swapchainImageViews[1];
-			attachments[4] = auxAttachment;
-			attachments[5] = depthAttachment;				// framebuffer for swapchain image 1
-			attachments[6] = swapchainImageViews[2];
-			attachments[7] = auxAttachment;
-			attachments[8] = depthAttachment;				// framebuffer for swapchain image 2
-			framebuffers = pvkCreateFramebuffers(logicalGPU, renderPass, window->width, window->height, 3, 3, attachments);
-
-			shadowMapImage = pvkCreateImage(physicalGPU, logicalGPU,
-												VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-												VK_FORMAT_D32_SFLOAT, window->width, window->height,
-												VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-												2, queueFamilyIndices);
-			shadowMapAttachment = pvkCreateImageView(logicalGPU, shadowMapImage.handle, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
-			shadowMapFramebuffer = pvkCreateFramebuffers(logicalGPU, shadowMapRenderPass, window->width, window->height, 1, 1, &shadowMapAttachment);
-
-			pipeline = pvkCreateGraphicsPipeline(logicalGPU, pipelineLayout, renderPass, 0, 1, window->width, window->height, 2,
-													(PvkShader) { fragmentShader, PVK_SHADER_TYPE_FRAGMENT },
-													(PvkShader) { vertexShader, PVK_SHADER_TYPE_VERTEX });
-			pipeline2 = pvkCreateGraphicsPipeline(logicalGPU, pipelineLayout2, renderPass, 1, 1, window->width, window->height, 2,
-													(PvkShader) { fragmentShaderPass2, PVK_SHADER_TYPE_FRAGMENT },
-													(PvkShader) { vertexShaderPass2, PVK_SHADER_TYPE_VERTEX });
-			shadowMapPipeline = pvkCreateShadowMapGraphicsPipeline(logicalGPU, shadowMapPipelineLayout, shadowMapRenderPass, 0, window->width, window->height, 1,
-													(PvkShader) { shadowMapVertexShader, PVK_SHADER_TYPE_VERTEX });
-
-			PVK_DELETE(camera);
-			camera = pvkCreateCamera((float)window->width / window->height, PVK_PROJECTION_TYPE_PERSPECTIVE, 65 DEG);	
-			PvkGlobalData* globalData = PVK_NEW(PvkGlobalData);
-			globalData->projectionMatrix = pvkMat4Transpose(camera->projection);
-			globalData->viewMatrix = pvkMat4Transpose(camera->view);
-			globalData->dirLight.dir = pvkVec3Normalize((PvkVec3) { 1, -1, 0 });
-			globalData->dirLight.intensity = 1.0f;
-			globalData->dirLight.color = (PvkVec3) { 1, 1, 1 };
-			globalData->lightProjectionMatrix = pvkMat4Transpose(pvkMat4OrthoProj(10, 1, 1, 20));
-			globalData->lightViewMatrix = pvkMat4Transpose(pvkMat4Inverse(pvkMat4Mul(pvkMat4Translate((PvkVec3) { -4.0f, 4.0f, 0 }), pvkMat4Rotate((PvkVec3) { -20 DEG, -90 DEG, 0 }))));
-			globalData->ambLight.color = (PvkVec3) { 0.3f, 0.3f, 0.3f };
-			globalData->ambLight.intensity = 1.0f;
-			objectData->modelMatrix = pvkMat4Transpose(pvkMat4Rotate((PvkVec3) { 0 DEG, 0, 0 }));
-			objectData->normalMatrix = pvkMat4Inverse(objectData->modelMatrix);
-			pvkUploadToMemory(logicalGPU, globalUniformBuffer.memory, globalData, sizeof(PvkGlobalData));
-			pvkUploadToMemory(logicalGPU, objectUniformBuffer.memory, objectData, sizeof(PvkObjectData));
-			PVK_DELETE(globalData);
-
-			pvkWriteImageViewToDescriptor(logicalGPU, set[0], 0, auxAttachment, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
-			pvkWriteImageViewToDescriptor(logicalGPU, set[3], 3, shadowMapAttachment, shadowMapSampler, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-
-			recordCommandBuffers(window->width, window->height, commandBuffers,
-								clearValues,
-								renderPass, 
-								shadowMapRenderPass, 
-								shadowMapFramebuffer,
-								framebuffers,
-								shadowMapPipeline,
-								pipeline,
-								pipeline2,
-								shadowMapPipelineLayout,
-								pipelineLayout,
-								pipelineLayout2,
-								set,
-								planeGeometry,
-								boxGeometry);
+			angle += 0.1f DEG;
+			boxData.modelMatrix = pvkMat4Transpose(pvkMat4Transform((PvkVec3) { 0, 0, 0 }, (PvkVec3) { 0, angle, 0 }));
+			boxData.normalMatrix = pvkMat4Inverse(boxData.modelMatrix);
+			/* the GPU is done with the previous frame of this slot, so its instance buffer can be overwritten */
+			PvkInstance* crowd = (PvkInstance*)crowdInstanceBuffers[frame->index].mappedData;
+			for(int i = 0; i < CROWD_SIZE; i++)
+			{
+				float crowdAngle = angle * 4 + i * (360 DEG / CROWD_SIZE);
+				PvkMat4 modelMatrix = pvkMat4Mul(pvkMat4Transform((PvkVec3) { 2.4f * cosf(crowdAngle), 0.45f, 2.4f * sinf(crowdAngle) }, (PvkVec3) { 0, -crowdAngle, 0 }), 
+													pvkMat4Scale((PvkVec3) { 0.3f, 0.3f, 0.3f }));
+				crowd[i].modelMatrix = pvkMat4Transpose(modelMatrix);
+				crowd[i].color = (PvkVec4) { 1, 1, 1, 1 };
+			}
+			/* the boxes and the panels come from the same geometry pool chunk, so they end up in a single batch */
+			PvkDrawList* postDrawList = postDrawLists[frame->index];
+			pvkDrawListReset(postDrawList);
+			for(int i = 0; i < POST_COUNT; i++)
+			{
+				float postAngle = (i + 0.5f) * (360 DEG / POST_COUNT);
+				PvkVec3 position = { 2.6f * cosf(postAngle), 0.45f, 2.6f * sinf(postAngle) };
+				PvkInstance post = { };
+				post.color = (PvkVec4) { 1, 1, 1, 1 };
+				if(i % 2)
+				{
+					/* a panel tilted towards the light (back faces are culled in the shadow pass too), rocking back and forth */
+					PvkMat4 modelMatrix = pvkMat4Mul(pvkMat4Transform(position, (PvkVec3) { 0, 0, 60 DEG + 0.3f * sinf(angle * 8) }), 
+														pvkMat4Scale((PvkVec3) { 0.15f, 0.15f, 0.15f }));
+					post.modelMatrix = pvkMat4Transpose(modelMatrix);
+					pvkDrawListAdd(postDrawList, planeGeometry, &post);
+				}
+				else
+				{
+					PvkMat4 modelMatrix = pvkMat4Mul(pvkMat4Transform(position, (PvkVec3) { 0, -postAngle, 0 }), pvkMat4Scale((PvkVec3) { 0.3f, 0.3f, 0.3f }));
+					post.modelMatrix = pvkMat4Transpose(modelMatrix);
+					pvkDrawListAdd(postDrawList, boxGeometry, &post);
+				}
+			}
+
+			/* the uniform data of this frame, the frames still in flight read their own copies */
+			uint32_t globalDataOffset = pvkFrameUploadUniform(frame, globalData, sizeof(PvkGlobalData));
+			VkDescriptorSet frameSet[3] = { set[0], globalSets[frame->index], set[1] };
+
+			recordShadowMapCommandBuffer(swapchain->width, swapchain->height, shadowMapCommandBuffers[frame->index],
+									shadowMapRenderPass, 
+									renderTargets.shadowMapFramebuffer[0],
+									shadowMapPipeline,
+									shadowMapPipelineLayout,
+									frameSet,
+									globalDataOffset,
+									planeGeometry,
+									boxGeometry,
+									&planeData,
+									&boxData,
+									crowdPipeline,
+									crowdPipelineLayout,
+									crowdInstanceBuffers[frame->index].handle,
+									postPipeline,
+									postDrawList);
+			recordCommandBuffer(swapchain->width, swapchain->height, frame->commandBuffer,
+									clearValues,
+									renderPass, 
+									renderTargets.framebuffers[index],
+									pipeline,
+									pipeline2,
+									pipelineLayout,
+									pipelineLayout2,
+									frameSet,
+									globalDataOffset,
+									planeGeometry,
+									boxGeometry,
+									&planeData,
+									&boxData);
+
+			// execute commands, the shadow pass doesn't wait for the swapchain image and both go with one vkQueueSubmit
+			pvkSubmitBatchAddCommandBuffer(submitBatch, shadowMapCommandBuffers[frame->index]);
+			pvkFrameContextSubmitBatch(frameContext, frame, submitBatch, swapchain->renderFinishSemaphores[index]);
+
+			// present the output image
+			isSwapchainOutOfDate = !pvkPresent(index, swapchain->handle, presentQueue, 1, &swapchain->renderFinishSemaphores[index]);
 		}
 
-		angle += 0.1f DEG;
-		objectData->modelMatrix = pvkMat4Transpose(pvkMat4Transform((PvkVec3) { 0, 0, 0 }, (PvkVec3) { 0, angle, 0 }));
-		objectData->normalMatrix = pvkMat4Inverse(objectData->modelMatrix);
-		pvkUploadToMemory(logicalGPU, objectUniformBuffer.memory, objectData, sizeof(PvkObjectData));
-		
-		VkSemaphore renderFinishSemaphore = pvkSemaphoreCircularPoolAcquire(semaphorePool, NULL);
-		// execute commands
-		pvkSubmit(commandBuffers[index], graphicsQueue, imageAvailableSemaphore, renderFinishSemaphore, VK_NULL_HANDLE);
-
-		// present the output image
-		if(!pvkPresent(index, swapchain, presentQueue, 1, &renderFinishSemaphore))
+		if(isSwapchainOutOfDate)
 		{
-			PVK_CHECK(vkDeviceWaitIdle(logicalGPU));
-			vkDestroyPipeline(logicalGPU, shadowMapPipeline, NULL);
-			vkDestroyPipeline(logicalGPU, pipeline2, NULL);
-			vkDestroyPipeline(logicalGPU, pipeline, NULL);
-			pvkDestroyFramebuffers(logicalGPU, 1, shadowMapFramebuffer);
-			PVK_DELETE(shadowMapFramebuffer);
-			vkDestroyImageView(logicalGPU, shadowMapAttachment, NULL);
-			pvkDestroyImage(logicalGPU, shadowMapImage);
-			pvkDestroyFramebuffers(logicalGPU, 3, framebuffers);
-			PVK_DELETE(framebuffers);
-			vkDestroyImageView(logicalGPU, depthAttachment, NULL);
-			pvkDestroyImage(logicalGPU, depthImage);
-			vkDestroyImageView(logicalGPU, auxAttachment, NULL);
-			pvkDestroyImage(logicalGPU, auxImage);
-			pvkDestroySwapchainImageViews(logicalGPU, swapchain, swapchainImageViews);
-			vkDestroySwapchainKHR(logicalGPU, swapchain, NULL);
-			vkDestroySurfaceKHR(instance, surface, NULL);
-
-			// pvkSemaphoreCircularPoolReset(semaphorePool);
-
-			surface = pvkWindowCreateVulkanSurface(window, instance);
-			swapchain = pvkCreateSwapchain(logicalGPU, surface, 3, 
-													window->width, window->height, 
-													VK_FORMAT_B8G8R8A8_SRGB, 
-													VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, 
-													VK_PRESENT_MODE_FIFO_KHR,
-													2, queueFamilyIndices, VK_NULL_HANDLE);
-			swapchainImageViews = pvkCreateSwapchainImageViews(logicalGPU, swapchain, VK_FORMAT_B8G8R8A8_SRGB, NULL);
-
-			auxImage = pvkCreateImage(physicalGPU, logicalGPU, 
-										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-										VK_FORMAT_B8G8R8A8_SRGB, window->width, window->height, 
-										VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, 
-										2, queueFamilyIndices);
-			auxAttachment = pvkCreateImageView(logicalGPU, auxImage.handle, VK_FORMAT_B8G8R8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
-			
-			depthImage = pvkCreateImage(physicalGPU, logicalGPU, 
-										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-										VK_FORMAT_D32_SFLOAT, window->width, window->height,
-										VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-										2, queueFamilyIndices);
-			depthAttachment = pvkCreateImageView(logicalGPU, depthImage.handle, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
-			
-			attachments[0] = swapchainImageViews[0];
-			attachments[1] = auxAttachment;
-			attachments[2] = depthAttachment;				// framebuffer for swapchain image 0
-			attachments[3] = swapchainImageViews[1];
-			attachments[4] = auxAttachment;
-			attachments[5] = depthAttachment;				// framebuffer for swapchain image 1
-			attachments[6] = swapchainImageViews[2];
-			attachments[7] = auxAttachment;
-			attachments[8] = depthAttachment;				// framebuffer for swapchain image 2
-			framebuffers = pvkCreateFramebuffers(logicalGPU, renderPass, window->width, window->height, 3, 3, attachments);
-
-			shadowMapImage = pvkCreateImage(physicalGPU, logicalGPU,
-												VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-												VK_FORMAT_D32_SFLOAT, window->width, window->height,
-												VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-												2, queueFamilyIndices);
-			shadowMapAttachment = pvkCreateImageView(logicalGPU, shadowMapImage.handle, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
-			shadowMapFramebuffer = pvkCreateFramebuffers(logicalGPU, shadowMapRenderPass, window->width, window->height, 1, 1, &shadowMapAttachment);
-
-			pipeline = pvkCreateGraphicsPipeline(logicalGPU, pipelineLayout, renderPass, 0, 1, window->width, window->height, 2,
-													(PvkShader) { fragmentShader, PVK_SHADER_TYPE_FRAGMENT },
-													(PvkShader) { vertexShader, PVK_SHADER_TYPE_VERTEX });
-			pipeline2 = pvkCreateGraphicsPipeline(logicalGPU, pipelineLayout2, renderPass, 1, 1, window->width, window->height, 2,
-													(PvkShader) { fragmentShaderPass2, PVK_SHADER_TYPE_FRAGMENT },
-													(PvkShader) { vertexShaderPass2, PVK_SHADER_TYPE_VERTEX });
-			shadowMapPipeline = pvkCreateShadowMapGraphicsPipeline(logicalGPU, shadowMapPipelineLayout, shadowMapRenderPass, 0, window->width, window->height, 1,
-													(PvkShader) { shadowMapVertexShader, PVK_SHADER_TYPE_VERTEX });
+			/* only the frames in flight and the pending presents have to be finished, the device isn't idled */
+			uint64_t startTime = pvkGetTimeNs();
+			pvkFrameContextWaitIdle(frameContext);
+			if(!isImageAcquired)
+				pvkFrameRecreateImageAvailableSemaphore(logicalGPU, frame);
+			/* the surface got minimized meanwhile, the old swapchain and render targets are kept until it is restored */
+			if(!pvkSwapchainRecreate(swapchain, presentQueue, window->width, window->height))
+			{
+				pvkWindowPollEvents(window);
+				continue;
+			}
+			destroyRenderTargets(logicalGPU, &renderTargets);
+			createRenderTargets(&renderTargets, logicalGPU, memoryAllocator, swapchain, renderPass, shadowMapRenderPass, 2, queueFamilyIndices);
 
 			PVK_DELETE(camera);
 			camera = pvkCreateCamera((float)window->width / window->height, PVK_PROJECTION_TYPE_PERSPECTIVE, 65 DEG);	
-			PvkGlobalData* globalData = PVK_NEW(PvkGlobalData);
 			globalData->projectionMatrix = pvkMat4Transpose(camera->projection);
 			globalData->viewMatrix = pvkMat4Transpose(camera->view);
-			globalData->dirLight.dir = pvkVec3Normalize((PvkVec3) { 1, -1, 0 });
-			globalData->dirLight.intensity = 1.0f;
-			globalData->dirLight.color = (PvkVec3) { 1, 1, 1 };
-			globalData->lightProjectionMatrix = pvkMat4Transpose(pvkMat4OrthoProj(10, 1, 1, 20));
-			globalData->lightViewMatrix = pvkMat4Transpose(pvkMat4Inverse(pvkMat4Mul(pvkMat4Translate((PvkVec3) { -4.0f, 4.0f, 0 }), pvkMat4Rotate((PvkVec3) { -20 DEG, -90 DEG, 0 }))));
-			globalData->ambLight.color = (PvkVec3) { 0.3f, 0.3f, 0.3f };
-			globalData->ambLight.intensity = 1.0f;
-			objectData->modelMatrix = pvkMat4Transpose(pvkMat4Rotate((PvkVec3) { 0 DEG, 0, 0 }));
-			objectData->normalMatrix = pvkMat4Inverse(objectData->modelMatrix);
-			pvkUploadToMemory(logicalGPU, globalUniformBuffer.memory, globalData, sizeof(PvkGlobalData));
-			pvkUploadToMemory(logicalGPU, objectUniformBuffer.memory, objectData, sizeof(PvkObjectData));
-			PVK_DELETE(globalData);
-
-			pvkWriteImageViewToDescriptor(logicalGPU, set[0], 0, auxAttachment, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
-			pvkWriteImageViewToDescriptor(logicalGPU, set[3], 3, shadowMapAttachment, shadowMapSampler, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-
-			recordCommandBuffers(window->width, window->height, commandBuffers,
-								clearValues,
-								renderPass, 
-								shadowMapRenderPass, 
-								shadowMapFramebuffer,
-								framebuffers,
-								shadowMapPipeline,
-								pipeline,
-								pipeline2,
-								shadowMapPipelineLayout,
-								pipelineLayout,
-								pipelineLayout2,
-								set,
-								planeGeometry,
-								boxGeometry);
+
+			pvkDescriptorWriterWriteImageView(&descriptorWriter, set[0], 0, renderTargets.auxAttachment, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
+			pvkDescriptorWriterWriteImageView(&descriptorWriter, set[1], 3, renderTargets.shadowMapAttachment, shadowMapSampler, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+			pvkDescriptorWriterFlush(&descriptorWriter);
+			PVK_INFO("Swapchain recreated (%u x %u) in %.2f ms", swapchain->width, swapchain->height, (double)(pvkGetTimeNs() - startTime) / 1000000.0);
 		}
 
 		pvkWindowPollEvents(window);
 	}
 
 	PVK_CHECK(vkDeviceWaitIdle(logicalGPU));
+	/* how long the CPU was blocked waiting for the GPU to release a frame slot */
+	if(graphicsTimeline != NULL)
+		pvkTimelineLogStats(graphicsTimeline);
+	else
+		pvkFencePoolLogStats(frameContext->fencePool);
+	PVK_INFO("Draw list: %u draws in %u batches, %u indirect calls (multiDrawIndirect: %s, drawIndirectFirstInstance: %s)", 
+				postDrawLists[0]->drawCount, postDrawLists[0]->batchCount, postDrawLists[0]->indirectCallCount,
+				enabledFeatures.multiDrawIndirect ? "enabled" : "disabled", enabledFeatures.drawIndirectFirstInstance ? "enabled" : "disabled");
 
-	pvkDestroyFencePool(logicalGPU, fencePool);
-	pvkDestroySemaphoreCircularPool(logicalGPU, semaphorePool);
 	PVK_DELETE(clearValues);
-	PVK_DELETE(objectData);
+	PVK_DELETE(globalData);
 	PVK_DELETE(camera);
+	for(int i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		pvkDestroyBuffer(logicalGPU, crowdInstanceBuffers[i]);
+		pvkDestroyDrawList(postDrawLists[i]);
+	}
 	pvkDestroyGeometry(logicalGPU, planeGeometry);
 	pvkDestroyGeometry(logicalGPU, boxGeometry);
-	vkDestroyShaderModule(logicalGPU, shadowMapFragmentShader, NULL);
-	vkDestroyShaderModule(logicalGPU, shadowMapVertexShader, NULL);
-	vkDestroyShaderModule(logicalGPU, fragmentShaderPass2, NULL);
-	vkDestroyShaderModule(logicalGPU, vertexShaderPass2, NULL);
-	vkDestroyPipeline(logicalGPU, shadowMapPipeline, NULL);
-	vkDestroyPipeline(logicalGPU, pipeline2, NULL);
-	vkDestroyPipeline(logicalGPU, pipeline, NULL);
-	vkDestroyPipelineLayout(logicalGPU, shadowMapPipelineLayout, NULL);
-	vkDestroyPipelineLayout(logicalGPU, pipelineLayout2, NULL);
-	vkDestroyPipelineLayout(logicalGPU, pipelineLayout, NULL);
-	vkDestroyShaderModule(logicalGPU, fragmentShader, NULL);
-	vkDestroyShaderModule(logicalGPU, vertexShader, NULL);
+	pvkDestroyGeometryPool(geometryPool);
+	pvkDestroyStagingRing(stagingRing);
+	pvkDestroyPipelineRegistry(pipelineRegistry);
+	pvkDestroyPipelineCache(pipelineCache);
+	pvkDestroyShaderCache(shaderCache);
+	pvkDestroyDescriptorTemplate(globalDataTemplate);
+	PVK_DELETE(globalSets);
 	PVK_DELETE(set);
-	for(int i = 0; i < 4; i++)
-		vkDestroyDescriptorSetLayout(logicalGPU, setLayouts[i], NULL);
-	pvkDestroyBuffer(logicalGPU, objectUniformBuffer);
-	pvkDestroyBuffer(logicalGPU, globalUniformBuffer);
+	pvkDestroyLayoutCache(layoutCache);
 	vkDestroyDescriptorPool(logicalGPU, descriptorPool, NULL);
-	pvkDestroyFramebuffers(logicalGPU, 1, shadowMapFramebuffer);
-	PVK_DELETE(shadowMapFramebuffer);
-	vkDestroyImageView(logicalGPU, shadowMapAttachment, NULL);
-	pvkDestroyImage(logicalGPU, shadowMapImage);
 	vkDestroySampler(logicalGPU, shadowMapSampler, NULL);
-	pvkDestroyFramebuffers(logicalGPU, 3, framebuffers);
-	PVK_DELETE(framebuffers);
-	vkDestroyImageView(logicalGPU, depthAttachment, NULL);
-	pvkDestroyImage(logicalGPU, depthImage);
-	vkDestroyImageView(logicalGPU, auxAttachment, NULL);
-	pvkDestroyImage(logicalGPU, auxImage);
-	pvkDestroySwapchainImageViews(logicalGPU, swapchain, swapchainImageViews);
+	destroyRenderTargets(logicalGPU, &renderTargets);
+	pvkDestroyMemoryAllocator(memoryAllocator);
 	vkDestroyRenderPass(logicalGPU, renderPass, NULL);
 	vkDestroyRenderPass(logicalGPU, shadowMapRenderPass, NULL);
-	vkDestroySemaphore(logicalGPU, imageAvailableSemaphore, NULL);
-	vkDestroySemaphore(logicalGPU, renderFinishSemaphore, NULL);
-	PVK_DELETE(commandBuffers);
-	vkDestroyCommandPool(logicalGPU, commandPool, NULL);
-	vkDestroySwapchainKHR(logicalGPU, swapchain, NULL);
+	pvkDestroySubmitBatch(submitBatch);
+	PVK_DELETE(shadowMapCommandBuffers);
+	vkDestroyCommandPool(logicalGPU, shadowMapCommandPool, NULL);
+	pvkDestroyFrameContext(frameContext);
+	if(graphicsTimeline != NULL)
+		pvkDestroyTimeline(graphicsTimeline);
+	pvkDestroySwapchain(swapchain);
 	vkDestroyDevice(logicalGPU, NULL);
 	vkDestroySurfaceKHR(instance, surface, NULL);
 	pvkWindowDestroy(window);